@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * peak_rss REPORT PROGRAM [ARGS...]
+ *
+ * Runs PROGRAM and writes its peak RSS in KiB to REPORT, exiting with its status. run.py measures through this
+ * rather than forking the workload itself: a forked child keeps the parent's high-water mark across exec, so
+ * ru_maxrss would include the Python interpreter, while this process is small by the time it forks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s REPORT PROGRAM [ARGS...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        execvp(argv[2], argv + 2);
+        perror(argv[2]);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return EXIT_FAILURE;
+    }
+
+    FILE *report = fopen(argv[1], "w");
+    if (report == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    fprintf(report, "%ld\n", usage.ru_maxrss);
+    fclose(report);
+
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+#
+# Runs the bench/*.tot workloads. Each one prints the number of operations it
+# completed as its last line; every run is timed, the peak RSS taken through
+# --launcher (the peak_rss helper built next to this script, or GNU time when
+# it is not given), and the median and spread (max - min over the median) of
+# ops/sec reported. --json writes the results, --baseline compares against a
+# file written that way and fails when a workload got slower than --threshold.
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def rss_command(launcher, report):
+    # os.wait4 on a child forked from here reports our own high-water mark as
+    # well, so the workload is started by a small process that reports its rusage
+    if launcher:
+        return [launcher, report]
+    if os.access('/usr/bin/time', os.X_OK):
+        return ['/usr/bin/time', '-f', '%M', '-o', report]
+    sys.exit('peak RSS needs --launcher (build/bench/peak_rss) or /usr/bin/time')
+
+
+def measure(tater, launcher, workload, repeat, extra_args):
+    rates = []
+    peak_rss = 0
+    ops = 0
+    for _ in range(repeat):
+        scratch = tempfile.mkdtemp(prefix='tater-bench-')
+        try:
+            report = os.path.join(scratch, 'peak_rss')
+            start = time.perf_counter()
+            child = subprocess.run(rss_command(launcher, report) + [tater] + extra_args + [os.path.abspath(workload)],
+                cwd=scratch, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+            elapsed = time.perf_counter() - start
+            out = child.stdout
+            with open(report) as f:
+                rss = int(f.read().split()[-1]) # KiB on Linux
+        finally:
+            shutil.rmtree(scratch, ignore_errors=True)
+        if child.returncode != 0:
+            sys.exit('%s failed:\n%s' % (workload, out))
+        lines = out.split()
+        ops = int(lines[-1]) if lines else 0
+        if ops <= 0:
+            sys.exit('%s did not print its operation count' % workload)
+        rates.append(ops / elapsed)
+        peak_rss = max(peak_rss, rss)
+    median = statistics.median(rates)
+    return {
+        'ops': ops,
+        'runs': repeat,
+        'ops_per_sec': median,
+        'min_ops_per_sec': min(rates),
+        'max_ops_per_sec': max(rates),
+        'spread': (max(rates) - min(rates)) / median,
+        'peak_rss_kib': peak_rss,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run the tater benchmark workloads.')
+    parser.add_argument('--tater', required=True, help='tater executable')
+    parser.add_argument('--launcher', help='peak_rss helper that runs tater and reports its peak RSS')
+    parser.add_argument('--repeat', type=int, default=5, help='runs per workload (default 5)')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--baseline', help='compare against results written by --json')
+    parser.add_argument('--threshold', type=float, default=0.10,
+        help='fractional drop in median ops/sec counted as a regression (default 0.10)')
+    parser.add_argument('--args', default='', help='extra tater arguments, e.g. "-j"')
+    parser.add_argument('workloads', nargs='*', help='.tot files (default: every bench/*.tot)')
+    options = parser.parse_args()
+
+    workloads = options.workloads
+    if not workloads:
+        here = os.path.dirname(os.path.abspath(__file__))
+        workloads = sorted(os.path.join(here, name) for name in os.listdir(here) if name.endswith('.tot'))
+
+    results = {}
+    print('%-12s %14s %8s %12s' % ('workload', 'ops/sec', 'spread', 'peak RSS'))
+    for workload in workloads:
+        name = os.path.splitext(os.path.basename(workload))[0]
+        result = measure(options.tater, options.launcher, workload, options.repeat, options.args.split())
+        results[name] = result
+        print('%-12s %14.2f %7.1f%% %9d KiB' % (name, result['ops_per_sec'], result['spread'] * 100, result['peak_rss_kib']))
+
+    if options.json:
+        with open(options.json, 'w') as f:
+            json.dump({'args': options.args, 'repeat': options.repeat, 'results': results}, f, indent=2, sort_keys=True)
+            f.write('\n')
+
+    regressed = False
+    if options.baseline:
+        with open(options.baseline) as f:
+            baseline = json.load(f)['results']
+        print('\n%-12s %14s %14s %8s' % ('workload', 'baseline', 'now', 'change'))
+        for name, result in results.items():
+            if name not in baseline:
+                continue
+            before = baseline[name]['ops_per_sec']
+            change = result['ops_per_sec'] / before - 1
+            flag = ''
+            if change < -options.threshold:
+                flag = '  REGRESSION'
+                regressed = True
+            print('%-12s %14.2f %14.2f %+7.1f%%%s' % (name, before, result['ops_per_sec'], change * 100, flag))
+    return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "aot.h"
+#include "cache.h"
+#include "vmopcodes.h"
+
+static int jump_target(const chunk_t *chunk, const int offset, const int next)
+{
+    const int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    return chunk->code[offset] == OP_LOOP ? next - jump : next + jump;
+}
+
+// one C statement list per instruction, falling back to the interpreter with AOT_EXIT
+static void emit_instruction(FILE *out, const chunk_t *chunk, const int offset, const int next, const bool *start)
+{
+    const uint8_t *code = chunk->code + offset;
+    const int operand = code[1];
+    switch (code[0]) {
+        case OP_CONSTANT: fprintf(out, "    *top++ = K[%d];\n", operand); break;
+        case OP_CONSTANT_LONG: fprintf(out, "    *top++ = K[%d];\n", code[1] | (code[2] << 8) | (code[3] << 16)); break;
+        case OP_NIL: fprintf(out, "    *top++ = NIL_VAL;\n"); break;
+        case OP_TRUE: fprintf(out, "    *top++ = BOOL_VAL(true);\n"); break;
+        case OP_FALSE: fprintf(out, "    *top++ = BOOL_VAL(false);\n"); break;
+        case OP_POP: fprintf(out, "    top--;\n"); break;
+        case OP_POPN: fprintf(out, "    top -= %d;\n", operand); break;
+        case OP_DUP: fprintf(out, "    *top = top[-1];\n    top++;\n"); break;
+        case OP_GET_LOCAL: fprintf(out, "    *top++ = slots[%d];\n", operand); break;
+        case OP_SET_LOCAL: fprintf(out, "    slots[%d] = top[-1];\n", operand); break;
+        case OP_GET_UPVALUE: fprintf(out, "    *top++ = *closure->upvalues[%d]->location;\n", operand); break;
+        case OP_SET_UPVALUE: fprintf(out, "    *closure->upvalues[%d]->location = top[-1];\n", operand); break;
+        case OP_GET_GLOBAL:
+            fprintf(out, "    if (!table_t_get(&vm.globals, K[%d], top)) AOT_EXIT(%d);\n    top++;\n", operand, offset);
+            break;
+        case OP_SET_GLOBAL:
+            // the table can grow and collect, so the stack top is stored first
+            fprintf(out, "    if (!table_t_get(&vm.globals, K[%d], top)) AOT_EXIT(%d);\n", operand, offset);
+            fprintf(out, "    vm.stack_top = top;\n    table_t_set(&vm.globals, K[%d], top[-1]);\n", operand);
+            break;
+        case OP_GET_PROPERTY:
+            fprintf(out, "    if (!IS_INSTANCE(top[-1]) || !table_t_get(&AS_INSTANCE(top[-1])->fields, K[%d], &top[-1])) AOT_EXIT(%d);\n",
+                operand, offset);
+            break;
+        case OP_SET_PROPERTY:
+            fprintf(out, "    if (!IS_INSTANCE(top[-2])) AOT_EXIT(%d);\n", offset);
+            fprintf(out, "    vm.stack_top = top;\n    table_t_set(&AS_INSTANCE(top[-2])->fields, K[%d], top[-1]);\n", operand);
+            fprintf(out, "    top[-2] = top[-1];\n    top--;\n");
+            break;
+        case OP_EQUAL: fprintf(out, "    top[-2] = BOOL_VAL(value_t_equal(top[-2], top[-1]));\n    top--;\n"); break;
+        case OP_GREATER:
+            fprintf(out, "    AOT_NUMBERS(%d);\n    top[-2] = BOOL_VAL(AS_NUMBER(top[-2]) > AS_NUMBER(top[-1]));\n    top--;\n", offset);
+            break;
+        case OP_LESS:
+            fprintf(out, "    AOT_NUMBERS(%d);\n    top[-2] = BOOL_VAL(AS_NUMBER(top[-2]) < AS_NUMBER(top[-1]));\n    top--;\n", offset);
+            break;
+        case OP_ADD: fprintf(out, "    AOT_NUMBERS(%d);\n    top[-2].as.number += AS_NUMBER(top[-1]);\n    top--;\n", offset); break;
+        case OP_SUBTRACT: fprintf(out, "    AOT_NUMBERS(%d);\n    top[-2].as.number -= AS_NUMBER(top[-1]);\n    top--;\n", offset); break;
+        case OP_MULTIPLY: fprintf(out, "    AOT_NUMBERS(%d);\n    top[-2].as.number *= AS_NUMBER(top[-1]);\n    top--;\n", offset); break;
+        case OP_DIVIDE: // division by zero is reported by the interpreter
+            fprintf(out, "    AOT_NUMBERS(%d);\n    if (AS_NUMBER(top[-1]) == 0) AOT_EXIT(%d);\n", offset, offset);
+            fprintf(out, "    top[-2].as.number /= AS_NUMBER(top[-1]);\n    top--;\n");
+            break;
+        case OP_MOD:
+            fprintf(out, "    AOT_NUMBERS(%d);\n    if (AS_NUMBER(top[-1]) == 0) AOT_EXIT(%d);\n", offset, offset);
+            fprintf(out, "    top[-2].as.number = fmod(AS_NUMBER(top[-2]), AS_NUMBER(top[-1]));\n    top--;\n");
+            break;
+        case OP_NOT: fprintf(out, "    top[-1] = BOOL_VAL(AOT_FALSEY(top[-1]));\n"); break;
+        case OP_NEGATE:
+            fprintf(out, "    if (!IS_NUMBER(top[-1])) AOT_EXIT(%d);\n    top[-1].as.number = -top[-1].as.number;\n", offset);
+            break;
+        case OP_PRINT: fprintf(out, "    value_t_print(stdout, top[-1]);\n    putchar('\\n');\n    top--;\n"); break;
+        case OP_JUMP: case OP_LOOP: case OP_JUMP_IF_FALSE: {
+            const int target = jump_target(chunk, offset, next);
+            if (target < 0 || target >= chunk->count || !start[target]) {
+                fprintf(out, "    AOT_EXIT(%d);\n", offset);
+            } else if (code[0] == OP_JUMP_IF_FALSE) {
+                fprintf(out, "    if (AOT_FALSEY(top[-1])) goto L%d;\n", target);
+            } else {
+                fprintf(out, "    goto L%d;\n", target);
+            }
+            break;
+        }
+        default:
+            fprintf(out, "    AOT_EXIT(%d);\n", offset);
+            break;
+    }
+}
+
+// functions are numbered depth first, the function and then its nested functions in constant order
+static bool emit_function(FILE *out, const obj_function_t *function, int *count)
+{
+    const chunk_t *chunk = &function->chunk;
+    const int index = (*count)++;
+    bool *start = calloc(chunk->count + 1, sizeof(bool));
+    bool *entry = calloc(chunk->count + 1, sizeof(bool));
+    bool *label = calloc(chunk->count + 1, sizeof(bool));
+    if (start == NULL || entry == NULL || label == NULL) {
+        fprintf(stderr, "Failed to allocate AOT buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the interpreter enters a frame at its start, right after each call it makes and at loop targets
+    bool ok = chunk->count > 0;
+    entry[0] = true;
+    for (int offset = 0; ok && offset < chunk->count;) {
+        const int length = jit_t_instruction_length(chunk, offset);
+        if (length < 0 || offset + length > chunk->count) {
+            ok = false;
+            break;
+        }
+        start[offset] = true;
+        if (jit_t_is_call(chunk, offset)) {
+            entry[offset + length] = true;
+        }
+        offset += length;
+    }
+    for (int offset = 0; ok && offset < chunk->count; offset += jit_t_instruction_length(chunk, offset)) {
+        const uint8_t op = chunk->code[offset];
+        if (op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP) {
+            const int target = jump_target(chunk, offset, offset + 3);
+            if (target >= 0 && target < chunk->count && start[target]) {
+                label[target] = true;
+                entry[target] = entry[target] || op == OP_LOOP;
+            }
+        }
+    }
+
+    if (ok) {
+        fprintf(out, "// %s\n", function->name != NULL ? function->name->chars : "<script>");
+        fprintf(out, "static uint8_t *f%d(value_t *slots __unused__, obj_closure_t *closure, const void *target)\n{\n", index);
+        fprintf(out, "    uint8_t *code = closure->function->chunk.code;\n");
+        fprintf(out, "    const value_t *K __unused__ = closure->function->chunk.constants.values;\n");
+        fprintf(out, "    value_t *top = vm.stack_top;\n");
+        fprintf(out, "    switch ((uintptr_t)target) {\n");
+        for (int offset = 1; offset < chunk->count; offset++) {
+            if (entry[offset] && start[offset]) {
+                fprintf(out, "        case %d: goto L%d;\n", offset + 1, offset);
+            }
+        }
+        fprintf(out, "        default: break; // the start of the function\n    }\n");
+        for (int offset = 0; offset < chunk->count;) {
+            const int next = offset + jit_t_instruction_length(chunk, offset);
+            if ((entry[offset] && offset > 0) || label[offset]) {
+                fprintf(out, "L%d:\n", offset);
+            }
+            fprintf(out, "    // %04d %s\n", offset, chunk->code[offset] < INVALID_OPCODE ? op_code_name[chunk->code[offset]] : "?");
+            emit_instruction(out, chunk, offset, next, start);
+            offset = next;
+        }
+        fprintf(out, "    AOT_EXIT(%d);\n}\n", chunk->count - 1); // unreachable, the last instruction is a return
+
+        fprintf(out, "static const int e%d[] = {", index);
+        for (int offset = 0; offset < chunk->count; offset++) {
+            if (entry[offset] && start[offset]) {
+                fprintf(out, "%s%d", offset ? ", " : "", offset);
+            }
+        }
+        fprintf(out, "};\n\n");
+    }
+    free(start);
+    free(entry);
+    free(label);
+
+    for (int i = 0; ok && i < chunk->constants.count; i++) {
+        if (IS_FUNCTION(chunk->constants.values[i])) {
+            ok = emit_function(out, AS_FUNCTION(chunk->constants.values[i]), count);
+        }
+    }
+    return ok;
+}
+
+bool aot_t_emit_c(obj_function_t *script, const char *source_path, const char *output_path)
+{
+    char *bytecode = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&bytecode, &size);
+    if (stream == NULL) {
+        perror(output_path);
+        return false;
+    }
+    const bool serialized = cache_t_write_function(stream, script);
+    if (fclose(stream) != 0 || !serialized) {
+        fprintf(stderr, gettext("Failed to serialize \"%s\".\n"), source_path);
+        free(bytecode);
+        return false;
+    }
+
+    FILE *out = fopen(output_path, "w");
+    if (out == NULL) {
+        perror(output_path);
+        free(bytecode);
+        return false;
+    }
+    fprintf(out, "// generated by tater --emit-c from %s\n", source_path);
+    fprintf(out, "// build with: cc -O2 -I<tater>/src -o program %s libtatertot.a -lm\n", output_path);
+    fprintf(out, "#include \"aot.h\"\n\n");
+    fprintf(out, "static const uint8_t bytecode[] = {");
+    for (size_t i = 0; i < size; i++) {
+        fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n    ", (uint8_t)bytecode[i]);
+    }
+    fprintf(out, "\n};\n\n");
+    free(bytecode);
+
+    int count = 0;
+    bool ok = emit_function(out, script, &count);
+    if (ok) {
+        fprintf(out, "static const aot_function_t functions[] = {\n");
+        for (int i = 0; i < count; i++) {
+            fprintf(out, "    {.run = f%d, .entries = e%d, .entry_count = sizeof e%d / sizeof e%d[0]},\n", i, i, i, i);
+        }
+        fprintf(out, "};\n\n");
+        fprintf(out, "int main(const int argc, const char *argv[])\n{\n");
+        fprintf(out, "    return aot_t_main(argc, argv, bytecode, sizeof bytecode, %d, functions, %d);\n}\n", CACHE_FORMAT_VERSION, count);
+    }
+    if (fclose(out) != 0 || !ok) {
+        fprintf(stderr, gettext("Failed to write C file \"%s\".\n"), output_path);
+        unlink(output_path);
+        return false;
+    }
+    return true;
+}
+
+// give each function its C code, in the order aot_t_emit_c numbered them, returning the next index or -1
+static int attach(obj_function_t *function, const aot_function_t *functions, const int function_count, int index)
+{
+    if (index >= function_count) {
+        return -1;
+    }
+    const aot_function_t *aot = &functions[index++];
+    jit_t *jit = malloc(sizeof *jit);
+    const void **entries = calloc(function->chunk.count + 1, sizeof *entries);
+    if (jit == NULL || entries == NULL) {
+        fprintf(stderr, "Failed to allocate AOT function.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < aot->entry_count; i++) {
+        const int offset = aot->entries[i];
+        if (offset >= 0 && offset < function->chunk.count) {
+            entries[offset] = (const void*)(uintptr_t)(offset + 1); // the case label in the generated switch
+        }
+    }
+    *jit = (jit_t){.run = aot->run, .code = NULL, .size = 0, .entries = entries};
+    function->jit = jit;
+
+    for (int i = 0; index >= 0 && i < function->chunk.constants.count; i++) {
+        if (IS_FUNCTION(function->chunk.constants.values[i])) {
+            index = attach(AS_FUNCTION(function->chunk.constants.values[i]), functions, function_count, index);
+        }
+    }
+    return index;
+}
+
+int aot_t_main(const int argc, const char *argv[], const uint8_t *bytecode, const size_t size, const int format_version,
+    const aot_function_t *functions, const int function_count)
+{
+    if (format_version != CACHE_FORMAT_VERSION) {
+        fprintf(stderr, gettext("Compiled for bytecode format %d, this libtatertot reads %d.\n"), format_version, CACHE_FORMAT_VERSION);
+        return EXIT_FAILURE;
+    }
+    vm_t_init();
+    vm_set_argc_argv(argc, argv);
+    vm_inherit_env();
+
+    int rv = EXIT_FAILURE;
+    obj_function_t *script = cache_t_read_function(bytecode, size);
+    if (script == NULL || attach(script, functions, function_count, 0) != function_count) {
+        fprintf(stderr, gettext("The embedded bytecode does not match the compiled functions.\n"));
+    } else {
+        switch (vm_t_interpret_function(script)) {
+            case INTERPRET_OK:
+            case INTERPRET_EXIT_OK:
+                rv = EXIT_SUCCESS;
+                break;
+            default:
+                break;
+        }
+    }
+    vm_t_free();
+    return rv;
+}
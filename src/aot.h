@@ -0,0 +1,49 @@
+#ifndef tater_aot_h
+#define tater_aot_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "jit.h"
+#include "vm.h"
+
+/*
+ * Ahead-of-time compilation: aot_t_emit_c translates a script to C, one
+ * function per tater function following the jit_fn_t contract, plus the
+ * script's bytecode. The generated main hands both to aot_t_main, which loads
+ * the bytecode and attaches the C functions the way the JIT attaches native
+ * code, so calls, returns and anything else left out run in the interpreter.
+ */
+typedef struct {
+    jit_fn_t run;
+    const int *entries; // bytecode offsets run can be entered at
+    int entry_count;
+} aot_function_t;
+
+// used by the generated code, where code, top and the frame arguments are in scope
+#define AOT_EXIT(offset) do { vm.stack_top = top; return code + (offset); } while (false)
+#define AOT_NUMBERS(offset) do { if (!IS_NUMBER(top[-1]) || !IS_NUMBER(top[-2])) AOT_EXIT(offset); } while (false)
+#define AOT_FALSEY(value) (IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value)) || (IS_NUMBER(value) && AS_NUMBER(value) == 0))
+
+bool aot_t_emit_c(obj_function_t *script, const char *source_path, const char *output_path);
+int aot_t_main(const int argc, const char *argv[], const uint8_t *bytecode, const size_t size, const int format_version,
+    const aot_function_t *functions, const int function_count);
+
+#endif
@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "cache.h"
+#include "compiler.h"
+#include "memory.h"
+#include "type.h"
+#include "vm.h"
+
+#define CACHE_BYTE_ORDER_MARK 0x01020304u
+
+typedef enum {
+    CACHE_CONSTANT_NIL,
+    CACHE_CONSTANT_BOOL,
+    CACHE_CONSTANT_NUMBER,
+    CACHE_CONSTANT_STRING,
+    CACHE_CONSTANT_FUNCTION,
+    CACHE_CONSTANT_LIST,
+    CACHE_CONSTANT_MAP,
+} cache_constant_t;
+
+typedef struct {
+    char magic[CACHE_FILE_MAGIC_LEN];
+    uint32_t format_version;
+    uint32_t opcode_count;
+    uint32_t byte_order_mark;
+    uint32_t optimization_level; // the -O it was compiled at, a run at another level compiles the source instead
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_size;
+    uint64_t source_hash;
+} cache_header_t;
+
+typedef struct {
+    const uint8_t *current;
+    const uint8_t *end;
+} cache_reader_t;
+
+static uint64_t hash_source(const char *source)
+{
+    uint64_t hash = 14695981039346656037u;
+    for (const char *c = source; *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+static bool cache_header_t_init(cache_header_t *header, const char *source_path, const char *source)
+{
+    struct stat statbuf;
+    if (stat(source_path, &statbuf) == -1) {
+        return false;
+    }
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_LEN);
+    header->format_version = CACHE_FORMAT_VERSION;
+    header->opcode_count = INVALID_OPCODE;
+    header->byte_order_mark = CACHE_BYTE_ORDER_MARK;
+    header->optimization_level = (uint32_t)compiler_t_get_optimization_level();
+    header->source_mtime_sec = statbuf.st_mtim.tv_sec;
+    header->source_mtime_nsec = statbuf.st_mtim.tv_nsec;
+    header->source_size = statbuf.st_size;
+    header->source_hash = hash_source(source);
+    return true;
+}
+
+static bool write_bytes(FILE *f, const void *bytes, const size_t length)
+{
+    return length == 0 || fwrite(bytes, 1, length, f) == length;
+}
+
+static bool write_int(FILE *f, const int32_t value)
+{
+    return write_bytes(f, &value, sizeof value);
+}
+
+static bool write_string(FILE *f, const obj_string_t *string)
+{
+    if (string == NULL) {
+        return write_int(f, -1);
+    }
+    return write_int(f, string->length) && write_bytes(f, string->chars, string->length);
+}
+
+static bool write_function(FILE *f, const obj_function_t *function);
+
+// lists and maps only show up as switch tables, holding numbers and strings
+static bool write_constant(FILE *f, const value_t constant)
+{
+    uint8_t tag;
+    if (IS_NIL(constant)) {
+        tag = CACHE_CONSTANT_NIL;
+        return write_bytes(f, &tag, 1);
+    } else if (IS_BOOL(constant)) {
+        tag = CACHE_CONSTANT_BOOL;
+        const uint8_t b = AS_BOOL(constant);
+        return write_bytes(f, &tag, 1) && write_bytes(f, &b, 1);
+    } else if (IS_NUMBER(constant)) {
+        tag = CACHE_CONSTANT_NUMBER;
+        const double n = AS_NUMBER(constant);
+        return write_bytes(f, &tag, 1) && write_bytes(f, &n, sizeof n);
+    } else if (IS_STRING(constant)) {
+        tag = CACHE_CONSTANT_STRING;
+        return write_bytes(f, &tag, 1) && write_string(f, AS_STRING(constant));
+    } else if (IS_FUNCTION(constant)) {
+        tag = CACHE_CONSTANT_FUNCTION;
+        return write_bytes(f, &tag, 1) && write_function(f, AS_FUNCTION(constant));
+    } else if (IS_LIST(constant)) {
+        tag = CACHE_CONSTANT_LIST;
+        const value_list_t *elements = &AS_LIST(constant)->elements;
+        bool ok = write_bytes(f, &tag, 1) && write_int(f, elements->count);
+        for (int i = 0; ok && i < elements->count; i++) {
+            ok = write_constant(f, elements->values[i]);
+        }
+        return ok;
+    } else if (IS_MAP(constant)) {
+        tag = CACHE_CONSTANT_MAP;
+        const table_t *table = &AS_MAP(constant)->table;
+        bool ok = write_bytes(f, &tag, 1) && write_int(f, table->count);
+        for (int i = 0; ok && i < table->capacity; i++) {
+            if (!IS_EMPTY(table->entries[i].key)) {
+                ok = write_constant(f, table->entries[i].key) && write_constant(f, table->entries[i].value);
+            }
+        }
+        return ok;
+    }
+    return false; // the compiler only produces the constant types above
+}
+
+static bool write_function(FILE *f, const obj_function_t *function)
+{
+    const chunk_t *chunk = &function->chunk;
+    if (function->lazy != NULL) {
+        return false; // cached code is always compiled eagerly
+    }
+    if (!write_int(f, function->arity) ||
+        !write_int(f, function->upvalue_count) ||
+        !write_int(f, function->max_slots) ||
+        !write_string(f, function->name) ||
+        !write_int(f, chunk->count) ||
+        !write_bytes(f, chunk->code, chunk->count) ||
+        !write_int(f, chunk->line_count)) {
+        return false;
+    }
+    for (int i = 0; i < chunk->line_count; i++) {
+        if (!write_int(f, chunk->lines[i].offset) || !write_int(f, chunk->lines[i].line)) {
+            return false;
+        }
+    }
+
+    if (!write_int(f, chunk->constants.count)) {
+        return false;
+    }
+    for (int i = 0; i < chunk->constants.count; i++) {
+        if (!write_constant(f, chunk->constants.values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool cache_t_write_function(FILE *f, const obj_function_t *function)
+{
+    return write_function(f, function);
+}
+
+bool cache_t_write(const char *cache_path, const char *source_path, const char *source, const obj_function_t *function)
+{
+    cache_header_t header;
+    if (!cache_header_t_init(&header, source_path, source)) {
+        perror(source_path);
+        return false;
+    }
+
+    // write to a temporary and rename so concurrent runs never see a partial cache
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, PATH_MAX, "%s.%d", cache_path, (int)getpid()) >= PATH_MAX) {
+        fprintf(stderr, gettext("Cache path too long \"%s\".\n"), cache_path);
+        return false;
+    }
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        perror(tmp_path);
+        return false;
+    }
+    const bool ok = write_bytes(f, &header, sizeof header) && write_function(f, function);
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, gettext("Failed to write cache file \"%s\".\n"), tmp_path);
+        unlink(tmp_path);
+        return false;
+    }
+    if (rename(tmp_path, cache_path) == -1) {
+        perror(cache_path);
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+static bool read_bytes(cache_reader_t *reader, void *bytes, const size_t length)
+{
+    if ((size_t)(reader->end - reader->current) < length) {
+        return false;
+    }
+    memcpy(bytes, reader->current, length);
+    reader->current += length;
+    return true;
+}
+
+static bool read_int(cache_reader_t *reader, int32_t *value)
+{
+    return read_bytes(reader, value, sizeof *value);
+}
+
+static bool read_string(cache_reader_t *reader, obj_string_t **string)
+{
+    int32_t length;
+    if (!read_int(reader, &length)) {
+        return false;
+    }
+    if (length == -1) {
+        *string = NULL;
+        return true;
+    }
+    if (length < 0 || reader->end - reader->current < length) {
+        return false;
+    }
+    *string = obj_string_t_copy_from((const char *)reader->current, length, true);
+    reader->current += length;
+    return true;
+}
+
+static obj_function_t *read_function(cache_reader_t *reader);
+
+// anything allocated is left on the vm stack on failure, callers unwind it
+static bool read_constant(cache_reader_t *reader, value_t *constant)
+{
+    uint8_t tag;
+    if (!read_bytes(reader, &tag, 1)) {
+        return false;
+    }
+    switch (tag) {
+        case CACHE_CONSTANT_NIL: *constant = NIL_VAL; return true;
+        case CACHE_CONSTANT_BOOL: {
+            uint8_t b;
+            if (!read_bytes(reader, &b, 1)) return false;
+            *constant = BOOL_VAL(b != 0);
+            return true;
+        }
+        case CACHE_CONSTANT_NUMBER: {
+            double n;
+            if (!read_bytes(reader, &n, sizeof n)) return false;
+            *constant = NUMBER_VAL(n);
+            return true;
+        }
+        case CACHE_CONSTANT_STRING: {
+            obj_string_t *string;
+            if (!read_string(reader, &string) || string == NULL) return false;
+            *constant = OBJ_VAL(string);
+            return true;
+        }
+        case CACHE_CONSTANT_FUNCTION: {
+            obj_function_t *nested = read_function(reader);
+            if (nested == NULL) return false;
+            *constant = OBJ_VAL(nested);
+            return true;
+        }
+        case CACHE_CONSTANT_LIST: {
+            int32_t count;
+            obj_list_t *list = obj_list_t_allocate();
+            vm_push(OBJ_VAL(list));
+            if (!read_int(reader, &count) || count < 0) return false;
+            for (int i = 0; i < count; i++) {
+                value_t element;
+                if (!read_constant(reader, &element)) return false;
+                value_list_t_add(&list->elements, element);
+            }
+            *constant = vm_pop();
+            return true;
+        }
+        case CACHE_CONSTANT_MAP: {
+            int32_t count;
+            obj_map_t *map = obj_map_t_allocate();
+            vm_push(OBJ_VAL(map));
+            if (!read_int(reader, &count) || count < 0) return false;
+            for (int i = 0; i < count; i++) {
+                value_t key, value;
+                if (!read_constant(reader, &key) || !(IS_NUMBER(key) || IS_STRING(key))) return false;
+                vm_push(key);
+                if (!read_constant(reader, &value)) return false;
+                table_t_set(&map->table, key, value);
+                vm_pop();
+            }
+            *constant = vm_pop();
+            return true;
+        }
+        default: return false;
+    }
+}
+
+// the function under construction is kept on the vm stack so it survives collections
+static obj_function_t *read_function(cache_reader_t *reader)
+{
+    obj_function_t *function = obj_function_t_allocate();
+    vm_push(OBJ_VAL(function));
+
+    int32_t arity, upvalue_count, max_slots, count;
+    if (!read_int(reader, &arity) || !read_int(reader, &upvalue_count) || upvalue_count < 0 ||
+        !read_int(reader, &max_slots) || max_slots < 0) {
+        return NULL;
+    }
+    function->arity = arity;
+    function->upvalue_count = upvalue_count;
+    function->max_slots = max_slots;
+    if (!read_string(reader, &function->name)) {
+        return NULL;
+    }
+
+    chunk_t *chunk = &function->chunk;
+    if (!read_int(reader, &count) || count < 0 || reader->end - reader->current < count) {
+        return NULL;
+    }
+    chunk->code = ALLOCATE(uint8_t, count);
+    chunk->capacity = count;
+    if (!read_bytes(reader, chunk->code, count)) {
+        return NULL;
+    }
+    chunk->count = count;
+
+    if (!read_int(reader, &count) || count < 0 || (reader->end - reader->current) / (ptrdiff_t)sizeof(line_info_t) < count) {
+        return NULL;
+    }
+    chunk->lines = ALLOCATE(line_info_t, count);
+    chunk->line_capacity = count;
+    for (int i = 0; i < count; i++) {
+        if (!read_int(reader, &chunk->lines[i].offset) || !read_int(reader, &chunk->lines[i].line)) {
+            return NULL;
+        }
+        chunk->line_count++;
+    }
+
+    if (!read_int(reader, &count) || count < 0) {
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        value_t constant;
+        if (!read_constant(reader, &constant)) {
+            return NULL;
+        }
+        chunk_t_add_constant(chunk, constant);
+    }
+
+    vm_pop();
+    return function;
+}
+
+obj_function_t *cache_t_read_function(const uint8_t *bytes, const size_t size)
+{
+    cache_reader_t reader = {.current = bytes, .end = bytes + size};
+    const ptrdiff_t stack_depth = vm.stack_top - vm.stack; // the stack can move while reading
+    obj_function_t *function = read_function(&reader);
+    if (function == NULL || reader.current != reader.end) {
+        vm.stack_top = vm.stack + stack_depth; // unwind anything a malformed cache left behind
+        return NULL;
+    }
+    return function;
+}
+
+obj_function_t *cache_t_load(const char *cache_path, const char *source_path, const char *source)
+{
+    const int fd = open(cache_path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1 || (size_t)statbuf.st_size < sizeof(cache_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    uint8_t *mapped = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return NULL;
+    }
+
+    cache_reader_t reader = {.current = mapped, .end = mapped + statbuf.st_size};
+    obj_function_t *function = NULL;
+
+    cache_header_t expected, header;
+    if (cache_header_t_init(&expected, source_path, source) &&
+        read_bytes(&reader, &header, sizeof header) &&
+        memcmp(&header, &expected, sizeof header) == 0) {
+        function = cache_t_read_function(reader.current, reader.end - reader.current);
+    }
+
+    munmap(mapped, statbuf.st_size);
+    return function;
+}
+#undef CACHE_BYTE_ORDER_MARK
@@ -0,0 +1,38 @@
+#ifndef tater_cache_h
+#define tater_cache_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "type.h"
+
+// foo.tot -> foo.totc
+#define CACHE_FILE_SUFFIX "c"
+#define CACHE_FILE_MAGIC "TOTC"
+#define CACHE_FILE_MAGIC_LEN 4
+// bump whenever the serialized layout or opcode encoding changes
+#define CACHE_FORMAT_VERSION 5
+
+bool cache_t_write(const char *cache_path, const char *source_path, const char *source, const obj_function_t *function);
+obj_function_t *cache_t_load(const char *cache_path, const char *source_path, const char *source);
+// the function alone, without the header tying it to a source file
+bool cache_t_write_function(FILE *f, const obj_function_t *function);
+obj_function_t *cache_t_read_function(const uint8_t *bytes, const size_t size);
+
+#endif
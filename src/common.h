@@ -37,6 +37,7 @@
 #endif
 
 #define UINT8_COUNT (UINT8_MAX + 1)
+#define UINT16_COUNT (UINT16_MAX + 1)
 
 #define CPP_STRINGIFY_NX(s) #s
 #define CPP_STRINGIFY(s) CPP_STRINGIFY_NX(s)
@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,7 +26,9 @@
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "ir.h"
 #include "memory.h"
+#include "probes.h"
 #include "type.h"
 #include "scanner.h"
 #include "vmopcodes.h"
@@ -69,7 +72,7 @@ typedef struct {
 } local_t;
 
 typedef struct {
-    uint8_t index;
+    uint16_t index;
     bool is_local;
 } upvalue_t;
 
@@ -81,16 +84,27 @@ typedef enum {
 } function_type_t;
 
 typedef struct compiler {
-    local_t locals[UINT8_COUNT];
-    upvalue_t upvalues[UINT8_COUNT];
+    local_t *locals; // up to UINT16_COUNT, past a byte they are reached with OP_WIDE
+    upvalue_t *upvalues;
+    int local_capacity;
+    int upvalue_capacity;
     table_t string_constants;
     struct compiler *enclosing;
     obj_function_t *function;
     function_type_t type;
     int local_count;
     int scope_depth;
+    int operand_start; // where the left operand of the infix being compiled begins
+    int last_call; // offset of the most recent OP_CALL, a tail call if the return follows it directly
+    const value_list_t *lazy_upvalue_names; // upvalues resolved when the body was skimmed
 } compiler_t;
 
+// code that can never run is still compiled so it is checked for errors, then thrown away
+typedef struct {
+    int code_count;
+    int loop_end;
+} dead_code_t;
+
 typedef struct type_compiler {
     struct type_compiler *enclosing;
     bool has_supertype;
@@ -101,6 +115,8 @@ static compiler_t *current = NULL;
 static type_compiler_t *current_type = NULL;
 static int compiler_count = 0;
 static bool compiler_debug = false;
+static bool compiler_skimming = false;
+static int compiler_optimization_level = 1; // 0 none, 1 folding, 2 adds the ir passes
 
 #define MAX_COMPILERS 1024
 #define MAX_PARAMETERS 255
@@ -211,19 +227,42 @@ static void emit_return(void)
     emit_byte(OP_RETURN);
 }
 
-static uint8_t make_constant(const value_t value)
+static int make_constant(const value_t value)
 {
     const int constant = chunk_t_add_constant(current_chunk(), value);
-    if (constant > UINT8_MAX) {
-        error(gettext("Too many constants in one chunk.")); // See OP_CONSTANT_LONG to fix
+    if (constant > UINT16_MAX) {
+        error(gettext("Too many constants in one chunk."));
         return 0;
     }
-    return (uint8_t)constant;
+    return constant;
+}
+
+// operands past a byte get the OP_WIDE prefix and a two byte index
+static void emit_wide(const uint8_t instruction, const int index)
+{
+    emit_bytes(OP_WIDE, instruction);
+    emit_bytes((index >> 8) & 0xff, index & 0xff);
+}
+
+static void emit_indexed(const uint8_t instruction, const int index)
+{
+    if (index > UINT8_MAX) {
+        emit_wide(instruction, index);
+    } else {
+        emit_bytes(instruction, (uint8_t)index);
+    }
 }
 
 static void emit_constant(const value_t value)
 {
-    emit_bytes(OP_CONSTANT, make_constant(value));
+    const int constant = make_constant(value);
+    if (constant > UINT8_MAX) {
+        emit_byte(OP_CONSTANT_LONG);
+        emit_bytes(constant & 0xff, (constant >> 8) & 0xff);
+        emit_byte((constant >> 16) & 0xff);
+    } else {
+        emit_bytes(OP_CONSTANT, (uint8_t)constant);
+    }
 }
 
 static void patch_jump(const int offset)
@@ -236,6 +275,185 @@ static void patch_jump(const int offset)
     current_chunk()->code[offset + 1] = jump & 0xff;
 }
 
+/*
+ * Constant folding works on the bytecode just emitted: an operand whose code
+ * is exactly one constant instruction is known at compile time, so the operator
+ * can be evaluated here and its operands rewound and replaced by the result.
+ * Anything the VM would reject at runtime (mixed types, divide by zero, out of
+ * range bitwise operands) is left alone so the error still happens there.
+ */
+static int long_constant_index(const chunk_t *chunk, const int offset)
+{
+    return chunk->code[offset + 1] | (chunk->code[offset + 2] << 8) | (chunk->code[offset + 3] << 16);
+}
+
+static bool constant_at(const int offset, const int end, value_t *value)
+{
+    const chunk_t *chunk = current_chunk();
+    if (offset >= end) {
+        return false;
+    }
+    switch (chunk->code[offset]) {
+        case OP_CONSTANT:
+            *value = chunk->constants.values[chunk->code[offset + 1]];
+            return offset + 2 == end;
+        case OP_CONSTANT_LONG:
+            *value = chunk->constants.values[long_constant_index(chunk, offset)];
+            return offset + 4 == end;
+        case OP_NIL: *value = NIL_VAL; return offset + 1 == end;
+        case OP_TRUE: *value = TRUE_VAL; return offset + 1 == end;
+        case OP_FALSE: *value = FALSE_VAL; return offset + 1 == end;
+        default: return false;
+    }
+}
+
+static bool constant_is_falsey(const value_t value)
+{
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value)) || (IS_NUMBER(value) && fabs(AS_NUMBER(value)) == 0);
+}
+
+static bool constant_is_integral(const value_t value)
+{
+    // the VM casts bitwise operands to long long, which is undefined outside this range
+    return IS_NUMBER(value) && AS_NUMBER(value) >= -9223372036854775808.0 && AS_NUMBER(value) < 9223372036854775808.0;
+}
+
+// drop the operands from offset onward, releasing their pool entries when nothing else can refer to them yet
+// rewinding past the last call means the bytes at last_call are no longer that call
+static void truncate_code(const int offset)
+{
+    chunk_t_truncate(current_chunk(), offset);
+    if (current->last_call >= offset) {
+        current->last_call = -1;
+    }
+}
+
+static void rewind_constants(const int offset)
+{
+    chunk_t *chunk = current_chunk();
+    int indexes[2];
+    int index_count = 0;
+    for (int i = offset; i < chunk->count; i += chunk->code[i] == OP_CONSTANT ? 2 : chunk->code[i] == OP_CONSTANT_LONG ? 4 : 1) {
+        if (chunk->code[i] == OP_CONSTANT && index_count < 2) {
+            indexes[index_count++] = chunk->code[i + 1];
+        } else if (chunk->code[i] == OP_CONSTANT_LONG && index_count < 2) {
+            indexes[index_count++] = long_constant_index(chunk, i);
+        }
+    }
+    while (index_count > 0 && indexes[index_count - 1] == chunk->constants.count - 1) {
+        chunk->constants.count--;
+        index_count--;
+    }
+    truncate_code(offset);
+}
+
+static void emit_folded(const int offset, const value_t result)
+{
+    vm_push(result); // the operands may have been the only reference to a string result's parts
+    rewind_constants(offset);
+    if (IS_NIL(result)) {
+        emit_byte(OP_NIL);
+    } else if (IS_BOOL(result)) {
+        emit_byte(AS_BOOL(result) ? OP_TRUE : OP_FALSE);
+    } else {
+        emit_constant(result);
+    }
+    vm_pop();
+}
+
+static bool fold_unary(const token_type_t operator_type, const int operand_start)
+{
+    value_t a;
+    if (compiler_optimization_level < 1 || !constant_at(operand_start, current_chunk()->count, &a)) {
+        return false;
+    }
+    switch (operator_type) {
+        case TOKEN_BANG: emit_folded(operand_start, BOOL_VAL(constant_is_falsey(a))); return true;
+        case TOKEN_MINUS:
+            if (!IS_NUMBER(a)) return false;
+            emit_folded(operand_start, NUMBER_VAL(-AS_NUMBER(a)));
+            return true;
+        case TOKEN_BIT_NOT:
+            if (!constant_is_integral(a)) return false;
+            emit_folded(operand_start, NUMBER_VAL((double)(~(long long)AS_NUMBER(a))));
+            return true;
+        default: return false;
+    }
+}
+
+static bool fold_binary(const token_type_t operator_type, const int left_start, const int right_start)
+{
+    value_t a, b;
+    if (compiler_optimization_level < 1 ||
+        !constant_at(left_start, right_start, &a) ||
+        !constant_at(right_start, current_chunk()->count, &b)) {
+        return false;
+    }
+
+    if (operator_type == TOKEN_EQUAL_EQUAL || operator_type == TOKEN_BANG_EQUAL) {
+        emit_folded(left_start, BOOL_VAL(value_t_equal(a, b) == (operator_type == TOKEN_EQUAL_EQUAL)));
+        return true;
+    }
+    if (operator_type == TOKEN_PLUS && IS_STRING(a) && IS_STRING(b)) {
+        const obj_string_t *sa = AS_STRING(a), *sb = AS_STRING(b);
+        const int length = sa->length + sb->length;
+        char *chars = ALLOCATE(char, length + 1);
+        memcpy(chars, sa->chars, sa->length);
+        memcpy(chars + sa->length, sb->chars, sb->length);
+        chars[length] = '\0';
+        emit_folded(left_start, OBJ_VAL(obj_string_t_copy_own(chars, length, true)));
+        return true;
+    }
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+        return false;
+    }
+
+    const double x = AS_NUMBER(a), y = AS_NUMBER(b);
+    const bool integral = constant_is_integral(a) && constant_is_integral(b);
+    value_t result;
+    switch (operator_type) {
+        // >= and <= compile to a negated < and >, so NaN must fold the same way
+        case TOKEN_GREATER: result = BOOL_VAL(x > y); break;
+        case TOKEN_GREATER_EQUAL: result = BOOL_VAL(!(x < y)); break;
+        case TOKEN_LESS: result = BOOL_VAL(x < y); break;
+        case TOKEN_LESS_EQUAL: result = BOOL_VAL(!(x > y)); break;
+        case TOKEN_PLUS: result = NUMBER_VAL(x + y); break;
+        case TOKEN_MINUS: result = NUMBER_VAL(x - y); break;
+        case TOKEN_STAR: result = NUMBER_VAL(x * y); break;
+        case TOKEN_SLASH:
+            if (y == 0) return false;
+            result = NUMBER_VAL(x / y);
+            break;
+        case TOKEN_MOD:
+            if (y == 0) return false;
+            result = NUMBER_VAL(fmod(x, y));
+            break;
+        case TOKEN_BIT_OR:
+            if (!integral) return false;
+            result = NUMBER_VAL((double)((long long)x | (long long)y));
+            break;
+        case TOKEN_BIT_AND:
+            if (!integral) return false;
+            result = NUMBER_VAL((double)((long long)x & (long long)y));
+            break;
+        case TOKEN_BIT_XOR:
+            if (!integral) return false;
+            result = NUMBER_VAL((double)((long long)x ^ (long long)y));
+            break;
+        case TOKEN_SHIFT_LEFT:
+            if (!integral || x < 0 || y < 0 || y >= 63 || x >= ldexp(1.0, 63 - (int)y)) return false;
+            result = NUMBER_VAL((double)((long long)x << (long long)y));
+            break;
+        case TOKEN_SHIFT_RIGHT:
+            if (!integral || y < 0 || y >= 63) return false;
+            result = NUMBER_VAL((double)((long long)x >> (long long)y));
+            break;
+        default: return false;
+    }
+    emit_folded(left_start, result);
+    return true;
+}
+
 static void compiler_t_init(compiler_t *compiler, const function_type_t type)
 {
     if (compiler_count >= MAX_COMPILERS) {
@@ -246,8 +464,15 @@ static void compiler_t_init(compiler_t *compiler, const function_type_t type)
     compiler->enclosing = current;
     compiler->function = NULL;
     compiler->type = type;
+    compiler->locals = NULL;
+    compiler->upvalues = NULL;
+    compiler->local_capacity = 0;
+    compiler->upvalue_capacity = 0;
     compiler->local_count = 0;
     compiler->scope_depth = 0;
+    compiler->operand_start = 0;
+    compiler->last_call = -1;
+    compiler->lazy_upvalue_names = NULL;
     compiler->function = obj_function_t_allocate();
     table_t_init(&compiler->string_constants);
 
@@ -257,7 +482,10 @@ static void compiler_t_init(compiler_t *compiler, const function_type_t type)
         current->function->name = obj_string_t_copy_from(parser.previous.start, parser.previous.length, true);
     }
 
+    current->local_capacity = GROW_CAPACITY(0);
+    current->locals = GROW_ARRAY(local_t, NULL, 0, current->local_capacity);
     local_t *local = &current->locals[current->local_count++];
+    current->function->max_slots = current->local_count;
     local->depth = 0;
     local->is_captured = false;
     if (type != TYPE_FUNCTION) {
@@ -269,19 +497,39 @@ static void compiler_t_init(compiler_t *compiler, const function_type_t type)
     }
 }
 
-static obj_function_t *compiler_t_end(const bool debug)
+// the upvalues outlive this, function() still emits them into the enclosing chunk
+static obj_function_t *compiler_t_pop(void)
 {
-    emit_return();
     table_t_free(&current->string_constants);
+    FREE_ARRAY(local_t, current->locals, current->local_capacity);
     obj_function_t *function_obj = current->function;
-    if (debug || parser.had_error) {
-        chunk_t_disassemble(current_chunk(), function_obj->name != NULL ? function_obj->name->chars : "<main>");
-    }
     current = current->enclosing;
     compiler_count--;
     return function_obj;
 }
 
+static obj_function_t *compiler_t_end(const bool debug)
+{
+    emit_return();
+    if (compiler_optimization_level > 1 && !parser.had_error) {
+        ir_t_optimize(current->function);
+    }
+    if (debug || parser.had_error) {
+        chunk_t_disassemble(current_chunk(), current->function->name != NULL ? current->function->name->chars : "<main>");
+    }
+    return compiler_t_pop();
+}
+
+// OP_POPN counts a byte, so past that the pops are split
+static void emit_popn(int count)
+{
+    while (count > UINT8_MAX) {
+        emit_bytes(OP_POPN, UINT8_MAX);
+        count -= UINT8_MAX;
+    }
+    emit_bytes(OP_POPN, (uint8_t)count);
+}
+
 static void begin_scope(void)
 {
     current->scope_depth++;
@@ -291,12 +539,12 @@ static void end_scope(void)
 {
     current->scope_depth--;
 
-    uint8_t to_pop = 0;
+    int to_pop = 0;
     while (current->local_count > 0 && current->locals[current->local_count - 1].depth > current->scope_depth) {
         if (current->locals[current->local_count - 1].is_captured) {
             // flush any to pop before the OP_CLOSE_UPVALUEA
             if (to_pop) {
-                emit_bytes(OP_POPN, to_pop);
+                emit_popn(to_pop);
                 to_pop = 0;
             }
             emit_byte(OP_CLOSE_UPVALUE);
@@ -307,7 +555,7 @@ static void end_scope(void)
     }
     if (to_pop > 0) {
         // flush remaining pops
-        emit_bytes(OP_POPN, to_pop);
+        emit_popn(to_pop);
     }
 }
 
@@ -316,15 +564,17 @@ static void statement(void);
 static void declaration(void);
 static const parse_rule_t *get_rule(const token_type_t type);
 static void parse_precedence(const precedence_t precedence);
+static dead_code_t dead_code_begin(void);
+static void dead_code_end(const dead_code_t dead);
 
-static uint8_t identifier_constant(const token_t *name)
+static int identifier_constant(const token_t *name)
 {
     obj_string_t *constant_str = obj_string_t_copy_from(name->start, name->length, true);
     value_t existing_index;
     if (table_t_get(&current->string_constants, OBJ_VAL(constant_str), &existing_index)) {
-        return (uint8_t)AS_NUMBER(existing_index);
+        return (int)AS_NUMBER(existing_index);
     }
-    uint8_t index = make_constant(OBJ_VAL(constant_str));
+    const int index = make_constant(OBJ_VAL(constant_str));
     table_t_set(&current->string_constants, OBJ_VAL(constant_str), NUMBER_VAL(index));
     return index;
 }
@@ -341,7 +591,7 @@ static int resolve_local(compiler_t *compiler, const token_t *name)
     for (int i = compiler->local_count - 1; i >= 0; i--) {
         const local_t *local = &compiler->locals[i];
         if (identifiers_equal(name, &local->name)) {
-            if (local->depth == -1) {
+            if (local->depth == -1 && !compiler_skimming) {
                 error(gettext("Can't read local variable in its own initializer."));
             }
             return i;
@@ -350,7 +600,7 @@ static int resolve_local(compiler_t *compiler, const token_t *name)
     return -1;
 }
 
-static int add_upvalue(compiler_t *compiler, const uint8_t index, const bool is_local)
+static int add_upvalue(compiler_t *compiler, const int index, const bool is_local)
 {
     int upvalue_count = compiler->function->upvalue_count;
     for (int i = 0; i < upvalue_count; i++) {
@@ -359,32 +609,49 @@ static int add_upvalue(compiler_t *compiler, const uint8_t index, const bool is_
             return i;
         }
     }
-    if (upvalue_count == UINT8_COUNT) {
+    if (upvalue_count == UINT16_COUNT) {
         error(gettext("Too many closure variables in function."));
         return 0;
     }
+    if (upvalue_count == compiler->upvalue_capacity) {
+        const int capacity = compiler->upvalue_capacity;
+        compiler->upvalue_capacity = GROW_CAPACITY(capacity);
+        compiler->upvalues = GROW_ARRAY(upvalue_t, compiler->upvalues, capacity, compiler->upvalue_capacity);
+    }
     compiler->upvalues[upvalue_count].is_local = is_local;
     compiler->upvalues[upvalue_count].index = index;
     return compiler->function->upvalue_count++;
 }
 
+static int resolve_lazy_upvalue(const compiler_t *compiler, const token_t *name)
+{
+    if (compiler->lazy_upvalue_names == NULL)
+        return -1; // must be global
+    for (int i = 0; i < compiler->lazy_upvalue_names->count; i++) {
+        const obj_string_t *upvalue_name = AS_STRING(compiler->lazy_upvalue_names->values[i]);
+        if (upvalue_name->length == name->length && memcmp(upvalue_name->chars, name->start, name->length) == 0)
+            return i;
+    }
+    return -1;
+}
+
 static int resolve_upvalue(compiler_t *compiler, const token_t *name)
 {
     if (compiler->enclosing == NULL)
-        return -1; // must be global
+        return resolve_lazy_upvalue(compiler, name);
 
     // try local
     const int local = resolve_local(compiler->enclosing, name);
     if (local != -1) {
         compiler->enclosing->locals[local].is_captured = true;
-        return add_upvalue(compiler, (uint8_t)local, true);
+        return add_upvalue(compiler, local, true);
     }
 
     // try enclosing... in which case every enclosing scope will have
     // it's own upvalue that the enclosed scopes then reference.
     const int upvalue = resolve_upvalue(compiler->enclosing, name);
     if (upvalue != -1) {
-        return add_upvalue(compiler, (uint8_t)upvalue, false);
+        return add_upvalue(compiler, upvalue, false);
     }
 
     return -1;
@@ -392,11 +659,19 @@ static int resolve_upvalue(compiler_t *compiler, const token_t *name)
 
 static void add_local(const token_t name)
 {
-    if (current->local_count == UINT8_COUNT) {
+    if (current->local_count == UINT16_COUNT) {
         error(gettext("Too many local variables in function."));
         return;
     }
+    if (current->local_count == current->local_capacity) {
+        const int capacity = current->local_capacity;
+        current->local_capacity = GROW_CAPACITY(capacity);
+        current->locals = GROW_ARRAY(local_t, current->locals, capacity, current->local_capacity);
+    }
     local_t *local = &current->locals[current->local_count++];
+    if (current->local_count > current->function->max_slots) {
+        current->function->max_slots = current->local_count;
+    }
     local->name = name;
     // NOTE here use use a depth of -1 to indicate uninitialized, see mark_initialized and resolve_local
     // local->depth = current->scope_depth;
@@ -422,7 +697,7 @@ static void declare_variable(void)
     add_local(*name);
 }
 
-static uint8_t parse_variable(const char *message)
+static int parse_variable(const char *message)
 {
     consume(TOKEN_IDENTIFIER, message);
     declare_variable();
@@ -440,13 +715,13 @@ static void mark_initialized(void)
     current->locals[current->local_count - 1].depth = current->scope_depth;
 }
 
-static void define_variable(const uint8_t variable)
+static void define_variable(const int variable)
 {
     if (current->scope_depth > 0) {
         mark_initialized();
         return;
     }
-    emit_bytes(OP_DEFINE_GLOBAL, variable);
+    emit_indexed(OP_DEFINE_GLOBAL, variable);
 }
 
 static uint8_t argument_list(void)
@@ -509,9 +784,14 @@ static void ternary(const bool)
 
 static void binary(const bool)
 {
+    const int left_start = current->operand_start;
+    const int right_start = current_chunk()->count;
     token_type_t operator_type = parser.previous.type;
     const parse_rule_t *rule = get_rule(operator_type);
     parse_precedence((precedence_t)(rule->precedence + 1));
+    if (fold_binary(operator_type, left_start, right_start)) {
+        return;
+    }
     switch (operator_type) {
         case TOKEN_BANG_EQUAL: emit_bytes(OP_EQUAL, OP_NOT); break;
         case TOKEN_EQUAL_EQUAL: emit_byte(OP_EQUAL); break;
@@ -536,14 +816,14 @@ static void binary(const bool)
 static void call(const bool)
 {
     const uint8_t arg_count = argument_list();
+    current->last_call = current_chunk()->count;
     emit_bytes(OP_CALL, arg_count);
 }
 
 static void map(const bool)
 {
     token_t map_token = synthetic_token(KEYWORD_MAP);
-    const uint8_t map = identifier_constant(&map_token);
-    emit_bytes(OP_GET_GLOBAL, map);
+    emit_indexed(OP_GET_GLOBAL, identifier_constant(&map_token));
     int arg_count = 0;
 
     if (!match(TOKEN_RIGHT_BRACE)) {
@@ -561,8 +841,7 @@ static void map(const bool)
 static void list(const bool)
 {
     token_t list_token = synthetic_token(KEYWORD_LIST);
-    const uint8_t list = identifier_constant(&list_token);
-    emit_bytes(OP_GET_GLOBAL, list);
+    emit_indexed(OP_GET_GLOBAL, identifier_constant(&list_token));
 
     int arg_count = 0;
     if (!match(TOKEN_RIGHT_BRACKET)) {
@@ -593,8 +872,7 @@ static void subscript(const bool can_assign)
         arg_count++;
     }
     token_t subscript_token = synthetic_token(KEYWORD_SUBSCRIPT);
-    const uint8_t subscript = identifier_constant(&subscript_token);
-    emit_bytes(OP_INVOKE, subscript);
+    emit_indexed(OP_INVOKE, identifier_constant(&subscript_token));
     emit_byte(arg_count);
 }
 
@@ -673,9 +951,9 @@ static bool match_for_load_and_modify(void)
     return false;
 }
 
-static void load_and_modify(const uint8_t name, const token_type_t match, const uint8_t get_op, const uint8_t set_op)
+static void load_and_modify(const int name, const token_type_t match, const uint8_t get_op, const uint8_t set_op)
 {
-    emit_bytes(get_op, name);
+    emit_indexed(get_op, name);
     switch (match) {
         case TOKEN_PLUS_EQUAL: expression(); emit_byte(OP_ADD); break;
         case TOKEN_MINUS_EQUAL: expression(); emit_byte(OP_SUBTRACT); break;
@@ -693,7 +971,7 @@ static void load_and_modify(const uint8_t name, const token_type_t match, const
             break;
         default: ;
     }
-    emit_bytes(set_op, name);
+    emit_indexed(set_op, name);
 }
 
 static void subscript_modify_in_place(const int slot, const uint8_t get_op)
@@ -710,7 +988,7 @@ static void subscript_modify_in_place(const int slot, const uint8_t get_op)
         const token_t match_token = parser.previous;
 
         // emit another invoke to load the current value to modify
-        emit_bytes(get_op, (uint8_t)slot);
+        emit_indexed(get_op, slot);
         if (saved_expression.type == TOKEN_STRING) {
             parser.previous = saved_expression;
             string(true);
@@ -721,8 +999,7 @@ static void subscript_modify_in_place(const int slot, const uint8_t get_op)
             error(gettext("Invalid subscript."));
         }
         token_t subscript_token = synthetic_token(KEYWORD_SUBSCRIPT);
-        const uint8_t subscript_v = identifier_constant(&subscript_token);
-        emit_bytes(OP_INVOKE, subscript_v);
+        emit_indexed(OP_INVOKE, identifier_constant(&subscript_token));
         emit_byte(arg_count);
 
         switch (match_token.type) {
@@ -751,8 +1028,7 @@ static void subscript_modify_in_place(const int slot, const uint8_t get_op)
     }
 
     token_t subscript_token = synthetic_token(KEYWORD_SUBSCRIPT);
-    const uint8_t subscript_v = identifier_constant(&subscript_token);
-    emit_bytes(OP_INVOKE, subscript_v);
+    emit_indexed(OP_INVOKE, identifier_constant(&subscript_token));
     emit_byte(arg_count);
 }
 
@@ -774,37 +1050,37 @@ static void named_variable(const token_t name, const bool can_assign)
 
     if (can_assign && match(TOKEN_EQUAL)) {
         expression();
-        emit_bytes(set_op, (uint8_t)arg);
+        emit_indexed(set_op, arg);
     } else if (can_assign && match_for_load_and_modify()) {
         load_and_modify(arg, parser.previous.type, get_op, set_op);
     } else if (can_assign && match(TOKEN_LEFT_BRACKET)) {
-        emit_bytes(get_op, (uint8_t)arg);
+        emit_indexed(get_op, arg);
         subscript_modify_in_place(arg, get_op);
     } else {
-        emit_bytes(get_op, (uint8_t)arg);
+        emit_indexed(get_op, arg);
     }
 }
 
 static void dot(const bool can_assign)
 {
     consume(TOKEN_IDENTIFIER, gettext("Expect property name after '.'."));
-    const uint8_t name = identifier_constant(&parser.previous);
+    const int name = identifier_constant(&parser.previous);
 
     if (can_assign && match(TOKEN_EQUAL)) {
         expression();
-        emit_bytes(OP_SET_PROPERTY, name);
+        emit_indexed(OP_SET_PROPERTY, name);
     } else if (match(TOKEN_LEFT_PAREN)) { // optimization here since we are immediately calling the method
         const uint8_t arg_count = argument_list();
-        emit_bytes(OP_INVOKE, name);
+        emit_indexed(OP_INVOKE, name);
         emit_byte(arg_count);
     } else if (can_assign && match_for_load_and_modify()) {
         named_variable(synthetic_token(token_keyword_names[TOKEN_SELF]), false);
         load_and_modify(name, parser.previous.type, OP_GET_PROPERTY, OP_SET_PROPERTY);
     } else if (can_assign && match(TOKEN_LEFT_BRACKET)) {
-        emit_bytes(OP_GET_PROPERTY, (uint8_t)name);
+        emit_indexed(OP_GET_PROPERTY, name);
         subscript_modify_in_place(name, OP_GET_PROPERTY);
     } else {
-        emit_bytes(OP_GET_PROPERTY, name);
+        emit_indexed(OP_GET_PROPERTY, name);
     }
 }
 
@@ -851,7 +1127,7 @@ static void super_expr(const bool)
 
     consume(TOKEN_DOT, gettext("Expect '.' after 'super'."));
     consume(TOKEN_IDENTIFIER, gettext("Expect supertype method name."));
-    const uint8_t method_name = identifier_constant(&parser.previous);
+    const int method_name = identifier_constant(&parser.previous);
 
     // capture self and super in case we are in a closure
     named_variable(synthetic_token(token_keyword_names[TOKEN_SELF]), false);
@@ -860,11 +1136,11 @@ static void super_expr(const bool)
     if (match(TOKEN_LEFT_PAREN)) {
         const uint8_t arg_count = argument_list();
         named_variable(synthetic_token(token_keyword_names[TOKEN_SUPER]), false);
-        emit_bytes(OP_SUPER_INVOKE, method_name);
+        emit_indexed(OP_SUPER_INVOKE, method_name);
         emit_byte(arg_count);
     } else { // slow path
         named_variable(synthetic_token(token_keyword_names[TOKEN_SUPER]), false);
-        emit_bytes(OP_GET_SUPER, method_name);
+        emit_indexed(OP_GET_SUPER, method_name);
     }
 }
 
@@ -881,9 +1157,13 @@ static void self_expr(const bool)
 static void unary(const bool)
 {
     const token_type_t operator_type = parser.previous.type;
+    const int operand_start = current_chunk()->count;
 
     // compile the operand
     parse_precedence(PREC_UNARY);
+    if (fold_unary(operator_type, operand_start)) {
+        return;
+    }
 
     // emit the operator instruction
     switch (operator_type) {
@@ -970,6 +1250,7 @@ static void parse_precedence(const precedence_t precedence)
     }
 
     const bool can_assign = precedence <= PREC_ASSIGNMENT;
+    const int start = current_chunk()->count;
     prefix_rule(can_assign);
 
     while (precedence <= get_rule(parser.current.type)->precedence) {
@@ -979,6 +1260,7 @@ static void parse_precedence(const precedence_t precedence)
             error(gettext("Expect expression."));
             return;
         }
+        current->operand_start = start;
         infix_rule(can_assign);
     }
 
@@ -997,21 +1279,31 @@ static void expression(void)
     parse_precedence(PREC_ASSIGNMENT);
 }
 
+static bool check_terminator(void)
+{
+    return check(TOKEN_RETURN) || check(TOKEN_BREAK) || check(TOKEN_CONTINUE) || check(TOKEN_EXIT);
+}
+
 static void block(void)
 {
     while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+        const bool terminates = compiler_optimization_level > 0 && check_terminator();
         declaration();
+        if (terminates && !check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+            // nothing after an unconditional return, break, continue or exit in this block can run
+            const dead_code_t dead = dead_code_begin();
+            while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+                declaration();
+            }
+            dead_code_end(dead);
+        }
     }
     consume(TOKEN_RIGHT_BRACE, gettext("Expect '}' after block."));
     match(TOKEN_SEMICOLON);
 }
 
-static void function(function_type_t type)
+static void parameters(void)
 {
-    compiler_t compiler;
-    compiler_t_init(&compiler, type);
-    begin_scope();
-
     consume(TOKEN_LEFT_PAREN, gettext("Expect '(' after function name."));
     if (!check(TOKEN_RIGHT_PAREN)) {
         do {
@@ -1019,40 +1311,133 @@ static void function(function_type_t type)
             if (current->function->arity > MAX_PARAMETERS) {
                 error_at_current(gettext("Exceeded maximum number of parameters."));
             }
-            const uint8_t constant = parse_variable(gettext("Expect parameter name."));
+            const int constant = parse_variable(gettext("Expect parameter name."));
             define_variable(constant);
         } while (match(TOKEN_COMMA));
     }
     consume(TOKEN_RIGHT_PAREN, gettext("Expect ')' after parameters."));
     consume(TOKEN_LEFT_BRACE, gettext("Expect '{' before function body."));
-    block();
+}
+
+static void skim_capture(const token_t *name)
+{
+    if (resolve_local(current, name) != -1)
+        return; // a parameter
+    value_list_t *upvalue_names = &current->function->lazy->upvalue_names;
+    if (resolve_upvalue(current, name) == upvalue_names->count) { // newly captured
+        value_t upvalue_name = OBJ_VAL(obj_string_t_copy_from(name->start, name->length, true));
+        vm_push(upvalue_name); // make GC happy
+        value_list_t_add(upvalue_names, upvalue_name);
+        vm_pop(); // make GC happy
+    }
+}
 
-    obj_function_t *function = compiler_t_end(compiler_debug); // no end_scope required here
-    emit_bytes(OP_CLOSURE, make_constant(OBJ_VAL(function)));
+/*
+ * Skip over the body, capturing anything it names from the enclosing scopes
+ * so the closure is complete. Names the body declares for itself may be
+ * captured too, which only costs a close. compiler_t_compile_lazy compiles
+ * the source span on the first call.
+ */
+static void skim_block(const token_t *start, const function_type_t type)
+{
+    lazy_function_t *lazy = ALLOCATE(lazy_function_t, 1);
+    lazy->source = NULL;
+    value_list_t_init(&lazy->upvalue_names);
+    lazy->line = start->line;
+    lazy->function_type = type;
+    lazy->in_type = current_type != NULL;
+    lazy->has_supertype = current_type != NULL && current_type->has_supertype;
+    current->function->lazy = lazy;
+
+    const token_t self_token = synthetic_token(token_keyword_names[TOKEN_SELF]);
+    int depth = 1;
+    compiler_skimming = true;
+    while (depth > 0 && !check(TOKEN_EOF)) {
+        advance();
+        switch (parser.previous.type) {
+            case TOKEN_LEFT_BRACE: depth++; break;
+            case TOKEN_RIGHT_BRACE: depth--; break;
+            case TOKEN_DOT:
+                skim_capture(&self_token); // see dot() for in place modification
+                match(TOKEN_IDENTIFIER); // property names are not variables
+                break;
+            case TOKEN_IDENTIFIER:
+            case TOKEN_SELF:
+            case TOKEN_SUPER:
+                skim_capture(&parser.previous);
+                break;
+            default: break;
+        }
+    }
+    compiler_skimming = false;
+    if (depth > 0) {
+        error_at_current(gettext("Expect '}' after block."));
+        return;
+    }
+    match(TOKEN_SEMICOLON);
+
+    const char *end = parser.previous.start + parser.previous.length;
+    lazy->source = obj_string_t_copy_from(start->start, (int)(end - start->start), false);
+}
+
+static void function(function_type_t type)
+{
+    compiler_t compiler;
+    compiler_t_init(&compiler, type);
+    begin_scope();
+
+    const token_t start = parser.current;
+    parameters();
+
+    obj_function_t *function;
+    if (vm.flags & VM_FLAG_LAZY_COMPILE) {
+        skim_block(&start, type);
+        function = compiler_t_pop();
+    } else {
+        block();
+        function = compiler_t_end(compiler_debug); // no end_scope required here
+    }
+    const int constant = make_constant(OBJ_VAL(function));
+    bool wide = constant > UINT8_MAX;
+    for (int i = 0; i < function->upvalue_count; i++) {
+        wide = wide || compiler.upvalues[i].index > UINT8_MAX;
+    }
+    if (wide) {
+        emit_wide(OP_CLOSURE, constant);
+    } else {
+        emit_bytes(OP_CLOSURE, (uint8_t)constant);
+    }
 
     for (int i = 0; i < function->upvalue_count; i++) {
-        emit_byte(compiler.upvalues[i].is_local ? 1 : 0);
-        emit_byte(compiler.upvalues[i].index);
+        const int index = compiler.upvalues[i].index;
+        const uint8_t flags = compiler.upvalues[i].is_local ? UPVALUE_LOCAL : 0;
+        if (index > UINT8_MAX) {
+            emit_bytes(flags | UPVALUE_WIDE, (index >> 8) & 0xff);
+            emit_byte(index & 0xff);
+        } else {
+            emit_bytes(flags, (uint8_t)index);
+        }
     }
+    FREE_ARRAY(upvalue_t, compiler.upvalues, compiler.upvalue_capacity);
 }
 
 static void field(void)
 {
     consume(TOKEN_IDENTIFIER, gettext("Expect field name."));
-    const uint8_t field_name = identifier_constant(&parser.previous);
+    const int field_name = identifier_constant(&parser.previous);
     if (match(TOKEN_EQUAL)) {
         expression();
     } else {
         emit_byte(OP_NIL);
     }
     consume(TOKEN_SEMICOLON, gettext("Expect ';' after field declaration."));
-    emit_bytes(OP_FIELD, field_name);
+    emit_indexed(OP_FIELD, field_name);
 }
 
 static void method(void)
 {
     consume(TOKEN_IDENTIFIER, gettext("Expect method name."));
-    const uint8_t constant = identifier_constant(&parser.previous);
+    const int constant = identifier_constant(&parser.previous);
 
     function_type_t type = TYPE_METHOD;
     if (parser.previous.length == KEYWORD_INIT_LEN && memcmp(parser.previous.start, KEYWORD_INIT, KEYWORD_INIT_LEN) == 0) {
@@ -1060,12 +1445,12 @@ static void method(void)
     }
     function(type);
 
-    emit_bytes(OP_METHOD, constant);
+    emit_indexed(OP_METHOD, constant);
 }
 
 static void fun_declaration(void)
 {
-    const uint8_t global = parse_variable(gettext("Expect function name."));
+    const int global = parse_variable(gettext("Expect function name."));
     mark_initialized(); // so we can support recursion before we compile the body
     function(TYPE_FUNCTION);
     define_variable(global);
@@ -1073,7 +1458,7 @@ static void fun_declaration(void)
 
 static void var_declaration(void)
 {
-    const uint8_t global = parse_variable(gettext("Expect variable name."));
+    const int global = parse_variable(gettext("Expect variable name."));
     if (match(TOKEN_EQUAL)) {
         expression();
     } else {
@@ -1088,10 +1473,10 @@ static void type_declaration(void)
 {
     consume(TOKEN_IDENTIFIER, gettext("Expect type name."));
     const token_t type_name = parser.previous;
-    const uint8_t name_constant = identifier_constant(&parser.previous);
+    const int name_constant = identifier_constant(&parser.previous);
     declare_variable();
 
-    emit_bytes(OP_TYPE, name_constant);
+    emit_indexed(OP_TYPE, name_constant);
     define_variable(name_constant);
 
     // setup a type compiler instance while we do the work
@@ -1161,6 +1546,28 @@ int inner_most_loop_start = -1;
 int inner_most_loop_end = -1;
 int inner_most_loop_scope_depth = 0;
 
+static dead_code_t dead_code_begin(void)
+{
+    return (dead_code_t){.code_count = current_chunk()->count, .loop_end = inner_most_loop_end};
+}
+
+static void dead_code_end(const dead_code_t dead)
+{
+    truncate_code(dead.code_count);
+    inner_most_loop_end = dead.loop_end; // a break that was thrown away must not be patched
+}
+
+static void constant_branch(const bool taken)
+{
+    if (taken) {
+        statement();
+    } else {
+        const dead_code_t dead = dead_code_begin();
+        statement();
+        dead_code_end(dead);
+    }
+}
+
 static void for_statement(void)
 {
     int surrounding_loop_start = inner_most_loop_start;
@@ -1226,9 +1633,21 @@ static void for_statement(void)
 static void if_statement(void)
 {
     consume(TOKEN_LEFT_PAREN, gettext("Expect '(' after 'if'."));
+    const int condition_start = current_chunk()->count;
     expression();
     consume(TOKEN_RIGHT_PAREN, gettext("Expect ')' after condition."));
 
+    value_t condition;
+    if (compiler_optimization_level > 0 && constant_at(condition_start, current_chunk()->count, &condition)) {
+        // only one branch can ever run, so drop the test along with the other branch
+        rewind_constants(condition_start);
+        const bool taken = !constant_is_falsey(condition);
+        constant_branch(taken);
+        if (match(TOKEN_ELSE))
+            constant_branch(!taken);
+        return;
+    }
+
     const int then_jump = emit_jump(OP_JUMP_IF_FALSE);
     emit_byte(OP_POP);
     statement();
@@ -1274,6 +1693,11 @@ static void return_statement(void)
         }
         expression();
         consume(TOKEN_SEMICOLON, gettext("Expect ';' after return value."));
+        // the callee takes over this frame; the return only runs when it was not a closure
+        if (compiler_optimization_level > 0 && current->last_call == current_chunk()->count - 2 &&
+            current_chunk()->code[current->last_call] == OP_CALL) {
+            current_chunk()->code[current->last_call] = OP_TAIL_CALL;
+        }
         emit_byte(OP_RETURN);
     }
 }
@@ -1291,17 +1715,32 @@ static void while_statement(void)
     expression();
     consume(TOKEN_RIGHT_PAREN, gettext("Expect ')' after condition."));
 
-    const int exit_jump = emit_jump(OP_JUMP_IF_FALSE);
-    emit_byte(OP_POP);
-    statement();
+    value_t condition;
+    if (compiler_optimization_level > 0 && constant_at(inner_most_loop_start, current_chunk()->count, &condition)) {
+        // a constant condition either never exits or never enters, so no test is needed
+        rewind_constants(inner_most_loop_start);
+        if (constant_is_falsey(condition)) {
+            constant_branch(false);
+        } else {
+            statement();
+            emit_loop(inner_most_loop_start);
+            if (inner_most_loop_end != -1) {
+                patch_jump(inner_most_loop_end);
+            }
+        }
+    } else {
+        const int exit_jump = emit_jump(OP_JUMP_IF_FALSE);
+        emit_byte(OP_POP);
+        statement();
 
-    emit_loop(inner_most_loop_start);
+        emit_loop(inner_most_loop_start);
 
-    patch_jump(exit_jump);
-    emit_byte(OP_POP);
+        patch_jump(exit_jump);
+        emit_byte(OP_POP);
 
-    if (inner_most_loop_end != -1) {
-        patch_jump(inner_most_loop_end);
+        if (inner_most_loop_end != -1) {
+            patch_jump(inner_most_loop_end);
+        }
     }
 
     inner_most_loop_start = surrounding_loop_start;
@@ -1349,6 +1788,71 @@ static void declaration(void)
 }
 
 #define MAX_CASES 256
+#define SWITCH_TABLE_MIN_CASES 3
+
+/*
+ * When every case is a number or string constant the comparisons are skipped
+ * entirely: OP_SWITCH_TABLE looks the value up and jumps straight to the body
+ * of the first matching case, or to the default (or the end) when none match.
+ * Integral keys in a dense range use a list indexed from the smallest key
+ * ([low, offset...]), anything else a map from key to offset. Whether that
+ * works is only known after the last case, so from -O1 up the slot it needs is
+ * reserved up front as a jump over one dead byte, which stays when it doesn't.
+ */
+static bool emit_switch_table(const int table_offset, const value_t *keys, const int *bodies, const int key_count, const int miss)
+{
+    chunk_t *chunk = current_chunk();
+    const int from = table_offset + 4;
+    if (key_count < SWITCH_TABLE_MIN_CASES || chunk->constants.count > UINT8_MAX || miss - from > UINT16_MAX) {
+        return false;
+    }
+    bool integral = true;
+    double low = 0, high = 0;
+    for (int i = 0; i < key_count; i++) {
+        if (IS_EMPTY(keys[i])) {
+            return false; // not a constant
+        }
+        if (!IS_NUMBER(keys[i])) {
+            integral = false;
+            continue;
+        }
+        const double key = AS_NUMBER(keys[i]);
+        integral = integral && key == floor(key) && fabs(key) < 1e9;
+        low = i == 0 || key < low ? key : low;
+        high = i == 0 || key > high ? key : high;
+    }
+    const bool dense = integral && high - low < 2.0 * key_count;
+
+    value_t table;
+    if (dense) {
+        obj_list_t *list = obj_list_t_allocate();
+        table = OBJ_VAL(list);
+        const uint8_t constant = make_constant(table);
+        value_list_t_add(&list->elements, NUMBER_VAL(low));
+        for (int i = 0; i <= (int)(high - low); i++) {
+            value_list_t_add(&list->elements, NIL_VAL);
+        }
+        for (int i = key_count - 1; i >= 0; i--) { // the first of any duplicates wins
+            list->elements.values[1 + (int)(AS_NUMBER(keys[i]) - low)] = NUMBER_VAL(bodies[i] - from);
+        }
+        chunk->code[table_offset + 1] = constant;
+    } else {
+        obj_map_t *map = obj_map_t_allocate();
+        table = OBJ_VAL(map);
+        const uint8_t constant = make_constant(table);
+        for (int i = key_count - 1; i >= 0; i--) {
+            const value_t key = IS_NUMBER(keys[i]) ? NUMBER_VAL(AS_NUMBER(keys[i]) + 0.0) : keys[i]; // -0 is 0
+            if (!(IS_NUMBER(key) && isnan(AS_NUMBER(key)))) {
+                table_t_set(&map->table, key, NUMBER_VAL(bodies[i] - from));
+            }
+        }
+        chunk->code[table_offset + 1] = constant;
+    }
+    chunk->code[table_offset] = OP_SWITCH_TABLE;
+    chunk->code[table_offset + 2] = ((miss - from) >> 8) & 0xff;
+    chunk->code[table_offset + 3] = (miss - from) & 0xff;
+    return true;
+}
 
 static void switch_statement(void)
 {
@@ -1361,6 +1865,18 @@ static void switch_statement(void)
     int case_count = 0;
     bool seen_default = false;
 
+    int table_offset = -1;
+    if (compiler_optimization_level >= 1) {
+        table_offset = current_chunk()->count;
+        const int skip = emit_jump(OP_JUMP);
+        emit_byte(OP_POP);
+        patch_jump(skip);
+    }
+    value_t case_keys[MAX_CASES];
+    int case_bodies[MAX_CASES];
+    int key_count = 0;
+    int miss = -1;
+
     while (!match(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
         if (seen_default) {
             error_at_current(gettext("Can't have another case or default after the default case."));
@@ -1373,15 +1889,23 @@ static void switch_statement(void)
                 return;
             }
             emit_byte(OP_DUP); // dup the switch value to compare against
+            const int key_start = current_chunk()->count;
             expression();
             consume(TOKEN_COLON, gettext("Expect ':' after case value."));
+            value_t key;
+            if (!constant_at(key_start, current_chunk()->count, &key) || !(IS_NUMBER(key) || IS_STRING(key))) {
+                key = EMPTY_VAL;
+            }
             emit_byte(OP_EQUAL);
             jump = emit_jump(OP_JUMP_IF_FALSE);
             emit_byte(OP_POP); // Pop the comparison result.
+            case_keys[key_count] = key;
+            case_bodies[key_count++] = current_chunk()->count;
         } else {
             consume(TOKEN_DEFAULT, gettext("Expect 'case' or 'default'."));
             consume(TOKEN_COLON, gettext("Expect ':' after default."));
             seen_default = true;
+            miss = current_chunk()->count;
         }
 
         while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_CASE) && !check(TOKEN_DEFAULT)) {
@@ -1401,9 +1925,13 @@ static void switch_statement(void)
         patch_jump(case_ends[i]);
     }
 
+    if (table_offset != -1 && !parser.had_error) {
+        emit_switch_table(table_offset, case_keys, case_bodies, key_count, miss != -1 ? miss : current_chunk()->count);
+    }
     emit_byte(OP_POP); // The switch value.
 }
 #undef MAX_CASES
+#undef SWITCH_TABLE_MIN_CASES
 
 static void break_statement(void)
 {
@@ -1412,11 +1940,11 @@ static void break_statement(void)
     }
     consume(TOKEN_SEMICOLON, gettext("Expect ';' after 'break'."));
 
-    uint8_t pop_count = 0;
+    int pop_count = 0;
     for (int i = current->local_count - 1; i >=0 && current->locals[i].depth > inner_most_loop_scope_depth; i--) {
         pop_count++;
     }
-    emit_bytes(OP_POPN, pop_count);
+    emit_popn(pop_count);
     inner_most_loop_end = emit_jump(OP_JUMP);
 }
 
@@ -1427,11 +1955,11 @@ static void continue_statement(void)
     }
     consume(TOKEN_SEMICOLON, gettext("Expect ';' after 'continue'."));
 
-    uint8_t pop_count = 0;
+    int pop_count = 0;
     for (int i = current->local_count - 1; i >=0 && current->locals[i].depth > inner_most_loop_scope_depth; i--) {
         pop_count++;
     }
-    emit_bytes(OP_POPN, pop_count);
+    emit_popn(pop_count);
     emit_loop(inner_most_loop_start);
 }
 
@@ -1464,7 +1992,7 @@ static void assert_statement(void)
     char errbuf[255];
     snprintf(errbuf, 255, "[line %d] Assertion failed", parser.current.line);
     obj_string_t *constant_str = obj_string_t_copy_from(errbuf, strlen(errbuf), true);
-    emit_bytes(OP_CONSTANT, make_constant(OBJ_VAL(constant_str)));
+    emit_constant(OBJ_VAL(constant_str));
     emit_byte(OP_PRINT);
 
     emit_constant(NUMBER_VAL(-1));
@@ -1509,6 +2037,7 @@ obj_function_t *compiler_t_compile(const char *source, const bool debug)
 {
     scanner_t_init(source);
 
+    TATER_PROBE_COMPILE_START("script", 1);
     compiler_t compiler;
     compiler_t_init(&compiler, TYPE_SCRIPT);
 
@@ -1523,9 +2052,62 @@ obj_function_t *compiler_t_compile(const char *source, const bool debug)
     }
 
     obj_function_t *function_obj = compiler_t_end(debug);
+    TATER_PROBE_COMPILE_DONE("script", !parser.had_error);
     return parser.had_error ? NULL : function_obj;
 }
 
+bool compiler_t_compile_lazy(obj_function_t *function, const bool debug)
+{
+    lazy_function_t *lazy = function->lazy;
+    TATER_PROBE_COMPILE_START(function->name->chars, lazy->line);
+    scanner_t_init_at_line(lazy->source->chars, lazy->line);
+
+    type_compiler_t type_compiler;
+    type_compiler.enclosing = NULL;
+    type_compiler.has_supertype = lazy->has_supertype;
+    current_type = lazy->in_type ? &type_compiler : NULL;
+
+    parser.had_error = false;
+    parser.panic_mode = false;
+    parser.previous = synthetic_token(function->name->chars); // compiler_t_init names the function from it
+    compiler_debug = debug;
+
+    compiler_t compiler;
+    compiler_t_init(&compiler, (function_type_t)lazy->function_type);
+    compiler.lazy_upvalue_names = &lazy->upvalue_names;
+    compiler.function->upvalue_count = lazy->upvalue_names.count;
+    begin_scope();
+
+    advance();
+    parameters();
+    block();
+    obj_function_t *compiled = compiler_t_end(debug);
+    current_type = NULL;
+    TATER_PROBE_COMPILE_DONE(function->name->chars, !parser.had_error);
+    if (parser.had_error)
+        return false;
+
+    // the closures already point at function, so move the compiled body over
+    chunk_t_free(&function->chunk);
+    function->chunk = compiled->chunk;
+    function->max_slots = compiled->max_slots;
+    chunk_t_init(&compiled->chunk);
+    value_list_t_free(&lazy->upvalue_names);
+    FREE(lazy_function_t, lazy);
+    function->lazy = NULL;
+    return true;
+}
+
+void compiler_t_set_optimization_level(const int level)
+{
+    compiler_optimization_level = level;
+}
+
+int compiler_t_get_optimization_level(void)
+{
+    return compiler_optimization_level;
+}
+
 void compiler_t_mark_roots(void)
 {
     compiler_t *compiler = current;
@@ -24,5 +24,8 @@
 #include "vmopcodes.h"
 
 obj_function_t *compiler_t_compile(const char *source, const bool debug);
+bool compiler_t_compile_lazy(obj_function_t *function, const bool debug);
+void compiler_t_set_optimization_level(const int level);
+int compiler_t_get_optimization_level(void);
 void compiler_t_mark_roots(void);
 #endif
@@ -79,18 +79,76 @@ static int jump_instruction(const char *name, const int sign, const chunk_t *chu
     return offset + 3;
 }
 
+static int switch_table_instruction(const char *name, const chunk_t *chunk, const int offset)
+{
+    assert(chunk->count > 0);
+    const uint8_t constant = chunk->code[offset + 1];
+    const uint16_t miss = (uint16_t)((chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+    printf("%-16s %4d '", name, constant);
+    value_t_print(stdout, chunk->constants.values[constant]);
+    printf("' else -> %d\n", offset + 4 + miss);
+    return offset + 4;
+}
+
 static int long_constant_instruction(const char *name, const chunk_t *chunk, const int offset)
 {
     assert(chunk->count > 0);
     const uint32_t constant = chunk->code[offset + 1] |
         (chunk->code[offset + 2] << 8) |
         (chunk->code[offset + 3] << 16);
-    printf("%-16s %4ud '", name, constant);
+    printf("%-16s %4u '", name, constant);
     value_t_print(stdout, chunk->constants.values[constant]);
     printf("'\n");
     return offset + 4;
 }
 
+static int wide_instruction(const char *name, const chunk_t *chunk, const int offset)
+{
+    assert(chunk->count > 0);
+    const uint8_t instruction = chunk->code[offset + 1];
+    const uint16_t index = (uint16_t)((chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+    printf("%s %-16s %4d", name, instruction < INVALID_OPCODE ? op_code_name[instruction] : "?", index);
+    switch (instruction) {
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE: {
+            printf("\n");
+            return offset + 4;
+        }
+        case OP_INVOKE:
+        case OP_SUPER_INVOKE: {
+            printf(" (%d args) '", chunk->code[offset + 4]);
+            value_t_print(stdout, chunk->constants.values[index]);
+            printf("'\n");
+            return offset + 5;
+        }
+        case OP_CLOSURE: {
+            printf(" ");
+            value_t_print(stdout, chunk->constants.values[index]);
+            printf("\n");
+            int next = offset + 4;
+            const obj_function_t *function = AS_FUNCTION(chunk->constants.values[index]);
+            for (int j = 0; j < function->upvalue_count; j++) {
+                const int at = next;
+                const int flags = chunk->code[next++];
+                int upvalue_index = chunk->code[next++];
+                if (flags & UPVALUE_WIDE) {
+                    upvalue_index = (upvalue_index << 8) | chunk->code[next++];
+                }
+                printf("%04d      |                     %s %d\n", at, flags & UPVALUE_LOCAL ? "local" : "upvalue", upvalue_index);
+            }
+            return next;
+        }
+        default: {
+            printf(" '");
+            value_t_print(stdout, chunk->constants.values[index]);
+            printf("'\n");
+            return offset + 4;
+        }
+    }
+}
+
 int chunk_t_disassemble_instruction(const chunk_t *chunk, int offset)
 {
     printf("%04d ", offset);
@@ -141,6 +199,7 @@ int chunk_t_disassemble_instruction(const chunk_t *chunk, int offset)
         case OP_JUMP_IF_FALSE: return jump_instruction(op_code_name[instruction], 1, chunk, offset);
         case OP_LOOP: return jump_instruction(op_code_name[instruction], -1, chunk, offset);
         case OP_CALL: return byte_instruction(op_code_name[instruction], chunk, offset);
+        case OP_TAIL_CALL: return byte_instruction(op_code_name[instruction], chunk, offset);
         case OP_INVOKE: return invoke_instruction(op_code_name[instruction], chunk, offset);
         case OP_SUPER_INVOKE: return invoke_instruction(op_code_name[instruction], chunk, offset);
         case OP_CLOSURE: {
@@ -166,9 +225,11 @@ int chunk_t_disassemble_instruction(const chunk_t *chunk, int offset)
         case OP_INHERIT: return simple_instruction(op_code_name[instruction], offset);
         case OP_METHOD: return constant_instruction(op_code_name[instruction], chunk, offset);
         case OP_FIELD: return constant_instruction(op_code_name[instruction], chunk, offset);
+        case OP_SWITCH_TABLE: return switch_table_instruction(op_code_name[instruction], chunk, offset);
         case OP_CONSTANT_LONG: return long_constant_instruction(op_code_name[instruction], chunk, offset);
         case OP_POPN: return byte_instruction(op_code_name[instruction], chunk, offset);
         case OP_DUP: return simple_instruction(op_code_name[instruction], offset);
+        case OP_WIDE: return wide_instruction(op_code_name[instruction], chunk, offset);
         default: {
             printf(gettext("Unknown opcode %d\n"), instruction);
             return offset + 1;
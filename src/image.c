@@ -0,0 +1,815 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "image.h"
+#include "memory.h"
+#include "type.h"
+#include "vm.h"
+
+#define IMAGE_BYTE_ORDER_MARK 0x01020304u
+#define IMAGE_NO_REF -1
+
+/*
+ * An image is the object graph reachable from the globals, flattened into
+ * records that refer to each other by index:
+ *
+ *   header | record offsets | globals (key/value pairs) | records
+ *
+ * Loading maps the file and relocates each index back to a freshly
+ * allocated object. Natives are resolved by name against the running vm.
+ */
+
+typedef struct {
+    char magic[IMAGE_FILE_MAGIC_LEN];
+    uint32_t format_version;
+    uint32_t opcode_count;
+    uint32_t byte_order_mark;
+    uint32_t object_count;
+    uint32_t global_count;
+} image_header_t;
+
+typedef struct {
+    const obj_t *obj;
+    int index;
+} image_ref_t;
+
+typedef struct {
+    FILE *f;
+    obj_t **objects;
+    int count;
+    int capacity;
+    image_ref_t *refs;
+} image_writer_t;
+
+typedef struct {
+    const uint8_t *start;
+    const uint8_t *current;
+    const uint8_t *end;
+    const uint8_t *offsets;
+    obj_list_t *loaded;
+} image_reader_t;
+
+// per process state is set up by vm_set_argc_argv/vm_inherit_env, never restored from an image
+static bool is_process_global(const value_t key)
+{
+    if (!IS_STRING(key))
+        return false;
+    const char *name = AS_CSTRING(key);
+    return strcmp(name, "argc") == 0 || strcmp(name, "argv") == 0 || strcmp(name, "env") == 0;
+}
+
+static void visit_object(image_writer_t *writer, obj_t *obj)
+{
+    if (obj == NULL || obj->is_marked)
+        return;
+    obj->is_marked = true; // borrowed from the collector, which cannot run while we hold it
+    if (writer->count + 1 > writer->capacity) {
+        writer->capacity = GROW_CAPACITY(writer->capacity);
+        writer->objects = realloc(writer->objects, sizeof(obj_t*) * writer->capacity);
+        if (writer->objects == NULL) {
+            fprintf(stderr, gettext("Failed to allocate image object list.\n"));
+            exit(EXIT_FAILURE);
+        }
+    }
+    writer->objects[writer->count++] = obj;
+}
+
+static void visit_value(image_writer_t *writer, const value_t value)
+{
+    if (IS_OBJ(value))
+        visit_object(writer, AS_OBJ(value));
+}
+
+static void visit_table(image_writer_t *writer, const table_t *table)
+{
+    for (int i = 0; i < table->capacity; i++) {
+        if (IS_EMPTY(table->entries[i].key))
+            continue;
+        visit_value(writer, table->entries[i].key);
+        visit_value(writer, table->entries[i].value);
+    }
+}
+
+static bool visit_references(image_writer_t *writer, obj_t *obj)
+{
+    switch (obj->type) {
+        case OBJ_BOUND_METHOD: {
+            obj_bound_method_t *bound_method = (obj_bound_method_t*)obj;
+            visit_value(writer, bound_method->receiving_instance);
+            visit_object(writer, (obj_t*)bound_method->method);
+            return true;
+        }
+        case OBJ_TYPECLASS: {
+            obj_typeobj_t *typeobj = (obj_typeobj_t*)obj;
+            visit_object(writer, (obj_t*)typeobj->name);
+            visit_object(writer, (obj_t*)typeobj->super);
+            visit_table(writer, &typeobj->fields);
+            visit_table(writer, &typeobj->methods);
+            return true;
+        }
+        case OBJ_CLOSURE: {
+            obj_closure_t *closure = (obj_closure_t*)obj;
+            visit_object(writer, (obj_t*)closure->function);
+            for (int i = 0; i < closure->upvalue_count; i++) {
+                visit_object(writer, (obj_t*)closure->upvalues[i]);
+            }
+            return true;
+        }
+        case OBJ_FUNCTION: {
+            obj_function_t *function = (obj_function_t*)obj;
+            visit_object(writer, (obj_t*)function->name);
+            for (int i = 0; i < function->chunk.constants.count; i++) {
+                visit_value(writer, function->chunk.constants.values[i]);
+            }
+            if (function->lazy != NULL) {
+                visit_object(writer, (obj_t*)function->lazy->source);
+                for (int i = 0; i < function->lazy->upvalue_names.count; i++) {
+                    visit_value(writer, function->lazy->upvalue_names.values[i]);
+                }
+            }
+            return true;
+        }
+        case OBJ_INSTANCE: {
+            obj_instance_t *instance = (obj_instance_t*)obj;
+            visit_object(writer, (obj_t*)instance->typeobj);
+            visit_table(writer, &instance->fields);
+            return true;
+        }
+        case OBJ_NATIVE: {
+            visit_object(writer, (obj_t*)((obj_native_t*)obj)->name);
+            return true;
+        }
+        case OBJ_UPVALUE: {
+            obj_upvalue_t *upvalue = (obj_upvalue_t*)obj;
+            if (upvalue->location != &upvalue->closed)
+                return false; // still pointing into a live stack frame
+            visit_value(writer, upvalue->closed);
+            return true;
+        }
+        case OBJ_LIST: {
+            obj_list_t *list = (obj_list_t*)obj;
+            for (int i = 0; i < list->elements.count; i++) {
+                visit_value(writer, list->elements.values[i]);
+            }
+            return true;
+        }
+        case OBJ_MAP: visit_table(writer, &((obj_map_t*)obj)->table); return true;
+        case OBJ_STRING: return true;
+        case OBJ_BOUND_NATIVE_METHOD: // native method pointers are private to the vm
+        case OBJ_FILE: // open descriptors do not survive the process
+        default: return false;
+    }
+}
+
+static int compare_refs(const void *a, const void *b)
+{
+    const uintptr_t left = (uintptr_t)((const image_ref_t*)a)->obj;
+    const uintptr_t right = (uintptr_t)((const image_ref_t*)b)->obj;
+    return (left > right) - (left < right);
+}
+
+static int32_t ref_index(const image_writer_t *writer, const obj_t *obj)
+{
+    if (obj == NULL)
+        return IMAGE_NO_REF;
+    const image_ref_t key = {.obj = obj, .index = 0};
+    const image_ref_t *ref = bsearch(&key, writer->refs, writer->count, sizeof key, compare_refs);
+    return ref != NULL ? ref->index : IMAGE_NO_REF; // everything reachable was visited
+}
+
+static bool write_bytes(image_writer_t *writer, const void *bytes, const size_t length)
+{
+    return length == 0 || fwrite(bytes, 1, length, writer->f) == length;
+}
+
+static bool write_int(image_writer_t *writer, const int32_t value)
+{
+    return write_bytes(writer, &value, sizeof value);
+}
+
+static bool write_ref(image_writer_t *writer, const obj_t *obj)
+{
+    return write_int(writer, ref_index(writer, obj));
+}
+
+static bool write_value(image_writer_t *writer, const value_t value)
+{
+    const uint8_t tag = value.type;
+    if (!write_bytes(writer, &tag, 1))
+        return false;
+    switch (value.type) {
+        case VAL_BOOL: {
+            const uint8_t b = AS_BOOL(value);
+            return write_bytes(writer, &b, 1);
+        }
+        case VAL_NUMBER: {
+            const double n = AS_NUMBER(value);
+            return write_bytes(writer, &n, sizeof n);
+        }
+        case VAL_OBJ: return write_ref(writer, AS_OBJ(value));
+        case VAL_NIL:
+        case VAL_EMPTY:
+        default: return true;
+    }
+}
+
+static bool write_table(image_writer_t *writer, const table_t *table)
+{
+    int count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (!IS_EMPTY(table->entries[i].key))
+            count++;
+    }
+    if (!write_int(writer, count))
+        return false;
+    for (int i = 0; i < table->capacity; i++) {
+        if (IS_EMPTY(table->entries[i].key))
+            continue;
+        if (!write_value(writer, table->entries[i].key) || !write_value(writer, table->entries[i].value))
+            return false;
+    }
+    return true;
+}
+
+static bool write_object(image_writer_t *writer, const obj_t *obj)
+{
+    const uint8_t type = obj->type;
+    if (!write_bytes(writer, &type, 1))
+        return false;
+
+    switch (obj->type) {
+        case OBJ_BOUND_METHOD: {
+            const obj_bound_method_t *bound_method = (const obj_bound_method_t*)obj;
+            return write_value(writer, bound_method->receiving_instance) && write_ref(writer, (obj_t*)bound_method->method);
+        }
+        case OBJ_TYPECLASS: {
+            const obj_typeobj_t *typeobj = (const obj_typeobj_t*)obj;
+            return write_ref(writer, (obj_t*)typeobj->name) && write_ref(writer, (obj_t*)typeobj->super) &&
+                write_table(writer, &typeobj->fields) && write_table(writer, &typeobj->methods);
+        }
+        case OBJ_CLOSURE: {
+            const obj_closure_t *closure = (const obj_closure_t*)obj;
+            if (!write_ref(writer, (obj_t*)closure->function) || !write_int(writer, closure->upvalue_count))
+                return false;
+            for (int i = 0; i < closure->upvalue_count; i++) {
+                if (!write_ref(writer, (obj_t*)closure->upvalues[i]))
+                    return false;
+            }
+            return true;
+        }
+        case OBJ_FUNCTION: {
+            const obj_function_t *function = (const obj_function_t*)obj;
+            const chunk_t *chunk = &function->chunk;
+            if (!write_int(writer, function->arity) || !write_int(writer, function->upvalue_count) ||
+                !write_int(writer, function->max_slots) || !write_ref(writer, (obj_t*)function->name) ||
+                !write_int(writer, chunk->count) || !write_bytes(writer, chunk->code, chunk->count) ||
+                !write_int(writer, chunk->line_count) ||
+                !write_bytes(writer, chunk->lines, sizeof(line_info_t) * chunk->line_count) ||
+                !write_int(writer, chunk->constants.count))
+                return false;
+            for (int i = 0; i < chunk->constants.count; i++) {
+                if (!write_value(writer, chunk->constants.values[i]))
+                    return false;
+            }
+            const lazy_function_t *lazy = function->lazy;
+            const uint8_t is_lazy = lazy != NULL;
+            if (!write_bytes(writer, &is_lazy, 1))
+                return false;
+            if (!is_lazy)
+                return true;
+            const uint8_t flags[] = {lazy->function_type, lazy->in_type, lazy->has_supertype};
+            if (!write_ref(writer, (obj_t*)lazy->source) || !write_int(writer, lazy->line) ||
+                !write_bytes(writer, flags, sizeof flags) || !write_int(writer, lazy->upvalue_names.count))
+                return false;
+            for (int i = 0; i < lazy->upvalue_names.count; i++) {
+                if (!write_value(writer, lazy->upvalue_names.values[i]))
+                    return false;
+            }
+            return true;
+        }
+        case OBJ_INSTANCE: {
+            const obj_instance_t *instance = (const obj_instance_t*)obj;
+            return write_ref(writer, (obj_t*)instance->typeobj) && write_table(writer, &instance->fields);
+        }
+        case OBJ_NATIVE: {
+            const obj_native_t *native = (const obj_native_t*)obj;
+            return write_ref(writer, (obj_t*)native->name) && write_int(writer, native->arity);
+        }
+        case OBJ_STRING: {
+            const obj_string_t *string = (const obj_string_t*)obj;
+            const uint8_t interned = table_t_find_key_by_str(&vm.strings, string->chars, string->length, string->hash) == string;
+            return write_bytes(writer, &interned, 1) && write_int(writer, string->length) &&
+                write_bytes(writer, string->chars, string->length);
+        }
+        case OBJ_UPVALUE: return write_value(writer, ((const obj_upvalue_t*)obj)->closed);
+        case OBJ_LIST: {
+            const obj_list_t *list = (const obj_list_t*)obj;
+            if (!write_int(writer, list->elements.count))
+                return false;
+            for (int i = 0; i < list->elements.count; i++) {
+                if (!write_value(writer, list->elements.values[i]))
+                    return false;
+            }
+            return true;
+        }
+        case OBJ_MAP: return write_table(writer, &((const obj_map_t*)obj)->table);
+        case OBJ_BOUND_NATIVE_METHOD:
+        case OBJ_FILE:
+        default: return false;
+    }
+}
+
+static bool write_image(image_writer_t *writer, image_header_t *header)
+{
+    if (!write_bytes(writer, header, sizeof *header))
+        return false;
+
+    const long offsets_at = ftell(writer->f);
+    uint32_t *offsets = calloc(writer->count, sizeof *offsets);
+    if (offsets == NULL || !write_bytes(writer, offsets, sizeof *offsets * writer->count)) {
+        free(offsets);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; ok && i < vm.globals.capacity; i++) {
+        const table_entry_t *entry = &vm.globals.entries[i];
+        if (IS_EMPTY(entry->key) || is_process_global(entry->key))
+            continue;
+        ok = write_value(writer, entry->key) && write_value(writer, entry->value);
+    }
+    for (int i = 0; ok && i < writer->count; i++) {
+        offsets[i] = ftell(writer->f);
+        ok = write_object(writer, writer->objects[i]);
+    }
+
+    ok = ok && fseek(writer->f, offsets_at, SEEK_SET) == 0 && write_bytes(writer, offsets, sizeof *offsets * writer->count);
+    free(offsets);
+    return ok;
+}
+
+bool image_t_write(const char *image_path)
+{
+    image_writer_t writer = {0};
+    image_header_t header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, IMAGE_FILE_MAGIC, IMAGE_FILE_MAGIC_LEN);
+    header.format_version = IMAGE_FORMAT_VERSION;
+    header.opcode_count = INVALID_OPCODE;
+    header.byte_order_mark = IMAGE_BYTE_ORDER_MARK;
+
+    for (int i = 0; i < vm.globals.capacity; i++) {
+        const table_entry_t *entry = &vm.globals.entries[i];
+        if (IS_EMPTY(entry->key) || is_process_global(entry->key))
+            continue;
+        visit_value(&writer, entry->key);
+        visit_value(&writer, entry->value);
+        header.global_count++;
+    }
+    bool ok = true;
+    for (int i = 0; i < writer.count; i++) { // grows as we go
+        if (!visit_references(&writer, writer.objects[i])) {
+            fprintf(stderr, gettext("Cannot save %s in an image.\n"), obj_type_names[writer.objects[i]->type]);
+            ok = false;
+            break;
+        }
+    }
+    for (int i = 0; i < writer.count; i++) {
+        writer.objects[i]->is_marked = false;
+    }
+    header.object_count = writer.count;
+
+    if (ok) {
+        writer.refs = malloc(sizeof *writer.refs * (writer.count + 1));
+        if (writer.refs == NULL) {
+            fprintf(stderr, gettext("Failed to allocate image object list.\n"));
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < writer.count; i++) {
+            writer.refs[i] = (image_ref_t){.obj = writer.objects[i], .index = i};
+        }
+        qsort(writer.refs, writer.count, sizeof *writer.refs, compare_refs);
+
+        writer.f = fopen(image_path, "wb");
+        if (writer.f == NULL) {
+            perror(image_path);
+            ok = false;
+        } else {
+            ok = write_image(&writer, &header);
+            if (fclose(writer.f) != 0 || !ok) {
+                fprintf(stderr, gettext("Failed to write image file \"%s\".\n"), image_path);
+                unlink(image_path);
+                ok = false;
+            }
+        }
+    }
+
+    free(writer.refs);
+    free(writer.objects);
+    return ok;
+}
+
+static bool read_bytes(image_reader_t *reader, void *bytes, const size_t length)
+{
+    if ((size_t)(reader->end - reader->current) < length)
+        return false;
+    memcpy(bytes, reader->current, length);
+    reader->current += length;
+    return true;
+}
+
+static bool read_int(image_reader_t *reader, int32_t *value)
+{
+    return read_bytes(reader, value, sizeof *value);
+}
+
+static bool seek_object(image_reader_t *reader, const int index, uint8_t *type)
+{
+    uint32_t offset;
+    memcpy(&offset, reader->offsets + sizeof offset * index, sizeof offset);
+    if (offset >= (size_t)(reader->end - reader->start))
+        return false;
+    reader->current = reader->start + offset;
+    return read_bytes(reader, type, 1);
+}
+
+// the shell for index, or NULL when it is out of range or not yet created
+static obj_t *loaded_object(const image_reader_t *reader, const int32_t index)
+{
+    if (index < 0 || index >= reader->loaded->elements.count)
+        return NULL;
+    const value_t value = reader->loaded->elements.values[index];
+    return IS_OBJ(value) ? AS_OBJ(value) : NULL;
+}
+
+static bool read_ref(image_reader_t *reader, const obj_type_t type, obj_t **obj)
+{
+    int32_t index;
+    if (!read_int(reader, &index))
+        return false;
+    if (index == IMAGE_NO_REF) {
+        *obj = NULL;
+        return true;
+    }
+    *obj = loaded_object(reader, index);
+    return *obj != NULL && (*obj)->type == type;
+}
+
+static bool read_value(image_reader_t *reader, value_t *value)
+{
+    uint8_t tag;
+    if (!read_bytes(reader, &tag, 1))
+        return false;
+    switch (tag) {
+        case VAL_BOOL: {
+            uint8_t b;
+            if (!read_bytes(reader, &b, 1))
+                return false;
+            *value = BOOL_VAL(b != 0);
+            return true;
+        }
+        case VAL_NUMBER: {
+            double n;
+            if (!read_bytes(reader, &n, sizeof n))
+                return false;
+            *value = NUMBER_VAL(n);
+            return true;
+        }
+        case VAL_OBJ: {
+            int32_t index;
+            if (!read_int(reader, &index))
+                return false;
+            obj_t *obj = loaded_object(reader, index);
+            if (obj == NULL)
+                return false;
+            *value = OBJ_VAL(obj);
+            return true;
+        }
+        case VAL_NIL: *value = NIL_VAL; return true;
+        case VAL_EMPTY: *value = EMPTY_VAL; return true;
+        default: return false;
+    }
+}
+
+static bool read_table(image_reader_t *reader, table_t *table)
+{
+    int32_t count;
+    if (!read_int(reader, &count) || count < 0)
+        return false;
+    for (int i = 0; i < count; i++) {
+        value_t key, value;
+        if (!read_value(reader, &key) || !read_value(reader, &value))
+            return false;
+        table_t_set(table, key, value);
+    }
+    return true;
+}
+
+static bool read_values(image_reader_t *reader, value_list_t *values)
+{
+    int32_t count;
+    if (!read_int(reader, &count) || count < 0)
+        return false;
+    for (int i = 0; i < count; i++) {
+        value_t value;
+        if (!read_value(reader, &value))
+            return false;
+        value_list_t_add(values, value);
+    }
+    return true;
+}
+
+// strings first so natives can be resolved by name, closures wait for their functions
+static bool create_object(image_reader_t *reader, const int index, const bool strings)
+{
+    uint8_t type;
+    if (!seek_object(reader, index, &type))
+        return false;
+    if ((type == OBJ_STRING) != strings)
+        return true;
+
+    obj_t *obj = NULL;
+    switch (type) {
+        case OBJ_STRING: {
+            uint8_t interned;
+            int32_t length;
+            if (!read_bytes(reader, &interned, 1) || !read_int(reader, &length) || length < 0 ||
+                reader->end - reader->current < length)
+                return false;
+            obj = (obj_t*)obj_string_t_copy_from((const char *)reader->current, length, interned != 0);
+            break;
+        }
+        case OBJ_NATIVE: {
+            obj_t *name;
+            value_t native;
+            if (!read_ref(reader, OBJ_STRING, &name) || name == NULL ||
+                !table_t_get(&vm.globals, OBJ_VAL(name), &native) || !IS_NATIVE(native))
+                return false;
+            obj = AS_OBJ(native);
+            break;
+        }
+        case OBJ_BOUND_METHOD: obj = (obj_t*)obj_bound_method_t_allocate(NIL_VAL, NULL); break;
+        case OBJ_TYPECLASS: obj = (obj_t*)obj_typeobj_t_allocate(NULL); break;
+        case OBJ_FUNCTION: obj = (obj_t*)obj_function_t_allocate(); break;
+        case OBJ_INSTANCE: obj = (obj_t*)obj_instance_t_allocate(NULL); break;
+        case OBJ_UPVALUE: {
+            obj_upvalue_t *upvalue = obj_upvalue_t_allocate(NULL);
+            upvalue->location = &upvalue->closed;
+            obj = (obj_t*)upvalue;
+            break;
+        }
+        case OBJ_LIST: obj = (obj_t*)obj_list_t_allocate(); break;
+        case OBJ_MAP: obj = (obj_t*)obj_map_t_allocate(); break;
+        case OBJ_CLOSURE: return true;
+        default: return false;
+    }
+    reader->loaded->elements.values[index] = OBJ_VAL(obj);
+    return true;
+}
+
+static bool fill_function(image_reader_t *reader, const int index)
+{
+    uint8_t type;
+    if (!seek_object(reader, index, &type))
+        return false;
+    if (type != OBJ_FUNCTION)
+        return true;
+
+    obj_function_t *function = (obj_function_t*)loaded_object(reader, index);
+    chunk_t *chunk = &function->chunk;
+    int32_t arity, upvalue_count, max_slots, count;
+    obj_t *name;
+    if (!read_int(reader, &arity) || !read_int(reader, &upvalue_count) || upvalue_count < 0 ||
+        !read_int(reader, &max_slots) || max_slots < 0 || !read_ref(reader, OBJ_STRING, &name))
+        return false;
+    function->arity = arity;
+    function->upvalue_count = upvalue_count;
+    function->max_slots = max_slots;
+    function->name = (obj_string_t*)name;
+
+    if (!read_int(reader, &count) || count < 0 || reader->end - reader->current < count)
+        return false;
+    chunk->code = ALLOCATE(uint8_t, count);
+    chunk->capacity = count;
+    if (!read_bytes(reader, chunk->code, count))
+        return false;
+    chunk->count = count;
+
+    if (!read_int(reader, &count) || count < 0 || (reader->end - reader->current) / (ptrdiff_t)sizeof(line_info_t) < count)
+        return false;
+    chunk->lines = ALLOCATE(line_info_t, count);
+    chunk->line_capacity = count;
+    if (!read_bytes(reader, chunk->lines, sizeof(line_info_t) * count))
+        return false;
+    chunk->line_count = count;
+
+    uint8_t is_lazy;
+    if (!read_values(reader, &chunk->constants) || !read_bytes(reader, &is_lazy, 1))
+        return false;
+    if (!is_lazy)
+        return true;
+
+    lazy_function_t *lazy = ALLOCATE(lazy_function_t, 1);
+    lazy->source = NULL;
+    value_list_t_init(&lazy->upvalue_names);
+    function->lazy = lazy;
+    obj_t *source;
+    uint8_t flags[3];
+    if (!read_ref(reader, OBJ_STRING, &source) || source == NULL || !read_int(reader, &lazy->line) ||
+        !read_bytes(reader, flags, sizeof flags) || !read_values(reader, &lazy->upvalue_names) ||
+        lazy->upvalue_names.count != function->upvalue_count)
+        return false;
+    lazy->source = (obj_string_t*)source;
+    lazy->function_type = flags[0];
+    lazy->in_type = flags[1] != 0;
+    lazy->has_supertype = flags[2] != 0;
+    for (int i = 0; i < lazy->upvalue_names.count; i++) {
+        if (!IS_STRING(lazy->upvalue_names.values[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool create_closure(image_reader_t *reader, const int index)
+{
+    uint8_t type;
+    if (!seek_object(reader, index, &type))
+        return false;
+    if (type != OBJ_CLOSURE)
+        return true;
+
+    obj_t *function;
+    int32_t upvalue_count;
+    if (!read_ref(reader, OBJ_FUNCTION, &function) || function == NULL || !read_int(reader, &upvalue_count) ||
+        upvalue_count != ((obj_function_t*)function)->upvalue_count)
+        return false;
+    reader->loaded->elements.values[index] = OBJ_VAL(obj_closure_t_allocate((obj_function_t*)function));
+    return true;
+}
+
+static bool fill_object(image_reader_t *reader, const int index)
+{
+    uint8_t type;
+    if (!seek_object(reader, index, &type))
+        return false;
+
+    obj_t *obj = loaded_object(reader, index);
+    switch (type) {
+        case OBJ_BOUND_METHOD: {
+            obj_bound_method_t *bound_method = (obj_bound_method_t*)obj;
+            obj_t *method;
+            if (!read_value(reader, &bound_method->receiving_instance) || !read_ref(reader, OBJ_CLOSURE, &method))
+                return false;
+            bound_method->method = (obj_closure_t*)method;
+            return true;
+        }
+        case OBJ_TYPECLASS: {
+            obj_typeobj_t *typeobj = (obj_typeobj_t*)obj;
+            obj_t *name, *super;
+            if (!read_ref(reader, OBJ_STRING, &name) || !read_ref(reader, OBJ_TYPECLASS, &super))
+                return false;
+            typeobj->name = (obj_string_t*)name;
+            typeobj->super = (obj_typeobj_t*)super;
+            return read_table(reader, &typeobj->fields) && read_table(reader, &typeobj->methods);
+        }
+        case OBJ_CLOSURE: {
+            obj_closure_t *closure = (obj_closure_t*)obj;
+            obj_t *function;
+            int32_t upvalue_count;
+            if (!read_ref(reader, OBJ_FUNCTION, &function) || !read_int(reader, &upvalue_count))
+                return false;
+            for (int i = 0; i < closure->upvalue_count; i++) {
+                obj_t *upvalue;
+                if (!read_ref(reader, OBJ_UPVALUE, &upvalue))
+                    return false;
+                closure->upvalues[i] = (obj_upvalue_t*)upvalue;
+            }
+            return true;
+        }
+        case OBJ_INSTANCE: {
+            obj_instance_t *instance = (obj_instance_t*)obj;
+            obj_t *typeobj;
+            if (!read_ref(reader, OBJ_TYPECLASS, &typeobj))
+                return false;
+            instance->typeobj = (obj_typeobj_t*)typeobj;
+            return read_table(reader, &instance->fields);
+        }
+        case OBJ_UPVALUE: return read_value(reader, &((obj_upvalue_t*)obj)->closed);
+        case OBJ_LIST: return read_values(reader, &((obj_list_t*)obj)->elements);
+        case OBJ_MAP: return read_table(reader, &((obj_map_t*)obj)->table);
+        case OBJ_FUNCTION:
+        case OBJ_NATIVE:
+        case OBJ_STRING: return true; // already complete
+        default: return false;
+    }
+}
+
+static bool read_image(image_reader_t *reader)
+{
+    image_header_t header;
+    if (!read_bytes(reader, &header, sizeof header) ||
+        memcmp(header.magic, IMAGE_FILE_MAGIC, IMAGE_FILE_MAGIC_LEN) != 0 ||
+        header.format_version != IMAGE_FORMAT_VERSION ||
+        header.opcode_count != INVALID_OPCODE ||
+        header.byte_order_mark != IMAGE_BYTE_ORDER_MARK ||
+        header.object_count > INT32_MAX ||
+        (size_t)(reader->end - reader->current) / sizeof(uint32_t) < header.object_count)
+        return false;
+
+    const int object_count = header.object_count;
+    reader->offsets = reader->current;
+    reader->current += sizeof(uint32_t) * object_count;
+    const uint8_t *globals = reader->current;
+
+    for (int i = 0; i < object_count; i++) {
+        value_list_t_add(&reader->loaded->elements, NIL_VAL);
+    }
+    for (int i = 0; i < object_count; i++) {
+        if (!create_object(reader, i, true))
+            return false;
+    }
+    for (int i = 0; i < object_count; i++) {
+        if (!create_object(reader, i, false))
+            return false;
+    }
+    for (int i = 0; i < object_count; i++) {
+        if (!fill_function(reader, i))
+            return false;
+    }
+    for (int i = 0; i < object_count; i++) {
+        if (!create_closure(reader, i))
+            return false;
+    }
+    for (int i = 0; i < object_count; i++) {
+        if (!fill_object(reader, i))
+            return false;
+    }
+
+    // only publish the globals once the whole graph is in place
+    reader->current = globals;
+    for (uint32_t i = 0; i < header.global_count; i++) {
+        value_t key, value;
+        if (!read_value(reader, &key) || !read_value(reader, &value))
+            return false;
+        table_t_set(&vm.globals, key, value);
+    }
+    return true;
+}
+
+bool image_t_load(const char *image_path)
+{
+    const int fd = open(image_path, O_RDONLY);
+    if (fd == -1) {
+        perror(image_path);
+        return false;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1 || statbuf.st_size == 0) {
+        fprintf(stderr, gettext("Invalid image file \"%s\".\n"), image_path);
+        close(fd);
+        return false;
+    }
+    uint8_t *mapped = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(image_path);
+        return false;
+    }
+
+    // everything created while loading hangs off this list so partially built objects survive collections
+    obj_list_t *loaded = obj_list_t_allocate();
+    vm_push(OBJ_VAL(loaded));
+    image_reader_t reader = {.start = mapped, .current = mapped, .end = mapped + statbuf.st_size, .offsets = NULL, .loaded = loaded};
+    const bool ok = read_image(&reader);
+    vm_pop();
+
+    munmap(mapped, statbuf.st_size);
+    if (!ok)
+        fprintf(stderr, gettext("Invalid image file \"%s\".\n"), image_path);
+    return ok;
+}
+#undef IMAGE_BYTE_ORDER_MARK
+#undef IMAGE_NO_REF
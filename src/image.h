@@ -0,0 +1,33 @@
+#ifndef tater_image_h
+#define tater_image_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdbool.h>
+#include "type.h"
+
+#define IMAGE_FILE_MAGIC "TOTI"
+#define IMAGE_FILE_MAGIC_LEN 4
+// bump whenever the serialized layout or opcode encoding changes
+#define IMAGE_FORMAT_VERSION 5
+
+bool image_t_write(const char *image_path);
+bool image_t_load(const char *image_path);
+
+#endif
@@ -0,0 +1,1021 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "ir.h"
+#include "memory.h"
+#include "vmopcodes.h"
+
+// marks an instruction a pass deleted, until the next ir_t_compact
+#define IR_REMOVED INVALID_OPCODE
+#define IR_MAX_ROUNDS 8
+#define IR_MAX_HOISTS 32
+
+static ir_instruction_t *ir_t_append(ir_t *ir)
+{
+    if (ir->capacity < ir->count + 1) {
+        const int old_capacity = ir->capacity;
+        ir->capacity = GROW_CAPACITY(old_capacity);
+        ir->instructions = GROW_ARRAY(ir_instruction_t, ir->instructions, old_capacity, ir->capacity);
+    }
+    ir_instruction_t *instruction = &ir->instructions[ir->count++];
+    memset(instruction, 0, sizeof *instruction);
+    instruction->upvalues = -1;
+    instruction->target = -1;
+    return instruction;
+}
+
+static int ir_t_append_bytes(ir_t *ir, const uint8_t *bytes, const int length)
+{
+    if (ir->byte_capacity < ir->byte_count + length) {
+        const int old_capacity = ir->byte_capacity;
+        ir->byte_capacity = GROW_CAPACITY(ir->byte_count + length);
+        ir->bytes = GROW_ARRAY(uint8_t, ir->bytes, old_capacity, ir->byte_capacity);
+    }
+    const int offset = ir->byte_count;
+    if (length > 0) { // a closure without upvalues may have no bytes allocated yet
+        memcpy(ir->bytes + offset, bytes, length);
+    }
+    ir->byte_count += length;
+    return offset;
+}
+
+static bool is_jump(const uint8_t op)
+{
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP;
+}
+
+static bool falls_through(const uint8_t op)
+{
+    return op != OP_JUMP && op != OP_LOOP && op != OP_RETURN && op != OP_EXIT;
+}
+
+static int upvalue_count(const ir_t *ir, const ir_instruction_t *instruction)
+{
+    return AS_FUNCTION(ir->chunk->constants.values[instruction->operands[0]])->upvalue_count;
+}
+
+// operand bytes after the opcode, -1 for encodings the IR leaves alone
+static int operand_length(const uint8_t op)
+{
+    switch (op) {
+        case OP_NIL: case OP_TRUE: case OP_FALSE: case OP_POP: case OP_DUP:
+        case OP_EQUAL: case OP_GREATER: case OP_LESS: case OP_ADD: case OP_SUBTRACT:
+        case OP_MULTIPLY: case OP_DIVIDE: case OP_BITWISE_AND: case OP_BITWISE_OR:
+        case OP_BITWISE_NOT: case OP_BITWISE_XOR: case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT:
+        case OP_NOT: case OP_MOD: case OP_NEGATE: case OP_PRINT: case OP_ERROR:
+        case OP_CLOSE_UPVALUE: case OP_RETURN: case OP_EXIT: case OP_INHERIT:
+            return 0;
+        case OP_CONSTANT: case OP_POPN: case OP_GET_LOCAL: case OP_SET_LOCAL:
+        case OP_GET_GLOBAL: case OP_DEFINE_GLOBAL: case OP_SET_GLOBAL: case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE: case OP_GET_PROPERTY: case OP_SET_PROPERTY: case OP_GET_SUPER:
+        case OP_CALL: case OP_TAIL_CALL: case OP_TYPE: case OP_METHOD: case OP_FIELD:
+            return 1;
+        case OP_INVOKE: case OP_SUPER_INVOKE: case OP_JUMP: case OP_JUMP_IF_FALSE: case OP_LOOP:
+            return 2;
+        default:
+            return -1;
+    }
+}
+
+static int lowered_length(const ir_t *ir, const ir_instruction_t *instruction)
+{
+    if (instruction->op == OP_CLOSURE) {
+        return 2 + 2 * upvalue_count(ir, instruction);
+    }
+    return 1 + operand_length(instruction->op);
+}
+
+bool ir_t_init(ir_t *ir, const obj_function_t *function)
+{
+    memset(ir, 0, sizeof *ir);
+    const chunk_t *chunk = &function->chunk;
+    ir->chunk = chunk;
+    ir->entry_depth = function->arity + 1;
+    if (chunk->count == 0 || chunk->code[chunk->count - 1] != OP_RETURN) {
+        return false;
+    }
+
+    int *index_at = ALLOCATE(int, chunk->count);
+    for (int offset = 0; offset < chunk->count; offset++) {
+        index_at[offset] = -1;
+    }
+
+    bool ok = true;
+    for (int offset = 0; ok && offset < chunk->count;) {
+        index_at[offset] = ir->count;
+        ir_instruction_t *instruction = ir_t_append(ir);
+        instruction->op = chunk->code[offset];
+        instruction->line = chunk_t_get_line(chunk, offset);
+
+        int length = operand_length(instruction->op);
+        if (instruction->op == OP_CLOSURE && offset + 1 < chunk->count) {
+            instruction->operands[0] = chunk->code[offset + 1];
+            length = 1 + 2 * upvalue_count(ir, instruction);
+        }
+        if (length < 0 || offset + length >= chunk->count) {
+            ok = false;
+        } else if (instruction->op == OP_CLOSURE) {
+            instruction->upvalues = ir_t_append_bytes(ir, chunk->code + offset + 2, length - 1);
+        } else if (is_jump(instruction->op)) {
+            // a byte offset until every instruction has an index
+            const int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+            instruction->target = instruction->op == OP_LOOP ? offset + 3 - jump : offset + 3 + jump;
+        } else {
+            memcpy(instruction->operands, chunk->code + offset + 1, length);
+        }
+        offset += 1 + length;
+    }
+
+    for (int i = 0; ok && i < ir->count; i++) {
+        ir_instruction_t *instruction = &ir->instructions[i];
+        if (!is_jump(instruction->op)) {
+            continue;
+        }
+        if (instruction->target < 0 || instruction->target >= chunk->count || index_at[instruction->target] == -1) {
+            ok = false; // e.g. a jump that was never patched
+        } else {
+            instruction->target = index_at[instruction->target];
+        }
+    }
+
+    FREE_ARRAY(int, index_at, chunk->count);
+    return ok;
+}
+
+void ir_t_free(ir_t *ir)
+{
+    FREE_ARRAY(ir_instruction_t, ir->instructions, ir->capacity);
+    FREE_ARRAY(uint8_t, ir->bytes, ir->byte_capacity);
+    memset(ir, 0, sizeof *ir);
+}
+
+bool ir_t_lower(const ir_t *ir, chunk_t *chunk)
+{
+    int *offsets = ALLOCATE(int, ir->count + 1);
+    offsets[0] = 0;
+    for (int i = 0; i < ir->count; i++) {
+        offsets[i + 1] = offsets[i] + lowered_length(ir, &ir->instructions[i]);
+    }
+
+    // only an unconditional jump can run backwards, as OP_LOOP
+    bool ok = true;
+    for (int i = 0; ok && i < ir->count; i++) {
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        if (is_jump(instruction->op)) {
+            const int from = offsets[i] + 3;
+            const int to = offsets[instruction->target];
+            if (to >= from) {
+                ok = to - from <= UINT16_MAX;
+            } else {
+                ok = instruction->op != OP_JUMP_IF_FALSE && from - to <= UINT16_MAX;
+            }
+        }
+    }
+
+    if (ok) {
+        chunk_t lowered;
+        chunk_t_init(&lowered);
+        for (int i = 0; i < ir->count; i++) {
+            const ir_instruction_t *instruction = &ir->instructions[i];
+            if (is_jump(instruction->op)) {
+                const int from = offsets[i] + 3;
+                const int to = offsets[instruction->target];
+                uint8_t op = instruction->op;
+                if (op != OP_JUMP_IF_FALSE) {
+                    op = to >= from ? OP_JUMP : OP_LOOP;
+                }
+                const int distance = to >= from ? to - from : from - to;
+                chunk_t_write(&lowered, op, instruction->line);
+                chunk_t_write(&lowered, (distance >> 8) & 0xff, instruction->line);
+                chunk_t_write(&lowered, distance & 0xff, instruction->line);
+            } else if (instruction->op == OP_CLOSURE) {
+                chunk_t_write(&lowered, instruction->op, instruction->line);
+                chunk_t_write(&lowered, instruction->operands[0], instruction->line);
+                for (int b = 0; b < 2 * upvalue_count(ir, instruction); b++) {
+                    chunk_t_write(&lowered, ir->bytes[instruction->upvalues + b], instruction->line);
+                }
+            } else {
+                chunk_t_write(&lowered, instruction->op, instruction->line);
+                for (int b = 0; b < operand_length(instruction->op); b++) {
+                    chunk_t_write(&lowered, instruction->operands[b], instruction->line);
+                }
+            }
+        }
+
+        // the constants stay where they are, only the code and its lines are replaced
+        FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+        FREE_ARRAY(line_info_t, chunk->lines, chunk->line_capacity);
+        chunk->code = lowered.code;
+        chunk->count = lowered.count;
+        chunk->capacity = lowered.capacity;
+        chunk->lines = lowered.lines;
+        chunk->line_count = lowered.line_count;
+        chunk->line_capacity = lowered.line_capacity;
+    }
+
+    FREE_ARRAY(int, offsets, ir->count + 1);
+    return ok;
+}
+
+// drop removed instructions, moving jumps that landed on one to the next instruction still there
+static void ir_t_compact(ir_t *ir)
+{
+    int *remap = ALLOCATE(int, ir->count + 1);
+    int live = 0;
+    for (int i = 0; i < ir->count; i++) {
+        remap[i] = ir->instructions[i].op == IR_REMOVED ? -1 : live++;
+    }
+    remap[ir->count] = live;
+    for (int i = ir->count - 1; i >= 0; i--) {
+        if (remap[i] == -1) {
+            remap[i] = remap[i + 1];
+        }
+    }
+
+    int next = 0;
+    for (int i = 0; i < ir->count; i++) {
+        ir_instruction_t instruction = ir->instructions[i];
+        if (instruction.op == IR_REMOVED) {
+            continue;
+        }
+        if (instruction.target >= 0) {
+            instruction.target = remap[instruction.target];
+        }
+        ir->instructions[next++] = instruction;
+    }
+    FREE_ARRAY(int, remap, ir->count + 1);
+    ir->count = live;
+}
+
+// open count empty instructions at index, jumps to the instruction that was there still reach it
+static void ir_t_insert(ir_t *ir, const int index, const int count)
+{
+    for (int i = 0; i < count; i++) {
+        ir_t_append(ir);
+    }
+    memmove(&ir->instructions[index + count], &ir->instructions[index], sizeof(ir_instruction_t) * (ir->count - count - index));
+    for (int i = 0; i < ir->count; i++) {
+        ir_instruction_t *instruction = &ir->instructions[i];
+        if (i >= index && i < index + count) {
+            memset(instruction, 0, sizeof *instruction);
+            instruction->upvalues = -1;
+            instruction->target = -1;
+        } else if (instruction->target >= index) {
+            instruction->target += count;
+        }
+    }
+}
+
+static bool *ir_t_jump_targets(const ir_t *ir)
+{
+    bool *targeted = ALLOCATE(bool, ir->count);
+    memset(targeted, 0, sizeof(bool) * ir->count);
+    for (int i = 0; i < ir->count; i++) {
+        if (ir->instructions[i].target >= 0) {
+            targeted[ir->instructions[i].target] = true;
+        }
+    }
+    return targeted;
+}
+
+static bool same_constant(const ir_t *ir, const uint8_t a, const uint8_t b)
+{
+    const value_t x = ir->chunk->constants.values[a];
+    const value_t y = ir->chunk->constants.values[b];
+    if (a == b) {
+        return true;
+    }
+    if (x.type != y.type) {
+        return false;
+    }
+    // compare the bits so 0 and -0 stay apart
+    return IS_NUMBER(x) ? memcmp(&x.as.number, &y.as.number, sizeof x.as.number) == 0 : value_t_equal(x, y);
+}
+
+static bool same_instruction(const ir_t *ir, const ir_instruction_t *a, const ir_instruction_t *b)
+{
+    if (a->op != b->op) {
+        return false;
+    }
+    if (a->op == OP_CONSTANT || a->op == OP_GET_GLOBAL) {
+        return same_constant(ir, a->operands[0], b->operands[0]);
+    }
+    return memcmp(a->operands, b->operands, operand_length(a->op)) == 0;
+}
+
+// values taken off and put back on the stack, false where the IR does not know
+static bool stack_effect(const ir_instruction_t *instruction, int *pops, int *pushes)
+{
+    *pops = 0;
+    *pushes = 0;
+    switch (instruction->op) {
+        case OP_CONSTANT: case OP_NIL: case OP_TRUE: case OP_FALSE: case OP_GET_LOCAL:
+        case OP_GET_GLOBAL: case OP_GET_UPVALUE: case OP_CLOSURE: case OP_TYPE:
+            *pushes = 1;
+            return true;
+        case OP_DUP:
+            *pops = 1;
+            *pushes = 2;
+            return true;
+        case OP_POP: case OP_DEFINE_GLOBAL: case OP_CLOSE_UPVALUE: case OP_PRINT: case OP_ERROR:
+        case OP_INHERIT: case OP_METHOD: case OP_FIELD: case OP_RETURN: case OP_EXIT:
+            *pops = 1;
+            return true;
+        case OP_POPN:
+            *pops = instruction->operands[0];
+            return true;
+        case OP_SET_LOCAL: case OP_SET_GLOBAL: case OP_SET_UPVALUE: case OP_GET_PROPERTY:
+        case OP_NOT: case OP_NEGATE: case OP_BITWISE_NOT: case OP_JUMP_IF_FALSE:
+            *pops = 1;
+            *pushes = 1;
+            return true;
+        case OP_SET_PROPERTY: case OP_GET_SUPER: case OP_EQUAL: case OP_GREATER: case OP_LESS:
+        case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_MOD:
+        case OP_BITWISE_AND: case OP_BITWISE_OR: case OP_BITWISE_XOR: case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT:
+            *pops = 2;
+            *pushes = 1;
+            return true;
+        case OP_JUMP: case OP_LOOP:
+            return true;
+        case OP_CALL: case OP_TAIL_CALL: case OP_INVOKE:
+            *pops = instruction->operands[instruction->op == OP_INVOKE ? 1 : 0] + 1;
+            *pushes = 1;
+            return true;
+        case OP_SUPER_INVOKE:
+            *pops = instruction->operands[1] + 2;
+            *pushes = 1;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// operators with no side effects; they can still fail at runtime on the wrong types
+static bool is_pure_operator(const uint8_t op)
+{
+    switch (op) {
+        case OP_EQUAL: case OP_GREATER: case OP_LESS: case OP_ADD: case OP_SUBTRACT:
+        case OP_MULTIPLY: case OP_DIVIDE: case OP_MOD: case OP_BITWISE_AND: case OP_BITWISE_OR:
+        case OP_BITWISE_XOR: case OP_BITWISE_NOT: case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT:
+        case OP_NOT: case OP_NEGATE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// loads that can never fail or have a side effect
+static bool is_safe_load(const uint8_t op)
+{
+    return op == OP_CONSTANT || op == OP_NIL || op == OP_TRUE || op == OP_FALSE || op == OP_GET_LOCAL || op == OP_GET_UPVALUE;
+}
+
+// the first instruction of the pure expression whose value instruction end leaves, or -1
+static int expression_start(const ir_t *ir, const int lower, const int end, const bool allow_globals)
+{
+    int need = 1;
+    for (int i = end; i >= lower; i--) {
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        if (!is_pure_operator(instruction->op) && !is_safe_load(instruction->op) &&
+            !(allow_globals && instruction->op == OP_GET_GLOBAL)) {
+            return -1;
+        }
+        int pops, pushes;
+        stack_effect(instruction, &pops, &pushes);
+        need = need - pushes + pops;
+        if (need == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Copy propagation: a value stored to a variable and popped, then loaded
+ * straight back, is still the value the store left on the stack.
+ */
+bool ir_t_propagate_copies(ir_t *ir)
+{
+    bool *targeted = ir_t_jump_targets(ir);
+    bool changed = false;
+    for (int i = 0; i + 2 < ir->count; i++) {
+        const ir_instruction_t *store = &ir->instructions[i];
+        const ir_instruction_t *load = &ir->instructions[i + 2];
+        if (ir->instructions[i + 1].op != OP_POP || targeted[i + 1] || targeted[i + 2]) {
+            continue;
+        }
+        const bool forwards =
+            (store->op == OP_SET_LOCAL && load->op == OP_GET_LOCAL && store->operands[0] == load->operands[0]) ||
+            (store->op == OP_SET_UPVALUE && load->op == OP_GET_UPVALUE && store->operands[0] == load->operands[0]) ||
+            (store->op == OP_SET_GLOBAL && load->op == OP_GET_GLOBAL && same_constant(ir, store->operands[0], load->operands[0]));
+        if (forwards) {
+            ir->instructions[i + 1].op = IR_REMOVED;
+            ir->instructions[i + 2].op = IR_REMOVED;
+            changed = true;
+            i += 2;
+        }
+    }
+    FREE_ARRAY(bool, targeted, ir->count);
+    if (changed) {
+        ir_t_compact(ir);
+    }
+    return changed;
+}
+
+/*
+ * Common subexpression elimination: a pure expression evaluated again right
+ * after itself, as in x * x or (a + b) * (a + b), is replaced by OP_DUP.
+ * Nothing runs between the two so even globals read the same value.
+ */
+bool ir_t_eliminate_common_subexpressions(ir_t *ir)
+{
+    bool *targeted = ir_t_jump_targets(ir);
+    bool changed = false;
+    for (int i = 0; i < ir->count; i++) {
+        const int start = expression_start(ir, 0, i, true);
+        const int length = i - start + 1;
+        if (start < 0 || i + length >= ir->count) {
+            continue;
+        }
+        bool same = true;
+        for (int j = start; same && j <= i; j++) {
+            // nothing may jump into the middle of the first copy or anywhere into the second
+            same = (j == start || !targeted[j]) && !targeted[j + length] &&
+                same_instruction(ir, &ir->instructions[j], &ir->instructions[j + length]);
+        }
+        if (same) {
+            ir->instructions[i + 1].op = OP_DUP;
+            for (int j = i + 2; j <= i + length; j++) {
+                ir->instructions[j].op = IR_REMOVED;
+            }
+            changed = true;
+            i += length;
+        }
+    }
+    FREE_ARRAY(bool, targeted, ir->count);
+    if (changed) {
+        ir_t_compact(ir);
+    }
+    return changed;
+}
+
+/*
+ * Jump threading: a jump that lands on an unconditional jump goes straight to
+ * its destination, and OP_JUMP_IF_FALSE landing on another one skips it too,
+ * since the falsey value it tested is still on top of the stack. A jump to the
+ * next instruction is dropped.
+ */
+bool ir_t_thread_jumps(ir_t *ir)
+{
+    bool changed = false;
+    for (int i = 0; i < ir->count; i++) {
+        ir_instruction_t *jump = &ir->instructions[i];
+        if (!is_jump(jump->op)) {
+            continue;
+        }
+        int target = jump->target;
+        for (int hops = 0; hops < ir->count; hops++) {
+            const ir_instruction_t *landing = &ir->instructions[target];
+            int next;
+            if (landing->op == OP_JUMP || landing->op == OP_LOOP) {
+                next = landing->target;
+            } else if (jump->op == OP_JUMP_IF_FALSE && landing->op == OP_JUMP_IF_FALSE) {
+                next = landing->target;
+            } else {
+                break;
+            }
+            if (next == target || (jump->op == OP_JUMP_IF_FALSE && next <= i)) {
+                break; // a jump to itself, or a conditional jump would have to run backwards
+            }
+            target = next;
+        }
+        if (target != jump->target) {
+            jump->target = target;
+            changed = true;
+        }
+        if (jump->op != OP_JUMP_IF_FALSE && jump->target == i + 1) {
+            jump->op = IR_REMOVED;
+            changed = true;
+        }
+    }
+    if (changed) {
+        ir_t_compact(ir);
+    }
+    return changed;
+}
+
+typedef struct {
+    int *depth; // stack depth before each instruction, -1 where unreachable
+    int *block_of;
+    int *block_start; // block_count + 1 entries
+    int block_count;
+    int *pred_start; // block_count + 1 entries into preds
+    int *preds;
+    int *idom; // immediate dominator of each block, -1 where unreachable
+    int *order; // reverse postorder position of each block
+} ir_cfg_t;
+
+static bool ir_t_depths(const ir_t *ir, int *depth)
+{
+    for (int i = 0; i < ir->count; i++) {
+        depth[i] = -1;
+    }
+    int *work = ALLOCATE(int, ir->count);
+    int work_count = 0;
+    depth[0] = ir->entry_depth;
+    work[work_count++] = 0;
+
+    bool ok = true;
+    while (ok && work_count > 0) {
+        const int i = work[--work_count];
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        int pops, pushes;
+        if (!stack_effect(instruction, &pops, &pushes) || depth[i] < pops) {
+            ok = false;
+            break;
+        }
+        const int after = depth[i] - pops + pushes;
+        int successors[2];
+        int successor_count = 0;
+        if (falls_through(instruction->op)) {
+            successors[successor_count++] = i + 1;
+        }
+        if (instruction->target >= 0) {
+            successors[successor_count++] = instruction->target;
+        }
+        for (int s = 0; ok && s < successor_count; s++) {
+            const int successor = successors[s];
+            if (successor >= ir->count) {
+                ok = false;
+            } else if (depth[successor] == -1) {
+                depth[successor] = after;
+                work[work_count++] = successor;
+            } else {
+                ok = depth[successor] == after;
+            }
+        }
+    }
+    FREE_ARRAY(int, work, ir->count);
+    return ok;
+}
+
+static int block_successors(const ir_t *ir, const ir_cfg_t *cfg, const int block, int successors[2])
+{
+    const int last = cfg->block_start[block + 1] - 1;
+    const ir_instruction_t *instruction = &ir->instructions[last];
+    int count = 0;
+    if (falls_through(instruction->op) && last + 1 < ir->count) {
+        successors[count++] = cfg->block_of[last + 1];
+    }
+    if (instruction->target >= 0) {
+        successors[count++] = cfg->block_of[instruction->target];
+    }
+    return count;
+}
+
+static int intersect(const ir_cfg_t *cfg, int a, int b)
+{
+    while (a != b) {
+        while (cfg->order[a] > cfg->order[b]) a = cfg->idom[a];
+        while (cfg->order[b] > cfg->order[a]) b = cfg->idom[b];
+    }
+    return a;
+}
+
+static void ir_cfg_t_free(ir_cfg_t *cfg, const ir_t *ir)
+{
+    FREE_ARRAY(int, cfg->depth, ir->count);
+    FREE_ARRAY(int, cfg->block_of, ir->count);
+    FREE_ARRAY(int, cfg->block_start, ir->count + 1);
+    FREE_ARRAY(int, cfg->pred_start, ir->count + 1);
+    FREE_ARRAY(int, cfg->preds, 2 * ir->count);
+    FREE_ARRAY(int, cfg->idom, ir->count);
+    FREE_ARRAY(int, cfg->order, ir->count);
+}
+
+// basic blocks, their predecessors and dominators (Cooper, Harvey and Kennedy)
+static bool ir_cfg_t_init(ir_cfg_t *cfg, const ir_t *ir)
+{
+    cfg->depth = ALLOCATE(int, ir->count);
+    cfg->block_of = ALLOCATE(int, ir->count);
+    cfg->block_start = ALLOCATE(int, ir->count + 1);
+    cfg->pred_start = ALLOCATE(int, ir->count + 1);
+    cfg->preds = ALLOCATE(int, 2 * ir->count);
+    cfg->idom = ALLOCATE(int, ir->count);
+    cfg->order = ALLOCATE(int, ir->count);
+    if (!ir_t_depths(ir, cfg->depth)) {
+        ir_cfg_t_free(cfg, ir);
+        return false;
+    }
+
+    bool *targeted = ir_t_jump_targets(ir);
+    cfg->block_count = 0;
+    for (int i = 0; i < ir->count; i++) {
+        const bool leader = i == 0 || targeted[i] ||
+            is_jump(ir->instructions[i - 1].op) || !falls_through(ir->instructions[i - 1].op);
+        if (leader) {
+            cfg->block_start[cfg->block_count++] = i;
+        }
+        cfg->block_of[i] = cfg->block_count - 1;
+    }
+    cfg->block_start[cfg->block_count] = ir->count;
+    FREE_ARRAY(bool, targeted, ir->count);
+
+    int successors[2];
+    for (int b = 0; b <= cfg->block_count; b++) {
+        cfg->pred_start[b] = 0;
+    }
+    for (int b = 0; b < cfg->block_count; b++) {
+        const int count = block_successors(ir, cfg, b, successors);
+        for (int s = 0; s < count; s++) {
+            cfg->pred_start[successors[s] + 1]++;
+        }
+    }
+    for (int b = 0; b < cfg->block_count; b++) {
+        cfg->pred_start[b + 1] += cfg->pred_start[b];
+    }
+    int *filled = ALLOCATE(int, cfg->block_count);
+    memset(filled, 0, sizeof(int) * cfg->block_count);
+    for (int b = 0; b < cfg->block_count; b++) {
+        const int count = block_successors(ir, cfg, b, successors);
+        for (int s = 0; s < count; s++) {
+            cfg->preds[cfg->pred_start[successors[s]] + filled[successors[s]]++] = b;
+        }
+    }
+    FREE_ARRAY(int, filled, cfg->block_count);
+
+    // reverse postorder from an iterative depth first walk
+    int *stack = ALLOCATE(int, cfg->block_count);
+    int *next_edge = ALLOCATE(int, cfg->block_count);
+    int *postorder = ALLOCATE(int, cfg->block_count);
+    int stack_count = 0, post_count = 0;
+    for (int b = 0; b < cfg->block_count; b++) {
+        next_edge[b] = 0;
+        cfg->order[b] = -1;
+        cfg->idom[b] = -1;
+    }
+    stack[stack_count++] = 0;
+    cfg->order[0] = 0; // visited
+    while (stack_count > 0) {
+        const int b = stack[stack_count - 1];
+        const int count = block_successors(ir, cfg, b, successors);
+        if (next_edge[b] < count) {
+            const int s = successors[next_edge[b]++];
+            if (cfg->order[s] == -1) {
+                cfg->order[s] = 0;
+                stack[stack_count++] = s;
+            }
+        } else {
+            postorder[post_count++] = b;
+            stack_count--;
+        }
+    }
+    for (int p = 0; p < post_count; p++) {
+        cfg->order[postorder[p]] = post_count - 1 - p;
+    }
+
+    cfg->idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int p = post_count - 2; p >= 0; p--) {
+            const int b = postorder[p];
+            int idom = -1;
+            for (int e = cfg->pred_start[b]; e < cfg->pred_start[b + 1]; e++) {
+                const int pred = cfg->preds[e];
+                if (cfg->idom[pred] != -1) {
+                    idom = idom == -1 ? pred : intersect(cfg, pred, idom);
+                }
+            }
+            if (idom != cfg->idom[b]) {
+                cfg->idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+    FREE_ARRAY(int, stack, cfg->block_count);
+    FREE_ARRAY(int, next_edge, cfg->block_count);
+    FREE_ARRAY(int, postorder, cfg->block_count);
+    return true;
+}
+
+static bool dominates(const ir_cfg_t *cfg, const int a, int b)
+{
+    while (b != a && b != 0) {
+        b = cfg->idom[b];
+    }
+    return b == a;
+}
+
+static bool invariant_expression(const ir_t *ir, const int start, const int end, const int depth, const bool *written, const bool *captured)
+{
+    for (int i = start; i <= end; i++) {
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        if (instruction->op == OP_GET_LOCAL) {
+            const uint8_t slot = instruction->operands[0];
+            if (slot >= depth || written[slot] || captured[slot]) {
+                return false;
+            }
+        } else if (instruction->op == OP_GET_UPVALUE) {
+            return false; // another closure can change it
+        } else if (!is_pure_operator(instruction->op) && !is_safe_load(instruction->op)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The hoisted value lives in a new stack slot just below everything the loop
+ * pushes, so the loop's slots move up by one and the value is popped where
+ * every way out of the loop meets again at the loop's own stack depth.
+ */
+static bool hoist_from_loop(ir_t *ir, const ir_cfg_t *cfg, const int header, const bool *in_loop, const bool *captured)
+{
+    const int start = cfg->block_start[header];
+    const int depth = cfg->depth[start];
+    if (depth < 0 || depth >= UINT8_MAX) {
+        return false;
+    }
+    if (start > 0 && in_loop[cfg->block_of[start - 1]] && falls_through(ir->instructions[start - 1].op)) {
+        return false; // the loop would run into the hoisted code again
+    }
+
+    bool written[UINT8_COUNT] = {false};
+    for (int i = 0; i < ir->count; i++) {
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        if (!in_loop[cfg->block_of[i]]) {
+            if (instruction->target == start) {
+                return false; // entered from outside without passing the hoisted code
+            }
+            continue;
+        }
+        int pops, pushes;
+        stack_effect(instruction, &pops, &pushes);
+        if (cfg->depth[i] < depth || (falls_through(instruction->op) && cfg->depth[i] - pops + pushes < depth)) {
+            return false;
+        }
+        if (instruction->op == OP_SET_LOCAL) {
+            written[instruction->operands[0]] = true;
+        }
+        if ((instruction->op == OP_GET_LOCAL || instruction->op == OP_SET_LOCAL) && instruction->operands[0] == UINT8_MAX) {
+            return false;
+        }
+        if (instruction->op == OP_CLOSURE) {
+            for (int u = 0; u < upvalue_count(ir, instruction); u++) {
+                if (ir->bytes[instruction->upvalues + 2 * u] && ir->bytes[instruction->upvalues + 2 * u + 1] == UINT8_MAX) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    // only the header is sure to run on every trip, and nothing before the expression may fail or act
+    int best_start = -1, best_end = -1;
+    for (int i = start; i < cfg->block_start[header + 1]; i++) {
+        const uint8_t op = ir->instructions[i].op;
+        if (is_pure_operator(op)) {
+            const int s = expression_start(ir, start, i, false);
+            bool safe_before = s >= 0;
+            for (int j = start; safe_before && j < s; j++) {
+                safe_before = is_safe_load(ir->instructions[j].op);
+            }
+            if (safe_before && invariant_expression(ir, s, i, depth, written, captured) && i - s > best_end - best_start) {
+                best_start = s;
+                best_end = i;
+            }
+        } else if (!is_safe_load(op)) {
+            break;
+        }
+    }
+    if (best_start < 0) {
+        return false;
+    }
+
+    // every exit has to fall back to the loop's depth at the same instruction, with nothing else reaching it
+    bool *region = ALLOCATE(bool, ir->count);
+    memset(region, 0, sizeof(bool) * ir->count);
+    int exit = -1;
+    bool ok = true;
+    for (int i = 0; ok && i < ir->count; i++) {
+        if (!in_loop[cfg->block_of[i]]) {
+            continue;
+        }
+        int successors[2];
+        int successor_count = 0;
+        if (falls_through(ir->instructions[i].op)) {
+            successors[successor_count++] = i + 1;
+        }
+        if (ir->instructions[i].target >= 0) {
+            successors[successor_count++] = ir->instructions[i].target;
+        }
+        for (int s = 0; ok && s < successor_count; s++) {
+            int x = successors[s];
+            if (in_loop[cfg->block_of[x]]) {
+                continue;
+            }
+            while (ok && cfg->depth[x] > depth) {
+                ok = ir->instructions[x].op == OP_POP && !in_loop[cfg->block_of[x]] && x + 1 < ir->count;
+                region[x] = true;
+                x++;
+            }
+            ok = ok && cfg->depth[x] == depth && (exit == -1 || exit == x);
+            exit = x;
+        }
+    }
+    for (int i = 0; ok && exit != -1 && i < ir->count; i++) {
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        const bool from_loop = in_loop[cfg->block_of[i]] || region[i];
+        if (instruction->target >= 0 && (region[instruction->target] || instruction->target == exit)) {
+            ok = from_loop;
+        }
+        if (falls_through(instruction->op) && i + 1 < ir->count && (region[i + 1] || i + 1 == exit)) {
+            ok = ok && from_loop;
+        }
+    }
+    FREE_ARRAY(bool, region, ir->count);
+    if (!ok) {
+        return false;
+    }
+
+    const int length = best_end - best_start + 1;
+    ir_instruction_t *hoisted = ALLOCATE(ir_instruction_t, length);
+    memcpy(hoisted, &ir->instructions[best_start], sizeof(ir_instruction_t) * length);
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instruction_t *instruction = &ir->instructions[i];
+        if (!in_loop[cfg->block_of[i]]) {
+            continue;
+        }
+        if ((instruction->op == OP_GET_LOCAL || instruction->op == OP_SET_LOCAL) && instruction->operands[0] >= depth) {
+            instruction->operands[0]++;
+        } else if (instruction->op == OP_CLOSURE) {
+            for (int u = 0; u < upvalue_count(ir, instruction); u++) {
+                uint8_t *index = &ir->bytes[instruction->upvalues + 2 * u + 1];
+                if (ir->bytes[instruction->upvalues + 2 * u] && *index >= depth) {
+                    (*index)++;
+                }
+            }
+        }
+    }
+    ir->instructions[best_start].op = OP_GET_LOCAL;
+    ir->instructions[best_start].operands[0] = (uint8_t)depth;
+    for (int i = best_start + 1; i <= best_end; i++) {
+        ir->instructions[i].op = IR_REMOVED;
+    }
+
+    // insert further along first so the other index stays put
+    if (exit > start) {
+        ir_t_insert(ir, exit, 1);
+    }
+    ir_t_insert(ir, start, length);
+    memcpy(&ir->instructions[start], hoisted, sizeof(ir_instruction_t) * length);
+    FREE_ARRAY(ir_instruction_t, hoisted, length);
+    if (exit != -1) {
+        if (exit > start) {
+            exit += length;
+        } else {
+            ir_t_insert(ir, exit, 1);
+        }
+        ir->instructions[exit].op = OP_POP;
+        ir->instructions[exit].line = ir->instructions[exit + 1].line;
+        for (int i = 0; i < ir->count; i++) {
+            if (ir->instructions[i].target == exit + 1) {
+                ir->instructions[i].target = exit; // the exits now leave through the pop
+            }
+        }
+    }
+    ir_t_compact(ir);
+    return true;
+}
+
+static bool hoist_one(ir_t *ir)
+{
+    ir_cfg_t cfg;
+    if (!ir_cfg_t_init(&cfg, ir)) {
+        return false;
+    }
+
+    bool captured[UINT8_COUNT] = {false};
+    for (int i = 0; i < ir->count; i++) {
+        const ir_instruction_t *instruction = &ir->instructions[i];
+        if (instruction->op == OP_CLOSURE) {
+            for (int u = 0; u < upvalue_count(ir, instruction); u++) {
+                if (ir->bytes[instruction->upvalues + 2 * u]) {
+                    captured[ir->bytes[instruction->upvalues + 2 * u + 1]] = true;
+                }
+            }
+        }
+    }
+
+    bool *in_loop = ALLOCATE(bool, cfg.block_count);
+    int *work = ALLOCATE(int, cfg.block_count);
+    bool hoisted = false;
+    for (int header = 0; !hoisted && header < cfg.block_count; header++) {
+        if (cfg.idom[header] == -1) {
+            continue;
+        }
+        // the natural loop: the header and every block reaching one of its back edges without passing it
+        memset(in_loop, 0, sizeof(bool) * cfg.block_count);
+        in_loop[header] = true;
+        int work_count = 0;
+        for (int e = cfg.pred_start[header]; e < cfg.pred_start[header + 1]; e++) {
+            const int pred = cfg.preds[e];
+            if (cfg.idom[pred] != -1 && dominates(&cfg, header, pred) && !in_loop[pred]) {
+                in_loop[pred] = true;
+                work[work_count++] = pred;
+            }
+        }
+        if (work_count == 0 && !in_loop[header]) {
+            continue;
+        }
+        bool has_back_edge = work_count > 0;
+        for (int e = cfg.pred_start[header]; e < cfg.pred_start[header + 1]; e++) {
+            has_back_edge = has_back_edge || cfg.preds[e] == header;
+        }
+        if (!has_back_edge) {
+            continue;
+        }
+        while (work_count > 0) {
+            const int b = work[--work_count];
+            for (int e = cfg.pred_start[b]; e < cfg.pred_start[b + 1]; e++) {
+                const int pred = cfg.preds[e];
+                if (cfg.idom[pred] != -1 && !in_loop[pred]) {
+                    in_loop[pred] = true;
+                    work[work_count++] = pred;
+                }
+            }
+        }
+        hoisted = hoist_from_loop(ir, &cfg, header, in_loop, captured);
+    }
+    FREE_ARRAY(bool, in_loop, cfg.block_count);
+    FREE_ARRAY(int, work, cfg.block_count);
+    ir_cfg_t_free(&cfg, ir);
+    return hoisted;
+}
+
+/*
+ * Loop-invariant code motion: a pure expression in a loop header built only
+ * from constants and locals the loop never assigns (or lets a closure see)
+ * is evaluated once before the loop instead of on every trip.
+ */
+bool ir_t_hoist_loop_invariants(ir_t *ir)
+{
+    bool changed = false;
+    for (int i = 0; i < IR_MAX_HOISTS && hoist_one(ir); i++) {
+        changed = true;
+    }
+    return changed;
+}
+
+static const ir_pass_t ir_passes[] = {
+    {"copy propagation", ir_t_propagate_copies},
+    {"loop-invariant hoisting", ir_t_hoist_loop_invariants},
+    {"common subexpression elimination", ir_t_eliminate_common_subexpressions},
+    {"jump threading", ir_t_thread_jumps},
+};
+
+void ir_t_optimize(obj_function_t *function)
+{
+    ir_t ir;
+    if (ir_t_init(&ir, function)) {
+        bool changed = false;
+        for (int round = 0; round < IR_MAX_ROUNDS; round++) {
+            bool round_changed = false;
+            for (size_t p = 0; p < sizeof ir_passes / sizeof ir_passes[0]; p++) {
+                if (ir_passes[p].run(&ir)) {
+                    DEBUG_LOGGER("%s changed %s\n", ir_passes[p].name, function->name != NULL ? function->name->chars : "<main>");
+                    round_changed = true;
+                }
+            }
+            if (!round_changed) {
+                break;
+            }
+            changed = true;
+        }
+        if (changed) {
+            ir_t_lower(&ir, &function->chunk); // left as it was if a jump no longer fits
+        }
+    }
+    ir_t_free(&ir);
+}
+#undef IR_REMOVED
+#undef IR_MAX_ROUNDS
+#undef IR_MAX_HOISTS
@@ -0,0 +1,66 @@
+#ifndef tater_ir_h
+#define tater_ir_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdbool.h>
+#include "type.h"
+
+/*
+ * A stack IR for one function: its bytecode decoded into instructions whose
+ * jumps name the instruction they land on instead of a byte offset, so passes
+ * can insert and remove instructions freely before it is lowered back.
+ */
+typedef struct {
+    uint8_t op;
+    uint8_t operands[2];
+    int upvalues; // OP_CLOSURE is_local/index pairs, offset into ir_t.bytes
+    int target; // instruction index for jumps, -1 otherwise
+    int line;
+} ir_instruction_t;
+
+typedef struct {
+    ir_instruction_t *instructions;
+    int count;
+    int capacity;
+    uint8_t *bytes;
+    int byte_count;
+    int byte_capacity;
+    const chunk_t *chunk;
+    int entry_depth; // the callee and its parameters occupy the first slots
+} ir_t;
+
+typedef bool (*ir_pass_fn_t)(ir_t *ir);
+
+typedef struct {
+    const char *name;
+    ir_pass_fn_t run;
+} ir_pass_t;
+
+bool ir_t_init(ir_t *ir, const obj_function_t *function);
+void ir_t_free(ir_t *ir);
+bool ir_t_lower(const ir_t *ir, chunk_t *chunk);
+
+bool ir_t_propagate_copies(ir_t *ir);
+bool ir_t_eliminate_common_subexpressions(ir_t *ir);
+bool ir_t_hoist_loop_invariants(ir_t *ir);
+bool ir_t_thread_jumps(ir_t *ir);
+
+void ir_t_optimize(obj_function_t *function);
+
+#endif
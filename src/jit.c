@@ -0,0 +1,803 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "profile.h"
+#include "vm.h"
+#include "vmopcodes.h"
+
+// bytes in the instruction at offset, or -1 when the chunk is cut short
+int jit_t_instruction_length(const chunk_t *chunk, const int offset)
+{
+    switch (chunk->code[offset]) {
+        case OP_CONSTANT: case OP_POPN: case OP_GET_LOCAL: case OP_SET_LOCAL:
+        case OP_GET_GLOBAL: case OP_DEFINE_GLOBAL: case OP_SET_GLOBAL: case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE: case OP_GET_PROPERTY: case OP_SET_PROPERTY: case OP_GET_SUPER:
+        case OP_CALL: case OP_TAIL_CALL: case OP_TYPE: case OP_METHOD: case OP_FIELD:
+            return 2;
+        case OP_INVOKE: case OP_SUPER_INVOKE: case OP_JUMP: case OP_JUMP_IF_FALSE: case OP_LOOP:
+        case OP_ASSERT:
+            return 3;
+        case OP_CONSTANT_LONG: case OP_SWITCH_TABLE:
+            return 4;
+        case OP_CLOSURE:
+            return 2 + 2 * AS_FUNCTION(chunk->constants.values[chunk->code[offset + 1]])->upvalue_count;
+        case OP_WIDE: {
+            if (offset + 3 >= chunk->count) {
+                return -1;
+            }
+            const int index = (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+            switch (chunk->code[offset + 1]) {
+                case OP_INVOKE: case OP_SUPER_INVOKE: return 5;
+                case OP_CLOSURE: {
+                    int length = 4;
+                    for (int i = 0; i < AS_FUNCTION(chunk->constants.values[index])->upvalue_count; i++) {
+                        if (offset + length >= chunk->count) {
+                            return -1;
+                        }
+                        length += chunk->code[offset + length] & UPVALUE_WIDE ? 3 : 2;
+                    }
+                    return length;
+                }
+                default: return 4;
+            }
+        }
+        default:
+            return 1;
+    }
+}
+
+// the interpreter returns into a frame right after the call it made
+bool jit_t_is_call(const chunk_t *chunk, const int offset)
+{
+    const uint8_t op = chunk->code[offset] == OP_WIDE ? chunk->code[offset + 1] : chunk->code[offset];
+    return op == OP_CALL || op == OP_INVOKE || op == OP_SUPER_INVOKE;
+}
+
+void jit_t_free(obj_function_t *function)
+{
+    jit_t *jit = function->jit;
+    if (jit == NULL) {
+        return;
+    }
+    if (jit->code != NULL) { // ahead-of-time code is part of the executable
+        munmap(jit->code, jit->size);
+    }
+    free(jit->entries);
+    free(jit);
+    function->jit = NULL;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Baseline x86-64 templates: every supported instruction becomes a fixed
+ * sequence working on the VM stack in memory, with the stack top cached in
+ * rbx, the frame slots in r12 and the closure in r13. Type checks that fail
+ * jump to a stub returning the ip of the instruction so the interpreter can
+ * run it (and raise any error) instead.
+ */
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R12 = 12, R13 = 13 };
+enum { XMM0 = 0, XMM1 = 1 };
+enum { JCC_E = 0x84, JCC_NE = 0x85, JCC_P = 0x8a };
+
+#define VALUE_SIZE ((int32_t)sizeof(value_t))
+#define PAYLOAD ((int32_t)offsetof(value_t, as))
+
+// helpers run what is too big to inline, returning false to leave the instruction to the interpreter
+typedef bool (*jit_helper_t)(value_t *top, const void *operand);
+
+typedef struct {
+    int at; // rel32 to patch
+    int target; // bytecode offset
+    bool deopt; // jump to a stub resuming the interpreter at target instead of the native code for it
+} jit_fixup_t;
+
+typedef struct {
+    uint8_t *bytes;
+    int count;
+    int capacity;
+    jit_fixup_t *fixups;
+    int fixup_count;
+    int fixup_capacity;
+    int exit; // shared epilogue, expects the resume ip in rax
+    const chunk_t *chunk;
+} jit_compiler_t;
+
+static void emit8(jit_compiler_t *j, const uint8_t byte)
+{
+    if (j->count == j->capacity) {
+        j->capacity = j->capacity < 256 ? 256 : j->capacity * 2;
+        j->bytes = realloc(j->bytes, j->capacity);
+        if (j->bytes == NULL) {
+            fprintf(stderr, "Failed to allocate JIT buffer.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    j->bytes[j->count++] = byte;
+}
+
+static void emit_bytes(jit_compiler_t *j, const int count, const uint8_t *bytes)
+{
+    for (int i = 0; i < count; i++) {
+        emit8(j, bytes[i]);
+    }
+}
+
+#define EMIT(...) emit_bytes(j, sizeof((const uint8_t[]){__VA_ARGS__}), (const uint8_t[]){__VA_ARGS__})
+
+static void emit32(jit_compiler_t *j, const uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        emit8(j, (value >> (8 * i)) & 0xff);
+    }
+}
+
+static void emit64(jit_compiler_t *j, const uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        emit8(j, (value >> (8 * i)) & 0xff);
+    }
+}
+
+// prefix [REX] opcode modrm [sib] disp32 for reg, [base + disp]
+static void emit_mem(jit_compiler_t *j, const uint8_t prefix, const bool wide, const int opcode, const int reg, const int base, const int32_t disp)
+{
+    if (prefix) {
+        emit8(j, prefix);
+    }
+    const uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+    if (rex != 0x40) {
+        emit8(j, rex);
+    }
+    if (opcode > 0xff) {
+        emit8(j, (opcode >> 8) & 0xff);
+    }
+    emit8(j, opcode & 0xff);
+    emit8(j, 0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) {
+        emit8(j, 0x24);
+    }
+    emit32(j, (uint32_t)disp);
+}
+
+static void emit_movabs(jit_compiler_t *j, const int reg, const uintptr_t value)
+{
+    EMIT(0x48, 0xb8 + reg);
+    emit64(j, (uint64_t)value);
+}
+
+static void emit_stack_adjust(jit_compiler_t *j, const int values)
+{
+    if (values > 0) {
+        EMIT(0x48, 0x81, 0xc3); // add rbx, imm32
+        emit32(j, (uint32_t)(values * VALUE_SIZE));
+    } else if (values < 0) {
+        EMIT(0x48, 0x81, 0xeb); // sub rbx, imm32
+        emit32(j, (uint32_t)(-values * VALUE_SIZE));
+    }
+}
+
+static void add_fixup(jit_compiler_t *j, const int target, const bool deopt)
+{
+    if (j->fixup_count == j->fixup_capacity) {
+        j->fixup_capacity = j->fixup_capacity < 16 ? 16 : j->fixup_capacity * 2;
+        j->fixups = realloc(j->fixups, sizeof(jit_fixup_t) * j->fixup_capacity);
+        if (j->fixups == NULL) {
+            fprintf(stderr, "Failed to allocate JIT buffer.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    j->fixups[j->fixup_count++] = (jit_fixup_t){.at = j->count, .target = target, .deopt = deopt};
+    emit32(j, 0);
+}
+
+static void emit_jump_to(jit_compiler_t *j, const int target)
+{
+    emit8(j, 0xe9);
+    add_fixup(j, target, false);
+}
+
+static void emit_jcc_to(jit_compiler_t *j, const uint8_t condition, const int target, const bool deopt)
+{
+    EMIT(0x0f, condition);
+    add_fixup(j, target, deopt);
+}
+
+// a forward jump within one template, patched once the label is reached
+static int emit_jcc_forward(jit_compiler_t *j, const uint8_t condition)
+{
+    EMIT(0x0f, condition);
+    emit32(j, 0);
+    return j->count - 4;
+}
+
+static void patch_forward(jit_compiler_t *j, const int at)
+{
+    const uint32_t rel = (uint32_t)(j->count - (at + 4));
+    memcpy(j->bytes + at, &rel, sizeof rel);
+}
+
+static void emit_exit(jit_compiler_t *j, const int offset)
+{
+    emit_movabs(j, RAX, (uintptr_t)(j->chunk->code + offset));
+    emit8(j, 0xe9);
+    const uint32_t rel = (uint32_t)(j->exit - (j->count + 4));
+    emit32(j, rel);
+}
+
+static void emit_check_number(jit_compiler_t *j, const int32_t disp, const int offset)
+{
+    emit_mem(j, 0, false, 0x83, 7, RBX, disp); // cmp dword [rbx + disp], VAL_NUMBER
+    emit8(j, VAL_NUMBER);
+    emit_jcc_to(j, JCC_NE, offset, true);
+}
+
+static void emit_sync_stack_top(jit_compiler_t *j)
+{
+    emit_movabs(j, RCX, (uintptr_t)&vm.stack_top);
+    EMIT(0x48, 0x89, 0x19); // mov [rcx], rbx
+}
+
+// helper(rbx, operand), deoptimizing when it returns false
+static void emit_helper(jit_compiler_t *j, const jit_helper_t helper, const void *operand, const int offset)
+{
+    emit_sync_stack_top(j); // helpers can allocate, so the collector must see the whole stack
+    EMIT(0x48, 0x89, 0xdf); // mov rdi, rbx
+    emit_movabs(j, RSI, (uintptr_t)operand);
+    emit_movabs(j, RAX, (uintptr_t)helper);
+    EMIT(0xff, 0xd0); // call rax
+    EMIT(0x84, 0xc0); // test al, al
+    emit_jcc_to(j, JCC_E, offset, true);
+}
+
+static void emit_push_from(jit_compiler_t *j, const int base, const int32_t disp)
+{
+    emit_mem(j, 0, false, 0x0f10, XMM0, base, disp); // movups xmm0, [base + disp]
+    emit_mem(j, 0, false, 0x0f11, XMM0, RBX, 0); // movups [rbx], xmm0
+    emit_stack_adjust(j, 1);
+}
+
+static void emit_push_immediate(jit_compiler_t *j, const value_type_t type, const uint32_t payload)
+{
+    emit_mem(j, 0, true, 0xc7, 0, RBX, 0); // mov qword [rbx], type
+    emit32(j, type);
+    emit_mem(j, 0, true, 0xc7, 0, RBX, PAYLOAD); // mov qword [rbx + 8], payload
+    emit32(j, payload);
+    emit_stack_adjust(j, 1);
+}
+
+// replace the two operands with the bool in al
+static void emit_bool_result(jit_compiler_t *j)
+{
+    EMIT(0x0f, 0xb6, 0xc0); // movzx eax, al
+    emit_mem(j, 0, true, 0xc7, 0, RBX, -2 * VALUE_SIZE); // mov qword [rbx - 32], VAL_BOOL
+    emit32(j, VAL_BOOL);
+    emit_mem(j, 0, true, 0x89, RAX, RBX, -2 * VALUE_SIZE + PAYLOAD); // mov [rbx - 24], rax
+    emit_stack_adjust(j, -1);
+}
+
+static bool jit_get_global(value_t *top, const void *operand)
+{
+    const obj_string_t *name = operand;
+    return table_t_get(&vm.globals, OBJ_VAL(name), top);
+}
+
+static bool jit_set_global(value_t *top, const void *operand)
+{
+    const obj_string_t *name = operand;
+    value_t existing;
+    if (!table_t_get(&vm.globals, OBJ_VAL(name), &existing)) {
+        return false;
+    }
+    table_t_set(&vm.globals, OBJ_VAL(name), top[-1]);
+    return true;
+}
+
+static bool jit_get_field(value_t *top, const void *operand)
+{
+    const obj_string_t *name = operand;
+    if (!IS_INSTANCE(top[-1])) {
+        return false;
+    }
+    value_t value;
+    if (!table_t_get(&AS_INSTANCE(top[-1])->fields, OBJ_VAL(name), &value)) {
+        return false; // methods are bound by the interpreter
+    }
+    top[-1] = value;
+    return true;
+}
+
+static bool jit_set_field(value_t *top, const void *operand)
+{
+    const obj_string_t *name = operand;
+    if (!IS_INSTANCE(top[-2])) {
+        return false;
+    }
+    table_t_set(&AS_INSTANCE(top[-2])->fields, OBJ_VAL(name), top[-1]);
+    top[-2] = top[-1];
+    return true;
+}
+
+static bool jit_equal(value_t *top, const void *)
+{
+    top[-2] = BOOL_VAL(value_t_equal(top[-2], top[-1]));
+    return true;
+}
+
+static bool jit_not(value_t *top, const void *)
+{
+    const value_t v = top[-1];
+    top[-1] = BOOL_VAL(IS_NIL(v) || (IS_BOOL(v) && !AS_BOOL(v)) || (IS_NUMBER(v) && fabs(AS_NUMBER(v)) == 0));
+    return true;
+}
+
+static bool jit_print(value_t *top, const void *)
+{
+    value_t_print(stdout, top[-1]);
+    printf("\n");
+    return true;
+}
+
+// returns false for instructions left to the interpreter
+static bool emit_instruction(jit_compiler_t *j, const int offset, const int next)
+{
+    const chunk_t *chunk = j->chunk;
+    const uint8_t *code = chunk->code;
+    const uint8_t op = code[offset];
+    switch (op) {
+        case OP_CONSTANT:
+            emit_movabs(j, RAX, (uintptr_t)&chunk->constants.values[code[offset + 1]]);
+            emit_push_from(j, RAX, 0);
+            return true;
+        case OP_CONSTANT_LONG:
+            emit_movabs(j, RAX, (uintptr_t)&chunk->constants.values[code[offset + 1] | (code[offset + 2] << 8) | (code[offset + 3] << 16)]);
+            emit_push_from(j, RAX, 0);
+            return true;
+        case OP_NIL: emit_push_immediate(j, VAL_NIL, 0); return true;
+        case OP_TRUE: emit_push_immediate(j, VAL_BOOL, 1); return true;
+        case OP_FALSE: emit_push_immediate(j, VAL_BOOL, 0); return true;
+        case OP_POP: emit_stack_adjust(j, -1); return true;
+        case OP_POPN: emit_stack_adjust(j, -code[offset + 1]); return true;
+        case OP_DUP: emit_push_from(j, RBX, -VALUE_SIZE); return true;
+        case OP_GET_LOCAL: emit_push_from(j, R12, code[offset + 1] * VALUE_SIZE); return true;
+        case OP_SET_LOCAL:
+            emit_mem(j, 0, false, 0x0f10, XMM0, RBX, -VALUE_SIZE);
+            emit_mem(j, 0, false, 0x0f11, XMM0, R12, code[offset + 1] * VALUE_SIZE);
+            return true;
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE:
+            emit_mem(j, 0, true, 0x8b, RAX, R13, (int32_t)offsetof(obj_closure_t, upvalues)); // mov rax, closure->upvalues
+            emit_mem(j, 0, true, 0x8b, RAX, RAX, code[offset + 1] * (int32_t)sizeof(obj_upvalue_t*));
+            emit_mem(j, 0, true, 0x8b, RAX, RAX, (int32_t)offsetof(obj_upvalue_t, location));
+            if (op == OP_GET_UPVALUE) {
+                emit_push_from(j, RAX, 0);
+            } else {
+                emit_mem(j, 0, false, 0x0f10, XMM0, RBX, -VALUE_SIZE);
+                emit_mem(j, 0, false, 0x0f11, XMM0, RAX, 0);
+            }
+            return true;
+        case OP_GET_GLOBAL:
+            emit_helper(j, jit_get_global, AS_OBJ(chunk->constants.values[code[offset + 1]]), offset);
+            emit_stack_adjust(j, 1);
+            return true;
+        case OP_SET_GLOBAL:
+            emit_helper(j, jit_set_global, AS_OBJ(chunk->constants.values[code[offset + 1]]), offset);
+            return true;
+        case OP_GET_PROPERTY:
+            emit_helper(j, jit_get_field, AS_OBJ(chunk->constants.values[code[offset + 1]]), offset);
+            return true;
+        case OP_SET_PROPERTY:
+            emit_helper(j, jit_set_field, AS_OBJ(chunk->constants.values[code[offset + 1]]), offset);
+            emit_stack_adjust(j, -1);
+            return true;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE: {
+            emit_check_number(j, -VALUE_SIZE, offset);
+            emit_check_number(j, -2 * VALUE_SIZE, offset);
+            if (op == OP_DIVIDE) { // the interpreter reports the divide by zero
+                EMIT(0x66, 0x0f, 0x57, 0xc9); // xorpd xmm1, xmm1
+                emit_mem(j, 0x66, false, 0x0f2e, XMM1, RBX, -VALUE_SIZE + PAYLOAD); // ucomisd xmm1, b
+                emit_jcc_to(j, JCC_E, offset, true);
+            }
+            const int arithmetic = op == OP_ADD ? 0x0f58 : op == OP_SUBTRACT ? 0x0f5c : op == OP_MULTIPLY ? 0x0f59 : 0x0f5e;
+            emit_mem(j, 0xf2, false, 0x0f10, XMM0, RBX, -2 * VALUE_SIZE + PAYLOAD); // movsd xmm0, a
+            emit_mem(j, 0xf2, false, arithmetic, XMM0, RBX, -VALUE_SIZE + PAYLOAD); // op xmm0, b
+            emit_mem(j, 0xf2, false, 0x0f11, XMM0, RBX, -2 * VALUE_SIZE + PAYLOAD); // movsd a, xmm0
+            emit_stack_adjust(j, -1);
+            return true;
+        }
+        case OP_LESS:
+        case OP_GREATER: {
+            emit_check_number(j, -VALUE_SIZE, offset);
+            emit_check_number(j, -2 * VALUE_SIZE, offset);
+            // a < b is b > a, and seta is false when either side is NaN
+            const int32_t left = op == OP_GREATER ? -2 * VALUE_SIZE : -VALUE_SIZE;
+            const int32_t right = op == OP_GREATER ? -VALUE_SIZE : -2 * VALUE_SIZE;
+            emit_mem(j, 0xf2, false, 0x0f10, XMM0, RBX, left + PAYLOAD);
+            emit_mem(j, 0x66, false, 0x0f2e, XMM0, RBX, right + PAYLOAD);
+            EMIT(0x0f, 0x97, 0xc0); // seta al
+            emit_bool_result(j);
+            return true;
+        }
+        case OP_EQUAL: {
+            emit_mem(j, 0, false, 0x83, 7, RBX, -VALUE_SIZE);
+            emit8(j, VAL_NUMBER);
+            const int not_numbers = emit_jcc_forward(j, JCC_NE);
+            emit_mem(j, 0, false, 0x83, 7, RBX, -2 * VALUE_SIZE);
+            emit8(j, VAL_NUMBER);
+            const int not_numbers_either = emit_jcc_forward(j, JCC_NE);
+            emit_mem(j, 0xf2, false, 0x0f10, XMM0, RBX, -2 * VALUE_SIZE + PAYLOAD);
+            emit_mem(j, 0x66, false, 0x0f2e, XMM0, RBX, -VALUE_SIZE + PAYLOAD);
+            EMIT(0x0f, 0x94, 0xc0); // sete al
+            EMIT(0x0f, 0x9b, 0xc1); // setnp cl
+            EMIT(0x20, 0xc8); // and al, cl
+            emit_bool_result(j);
+            EMIT(0xe9);
+            emit32(j, 0);
+            const int done = j->count - 4;
+            patch_forward(j, not_numbers);
+            patch_forward(j, not_numbers_either);
+            emit_helper(j, jit_equal, NULL, offset);
+            emit_stack_adjust(j, -1);
+            patch_forward(j, done);
+            return true;
+        }
+        case OP_NOT:
+            emit_helper(j, jit_not, NULL, offset);
+            return true;
+        case OP_NEGATE:
+            emit_check_number(j, -VALUE_SIZE, offset);
+            emit_mem(j, 0, true, 0x0fba, 7, RBX, -VALUE_SIZE + PAYLOAD); // btc qword [rbx - 8], 63
+            emit8(j, 63);
+            return true;
+        case OP_PRINT:
+            emit_helper(j, jit_print, NULL, offset);
+            emit_stack_adjust(j, -1);
+            return true;
+        case OP_JUMP:
+            emit_jump_to(j, next + ((code[offset + 1] << 8) | code[offset + 2]));
+            return true;
+        case OP_LOOP:
+            emit_jump_to(j, next - ((code[offset + 1] << 8) | code[offset + 2]));
+            return true;
+        case OP_JUMP_IF_FALSE: {
+            const int target = next + ((code[offset + 1] << 8) | code[offset + 2]);
+            emit_mem(j, 0, false, 0x8b, RAX, RBX, -VALUE_SIZE); // mov eax, type
+            EMIT(0x83, 0xf8, VAL_BOOL); // cmp eax, VAL_BOOL
+            const int not_bool = emit_jcc_forward(j, JCC_NE);
+            emit_mem(j, 0, false, 0x80, 7, RBX, -VALUE_SIZE + PAYLOAD); // cmp byte [rbx - 8], 0
+            emit8(j, 0);
+            emit_jcc_to(j, JCC_E, target, false);
+            EMIT(0xe9);
+            emit32(j, 0);
+            const int done = j->count - 4;
+            patch_forward(j, not_bool);
+            EMIT(0x83, 0xf8, VAL_NIL);
+            emit_jcc_to(j, JCC_E, target, false);
+            EMIT(0x83, 0xf8, VAL_NUMBER);
+            const int not_number = emit_jcc_forward(j, JCC_NE);
+            EMIT(0x66, 0x0f, 0x57, 0xc9); // xorpd xmm1, xmm1
+            emit_mem(j, 0x66, false, 0x0f2e, XMM1, RBX, -VALUE_SIZE + PAYLOAD); // 0 == v, NaN is truthy
+            const int unordered = emit_jcc_forward(j, JCC_P);
+            emit_jcc_to(j, JCC_E, target, false);
+            patch_forward(j, done);
+            patch_forward(j, not_number);
+            patch_forward(j, unordered);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static uint8_t *map_code(const size_t size)
+{
+    uint8_t *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        fprintf(stderr, "Failed to allocate JIT buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+    return code;
+}
+
+// make the finished code executable and attach it, with native[offset] for each offset entry[] allows
+static bool install(obj_function_t *function, uint8_t *code, const size_t size, const int *native, const bool *entry, const jit_fn_t run)
+{
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        return false;
+    }
+    jit_t *jit = malloc(sizeof(jit_t));
+    const void **entries = calloc(function->chunk.count, sizeof(void*));
+    if (jit == NULL || entries == NULL) {
+        fprintf(stderr, "Failed to allocate JIT buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int offset = 0; offset < function->chunk.count; offset++) {
+        if (entry[offset]) {
+            entries[offset] = code + native[offset];
+        }
+    }
+    jit->code = code;
+    jit->size = size;
+    jit->entries = entries;
+    jit->run = run;
+    function->jit = jit;
+    profile_t_perf_map_add(code, size, function);
+    return true;
+}
+
+static bool compile_templates(obj_function_t *function)
+{
+    const chunk_t *chunk = &function->chunk;
+
+    jit_compiler_t compiler = {.chunk = chunk};
+    jit_compiler_t *j = &compiler;
+    int *native = malloc(sizeof(int) * (chunk->count + 1));
+    bool *entry = calloc(chunk->count + 1, sizeof(bool));
+    if (native == NULL || entry == NULL) {
+        fprintf(stderr, "Failed to allocate JIT buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the interpreter comes back in at the start, at loop headers and after calls
+    entry[0] = true;
+    for (int offset = 0; offset < chunk->count;) {
+        const int length = jit_t_instruction_length(chunk, offset);
+        if (length < 0 || offset + length > chunk->count) {
+            free(native);
+            free(entry);
+            return false;
+        }
+        if (chunk->code[offset] == OP_LOOP) {
+            entry[offset + length - ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2])] = true;
+        } else if (jit_t_is_call(chunk, offset)) {
+            entry[offset + length] = true;
+        }
+        native[offset] = -1;
+        offset += length;
+    }
+
+    EMIT(0xf3, 0x0f, 0x1e, 0xfa); // endbr64
+    EMIT(0x55, 0x48, 0x89, 0xe5, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56); // push rbp; mov rbp, rsp; push rbx, r12-r14
+    EMIT(0x49, 0x89, 0xfc, 0x49, 0x89, 0xf5); // mov r12, rdi; mov r13, rsi
+    emit_movabs(j, RAX, (uintptr_t)&vm.stack_top);
+    EMIT(0x48, 0x8b, 0x18); // mov rbx, [rax]
+    EMIT(0xff, 0xe2); // jmp rdx
+    j->exit = j->count;
+    emit_sync_stack_top(j);
+    EMIT(0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0x5d, 0xc3); // pop r14-r12, rbx, rbp; ret
+
+    for (int offset = 0; offset < chunk->count;) {
+        const int next = offset + jit_t_instruction_length(chunk, offset);
+        native[offset] = j->count;
+        if (entry[offset]) {
+            EMIT(0xf3, 0x0f, 0x1e, 0xfa); // endbr64, entered by the indirect jump in the prologue
+        }
+        if (!emit_instruction(j, offset, next)) {
+            emit_exit(j, offset);
+        }
+        offset = next;
+    }
+    native[chunk->count] = j->count;
+    emit_exit(j, chunk->count - 1); // unreachable, the last instruction is a return
+
+    for (int i = 0; i < j->fixup_count; i++) {
+        const jit_fixup_t *fixup = &j->fixups[i];
+        int to = native[fixup->target];
+        if (fixup->deopt) {
+            to = j->count;
+            emit_exit(j, fixup->target);
+        }
+        const uint32_t rel = (uint32_t)(to - (fixup->at + 4));
+        memcpy(j->bytes + fixup->at, &rel, sizeof rel);
+    }
+
+    uint8_t *code = map_code(j->count);
+    memcpy(code, j->bytes, j->count);
+    # pragma GCC diagnostic push
+    # pragma GCC diagnostic ignored "-Wpedantic"
+    const bool installed = install(function, code, j->count, native, entry, (jit_fn_t)code);
+    # pragma GCC diagnostic pop
+
+    free(native);
+    free(entry);
+    free(j->bytes);
+    free(j->fixups);
+    return installed;
+}
+
+/*
+ * Copy-and-patch backend: the code for each instruction is a stencil from
+ * jit_stencils.h, machine code the C compiler produced for jit_stencils.c,
+ * copied in order with its holes patched. Stencils hand the stack top to each
+ * other in registers and keep the rest of the stack in memory.
+ */
+
+typedef enum {
+    JIT_HOLE_NONE,
+    JIT_HOLE_CONTINUE, // the next instruction
+    JIT_HOLE_TARGET, // where a jump goes
+    JIT_HOLE_RESUME, // the ip the interpreter continues from
+    JIT_HOLE_OPERAND, // the decoded operand
+    JIT_HOLE_SYMBOL, // a runtime function or variable
+} jit_hole_kind_t;
+
+typedef struct {
+    size_t offset;
+    jit_hole_kind_t kind;
+    const char *symbol;
+    int64_t addend;
+} jit_hole_t;
+
+typedef struct {
+    size_t size;
+    const uint8_t *code;
+    const jit_hole_t *holes;
+    int hole_count;
+} jit_stencil_t;
+
+enum { JIT_STENCIL_exit = UINT8_COUNT }; // stencils not tied to an opcode follow them
+
+#include "jit_stencils.h"
+
+typedef uint8_t *(*stencil_fn_t)(value_t *slots, obj_closure_t *closure, value_t *top);
+
+static uint8_t *stencil_enter(value_t *slots, obj_closure_t *closure, const void *target)
+{
+    # pragma GCC diagnostic push
+    # pragma GCC diagnostic ignored "-Wpedantic"
+    return ((stencil_fn_t)target)(slots, closure, vm.stack_top);
+    # pragma GCC diagnostic pop
+}
+
+static uintptr_t stencil_symbol(const char *name)
+{
+    const struct {
+        const char *name;
+        uintptr_t address;
+    } symbols[] = {
+        {"vm", (uintptr_t)&vm},
+        {"stdout", (uintptr_t)&stdout},
+        {"putc", (uintptr_t)putc},
+        {"table_t_get", (uintptr_t)table_t_get},
+        {"table_t_set", (uintptr_t)table_t_set},
+        {"value_t_equal", (uintptr_t)value_t_equal},
+        {"value_t_print", (uintptr_t)value_t_print},
+    };
+    for (size_t i = 0; i < sizeof symbols / sizeof symbols[0]; i++) {
+        if (strcmp(symbols[i].name, name) == 0) {
+            return symbols[i].address;
+        }
+    }
+    return 0;
+}
+
+static const jit_stencil_t *stencil_for(const chunk_t *chunk, const int offset)
+{
+    const jit_stencil_t *stencil = &jit_stencils[chunk->code[offset]];
+    return stencil->code != NULL ? stencil : &jit_stencils[JIT_STENCIL_exit];
+}
+
+static uintptr_t stencil_operand(const chunk_t *chunk, const int offset)
+{
+    const uint8_t *code = chunk->code + offset;
+    switch (code[0]) {
+        case OP_CONSTANT: return (uintptr_t)&chunk->constants.values[code[1]];
+        case OP_CONSTANT_LONG: return (uintptr_t)&chunk->constants.values[code[1] | (code[2] << 8) | (code[3] << 16)];
+        case OP_GET_GLOBAL: case OP_SET_GLOBAL: case OP_GET_PROPERTY: case OP_SET_PROPERTY:
+            return (uintptr_t)AS_OBJ(chunk->constants.values[code[1]]);
+        default: return code[1];
+    }
+}
+
+static int stencil_target(const chunk_t *chunk, const int offset, const int next)
+{
+    const int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    return chunk->code[offset] == OP_LOOP ? next - jump : next + jump;
+}
+
+static bool compile_stencils(obj_function_t *function)
+{
+    const chunk_t *chunk = &function->chunk;
+    int *native = malloc(sizeof(int) * (chunk->count + 1));
+    bool *entry = calloc(chunk->count + 1, sizeof(bool));
+    if (native == NULL || entry == NULL) {
+        fprintf(stderr, "Failed to allocate JIT buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // every stencil starts with endbr64, so each instruction can be entered
+    size_t size = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        const int length = jit_t_instruction_length(chunk, offset);
+        if (length < 0 || offset + length > chunk->count) {
+            free(native);
+            free(entry);
+            return false;
+        }
+        native[offset] = size;
+        entry[offset] = true;
+        size += stencil_for(chunk, offset)->size;
+        offset += length;
+    }
+    native[chunk->count] = size; // unreachable, the last instruction is a return
+    size += jit_stencils[JIT_STENCIL_exit].size;
+
+    uint8_t *code = map_code(size);
+    bool ok = true;
+    for (int offset = 0; ok && offset <= chunk->count;) {
+        const int next = offset < chunk->count ? offset + jit_t_instruction_length(chunk, offset) : offset;
+        const jit_stencil_t *stencil = offset < chunk->count ? stencil_for(chunk, offset) : &jit_stencils[JIT_STENCIL_exit];
+        uint8_t *at = code + native[offset];
+        memcpy(at, stencil->code, stencil->size);
+        for (int i = 0; ok && i < stencil->hole_count; i++) {
+            const jit_hole_t *hole = &stencil->holes[i];
+            uintptr_t value = 0;
+            switch (hole->kind) {
+                case JIT_HOLE_CONTINUE: value = (uintptr_t)(code + native[next]); break;
+                case JIT_HOLE_TARGET: value = (uintptr_t)(code + native[stencil_target(chunk, offset, next)]); break;
+                case JIT_HOLE_RESUME: value = (uintptr_t)(chunk->code + (offset < chunk->count ? offset : chunk->count - 1)); break;
+                case JIT_HOLE_OPERAND: value = stencil_operand(chunk, offset); break;
+                case JIT_HOLE_SYMBOL: ok = (value = stencil_symbol(hole->symbol)) != 0; break;
+                case JIT_HOLE_NONE:
+                default: break;
+            }
+            value += hole->addend;
+            memcpy(at + hole->offset, &value, sizeof value);
+        }
+        offset = offset < chunk->count ? next : offset + 1;
+    }
+
+    const bool installed = ok && install(function, code, size, native, entry, stencil_enter);
+    if (!ok) {
+        munmap(code, size);
+    }
+    free(native);
+    free(entry);
+    return installed;
+}
+
+bool jit_t_compile(obj_function_t *function, const jit_backend_t backend)
+{
+    if (function->jit != NULL || function->chunk.count == 0) {
+        return function->jit != NULL;
+    }
+    return backend == JIT_STENCILS ? compile_stencils(function) : compile_templates(function);
+}
+
+#undef EMIT
+#undef VALUE_SIZE
+#undef PAYLOAD
+
+#else
+
+bool jit_t_compile(obj_function_t *, const jit_backend_t)
+{
+    return false; // no code generator for this architecture, the interpreter runs everything
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef tater_jit_h
+#define tater_jit_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdbool.h>
+#include "type.h"
+
+#define JIT_THRESHOLD 1000 // calls plus loop iterations before a function is compiled
+
+/*
+ * Native code for one function. It runs on the VM value stack exactly like the
+ * interpreter would and returns the ip of the first instruction it does not
+ * handle, so the interpreter picks up from there: calls, returns and anything
+ * whose operands are not the types the templates expect all go back to run().
+ */
+typedef uint8_t *(*jit_fn_t)(value_t *slots, obj_closure_t *closure, const void *target);
+
+typedef struct jit {
+    jit_fn_t run;
+    uint8_t *code;
+    size_t size;
+    const void **entries; // native address for each bytecode offset it can be entered at, NULL elsewhere
+} jit_t;
+
+typedef enum {
+    JIT_TEMPLATES, // hand written x86-64 templates, jit.c
+    JIT_STENCILS, // copy-and-patch from the compiled stencils in jit_stencils.c
+} jit_backend_t;
+
+bool jit_t_compile(obj_function_t *function, const jit_backend_t backend);
+void jit_t_free(obj_function_t *function);
+// bytecode walking shared with the ahead-of-time compiler
+int jit_t_instruction_length(const chunk_t *chunk, const int offset);
+bool jit_t_is_call(const chunk_t *chunk, const int offset);
+
+#endif
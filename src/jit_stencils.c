@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copy-and-patch stencils: one small function per opcode, compiled on its own
+ * (see jit_stencils_gen.c) and never linked into tater. The machine code and
+ * the relocations against the JIT_* symbols below end up in jit_stencils.h,
+ * and the JIT copies the bytes for each instruction and patches those holes.
+ *
+ * Every stencil takes the frame slots, the closure and the stack top and
+ * either tail calls the next instruction through JIT_CONTINUE (or JIT_TARGET
+ * for a jump), or stores the stack top and returns the ip the interpreter
+ * resumes from: this instruction when it is not handled here.
+ */
+
+#include <string.h>
+#include "vm.h"
+
+extern uint8_t *JIT_CONTINUE(value_t *slots, obj_closure_t *closure, value_t *top);
+extern uint8_t *JIT_TARGET(value_t *slots, obj_closure_t *closure, value_t *top);
+extern uint8_t JIT_RESUME[];
+extern value_t JIT_OPERAND[];
+
+#define STENCIL(name) \
+    uint8_t *stencil_##name(value_t *slots, obj_closure_t *closure, value_t *top); \
+    uint8_t *stencil_##name(value_t *slots __unused__, obj_closure_t *closure __unused__, value_t *top)
+#define OPERAND ((uintptr_t)JIT_OPERAND)
+#define CONTINUE(new_top) return JIT_CONTINUE(slots, closure, (new_top))
+#define JUMP(new_top) return JIT_TARGET(slots, closure, (new_top))
+#define EXIT(new_top) do { vm.stack_top = (new_top); return JIT_RESUME; } while (false)
+#define NUMBERS() do { if (!IS_NUMBER(top[-1]) || !IS_NUMBER(top[-2])) EXIT(top); } while (false)
+
+// no fabs, a constant pool would be a relocation the JIT cannot patch
+#define FALSEY(value) (IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value)) || (IS_NUMBER(value) && AS_NUMBER(value) == 0))
+
+STENCIL(exit) { EXIT(top); }
+
+STENCIL(OP_CONSTANT) { *top = *JIT_OPERAND; CONTINUE(top + 1); }
+STENCIL(OP_CONSTANT_LONG) { *top = *JIT_OPERAND; CONTINUE(top + 1); }
+// stored a field at a time, a whole value_t literal is loaded from a constant pool
+STENCIL(OP_NIL) { top->type = VAL_NIL; top->as.obj = NULL; CONTINUE(top + 1); }
+STENCIL(OP_TRUE) { top->type = VAL_BOOL; top->as.obj = NULL; top->as.boolean = true; CONTINUE(top + 1); }
+STENCIL(OP_FALSE) { top->type = VAL_BOOL; top->as.obj = NULL; CONTINUE(top + 1); }
+STENCIL(OP_POP) { CONTINUE(top - 1); }
+STENCIL(OP_POPN) { CONTINUE(top - OPERAND); }
+STENCIL(OP_DUP) { *top = top[-1]; CONTINUE(top + 1); }
+STENCIL(OP_GET_LOCAL) { *top = slots[OPERAND]; CONTINUE(top + 1); }
+STENCIL(OP_SET_LOCAL) { slots[OPERAND] = top[-1]; CONTINUE(top); }
+STENCIL(OP_GET_UPVALUE) { *top = *closure->upvalues[OPERAND]->location; CONTINUE(top + 1); }
+STENCIL(OP_SET_UPVALUE) { *closure->upvalues[OPERAND]->location = top[-1]; CONTINUE(top); }
+
+STENCIL(OP_GET_GLOBAL)
+{
+    if (!table_t_get(&vm.globals, OBJ_VAL(JIT_OPERAND), top)) {
+        EXIT(top);
+    }
+    CONTINUE(top + 1);
+}
+
+STENCIL(OP_SET_GLOBAL)
+{
+    // the free slot at top holds the old value, a local would keep the tail call from being a jump
+    if (!table_t_get(&vm.globals, OBJ_VAL(JIT_OPERAND), top)) {
+        EXIT(top);
+    }
+    vm.stack_top = top; // the table can grow and collect
+    table_t_set(&vm.globals, OBJ_VAL(JIT_OPERAND), top[-1]);
+    CONTINUE(top);
+}
+
+STENCIL(OP_GET_PROPERTY)
+{
+    if (!IS_INSTANCE(top[-1]) || !table_t_get(&AS_INSTANCE(top[-1])->fields, OBJ_VAL(JIT_OPERAND), &top[-1])) {
+        EXIT(top); // methods are bound by the interpreter
+    }
+    CONTINUE(top);
+}
+
+STENCIL(OP_SET_PROPERTY)
+{
+    if (!IS_INSTANCE(top[-2])) {
+        EXIT(top);
+    }
+    vm.stack_top = top;
+    table_t_set(&AS_INSTANCE(top[-2])->fields, OBJ_VAL(JIT_OPERAND), top[-1]);
+    top[-2] = top[-1];
+    CONTINUE(top - 1);
+}
+
+STENCIL(OP_EQUAL)
+{
+    if (IS_NUMBER(top[-1]) && IS_NUMBER(top[-2])) {
+        top[-2] = BOOL_VAL(AS_NUMBER(top[-2]) == AS_NUMBER(top[-1]));
+    } else {
+        top[-2] = BOOL_VAL(value_t_equal(top[-2], top[-1]));
+    }
+    CONTINUE(top - 1);
+}
+
+STENCIL(OP_GREATER) { NUMBERS(); top[-2] = BOOL_VAL(AS_NUMBER(top[-2]) > AS_NUMBER(top[-1])); CONTINUE(top - 1); }
+STENCIL(OP_LESS) { NUMBERS(); top[-2] = BOOL_VAL(AS_NUMBER(top[-2]) < AS_NUMBER(top[-1])); CONTINUE(top - 1); }
+STENCIL(OP_ADD) { NUMBERS(); top[-2].as.number += AS_NUMBER(top[-1]); CONTINUE(top - 1); }
+STENCIL(OP_SUBTRACT) { NUMBERS(); top[-2].as.number -= AS_NUMBER(top[-1]); CONTINUE(top - 1); }
+STENCIL(OP_MULTIPLY) { NUMBERS(); top[-2].as.number *= AS_NUMBER(top[-1]); CONTINUE(top - 1); }
+
+STENCIL(OP_DIVIDE)
+{
+    NUMBERS();
+    if (AS_NUMBER(top[-1]) == 0) {
+        EXIT(top); // the interpreter reports it
+    }
+    top[-2].as.number /= AS_NUMBER(top[-1]);
+    CONTINUE(top - 1);
+}
+
+STENCIL(OP_NOT) { top[-1] = BOOL_VAL(FALSEY(top[-1])); CONTINUE(top); }
+
+STENCIL(OP_NEGATE)
+{
+    if (!IS_NUMBER(top[-1])) {
+        EXIT(top);
+    }
+    uint64_t bits; // flip the sign bit rather than negate, which needs a mask from a constant pool
+    memcpy(&bits, &top[-1].as.number, sizeof bits);
+    bits ^= UINT64_C(1) << 63;
+    memcpy(&top[-1].as.number, &bits, sizeof bits);
+    CONTINUE(top);
+}
+
+STENCIL(OP_PRINT)
+{
+    value_t_print(stdout, top[-1]);
+    putchar('\n');
+    CONTINUE(top - 1);
+}
+
+STENCIL(OP_JUMP) { JUMP(top); }
+STENCIL(OP_LOOP) { JUMP(top); }
+
+STENCIL(OP_JUMP_IF_FALSE)
+{
+    if (FALSEY(top[-1])) {
+        JUMP(top);
+    }
+    CONTINUE(top);
+}
+
+#undef STENCIL
+#undef OPERAND
+#undef CONTINUE
+#undef JUMP
+#undef EXIT
+#undef NUMBERS
+#undef FALSEY
@@ -0,0 +1,346 @@
+#ifndef tater_jit_stencils_h
+#define tater_jit_stencils_h
+// generated by jit_stencils_gen from jit_stencils.c, regenerate with: meson compile jit-stencils -C build
+
+static const jit_stencil_t jit_stencils[] = {
+    [JIT_STENCIL_exit] = {.size = 28, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 9, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 19, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_CONSTANT] = {.size = 38, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83,
+        0xc2, 0x10, 0xf3, 0x0f, 0x6f, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x0f, 0x11, 0x42, 0xf0, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 24, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_CONSTANT_LONG] = {.size = 38, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83,
+        0xc2, 0x10, 0xf3, 0x0f, 0x6f, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x0f, 0x11, 0x42, 0xf0, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 24, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_NIL] = {.size = 34, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0xc7, 0x02, 0x01, 0x00, 0x00, 0x00, 0x48, 0x83, 0xc2, 0x10, 0x48, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xc7, 0x42, 0xf8, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 16, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_TRUE] = {.size = 34, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0xc7, 0x02, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xc2, 0x10, 0x48, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xc7, 0x42, 0xf8, 0x01, 0x00, 0x00, 0x00,
+        0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 16, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_FALSE] = {.size = 34, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0xc7, 0x02, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xc2, 0x10, 0x48, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xc7, 0x42, 0xf8, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 16, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_POP] = {.size = 20, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83,
+        0xea, 0x10, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_POPN] = {.size = 33, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x6b,
+        0xc0, 0x10, 0x48, 0x29, 0xc2, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+        0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 23, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_DUP] = {.size = 29, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0xf3, 0x0f, 0x6f, 0x42, 0xf0, 0x48, 0x83, 0xc2, 0x10, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x11, 0x42, 0xf0, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 15, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_GET_LOCAL] = {.size = 43, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83,
+        0xc2, 0x10, 0x48, 0xc1, 0xe0, 0x04, 0xf3, 0x0f, 0x6f, 0x04, 0x07, 0x48, 0xb8, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x11, 0x42, 0xf0, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 29, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_SET_LOCAL] = {.size = 39, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf3, 0x0f,
+        0x6f, 0x42, 0xf0, 0x48, 0xc1, 0xe0, 0x04, 0x0f, 0x11, 0x04, 0x07, 0x48, 0xb8, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 29, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_GET_UPVALUE] = {.size = 50, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0x8b, 0x46, 0x18, 0x48, 0x83, 0xc2, 0x10, 0x48, 0xb9, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x8b, 0x04, 0xc8, 0x48, 0x8b, 0x40, 0x10, 0xf3, 0x0f,
+        0x6f, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x11, 0x42, 0xf0,
+        0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 14, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 36, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_SET_UPVALUE] = {.size = 46, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0x8b, 0x46, 0x18, 0xf3, 0x0f, 0x6f, 0x42, 0xf0, 0x48, 0xb9, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x8b, 0x04, 0xc8, 0x48, 0x8b, 0x40, 0x10, 0x0f,
+        0x11, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 15, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 36, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_GET_GLOBAL] = {.size = 122, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x54,
+        0x48, 0x89, 0xd1, 0x49, 0x89, 0xf4, 0x55, 0xbe, 0x03, 0x00, 0x00, 0x00, 0x48, 0x89, 0xfd, 0x48,
+        0xbf, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x48, 0x89, 0xd3, 0x48, 0xba, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xd0, 0x84, 0xc0, 0x75, 0x23, 0x48, 0x89, 0xd8,
+        0x5b, 0x5d, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x5c, 0x48, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00,
+        0x48, 0x8d, 0x53, 0x10, 0x4c, 0x89, 0xe6, 0x5b, 0x48, 0x89, 0xef, 0x48, 0xb8, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x5d, 0x41, 0x5c, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_SYMBOL, .symbol = "table_t_get", .addend = 0},
+        {.offset = 33, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 48},
+        {.offset = 47, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 68, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 80, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 109, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 6},
+    [OP_SET_GLOBAL] = {.size = 171, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x56,
+        0x48, 0x89, 0xd1, 0x49, 0xbe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x55, 0x49,
+        0xbd, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x54, 0x49, 0x89, 0xf4, 0xbe, 0x03,
+        0x00, 0x00, 0x00, 0x55, 0x48, 0x89, 0xfd, 0x4c, 0x89, 0xef, 0x53, 0x48, 0x89, 0xd3, 0x4c, 0x89,
+        0xf2, 0xff, 0xd0, 0x84, 0xc0, 0x48, 0x89, 0xd8, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x75, 0x1c, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5b, 0x5d,
+        0x41, 0x5c, 0x41, 0x5d, 0x41, 0x5e, 0xc3, 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x4c, 0x89, 0xf2, 0x4c, 0x89, 0xef, 0x8b, 0x4b, 0xf0, 0x4c, 0x8b, 0x43, 0xf8, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xbe, 0x03, 0x00, 0x00, 0x00, 0xff, 0xd0, 0x48, 0x89,
+        0xda, 0x4c, 0x89, 0xe6, 0x5b, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48,
+        0x89, 0xef, 0x5d, 0x41, 0x5c, 0x41, 0x5d, 0x41, 0x5e, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_SYMBOL, .symbol = "table_t_get", .addend = 0},
+        {.offset = 21, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 33, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 48},
+        {.offset = 74, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 86, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 127, .kind = JIT_HOLE_SYMBOL, .symbol = "table_t_set", .addend = 0},
+        {.offset = 151, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 7},
+    [OP_GET_PROPERTY] = {.size = 128, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x41, 0x54, 0x49, 0x89, 0xfc, 0x55, 0x53, 0x83, 0x7a, 0xf0, 0x03, 0x48,
+        0x89, 0xd3, 0x48, 0x8b, 0x7a, 0xf8, 0x74, 0x20, 0x48, 0x89, 0xd8, 0x5b, 0x5d, 0x48, 0xa3, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x5c, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x40, 0x00, 0x83, 0x3f, 0x04, 0x75, 0xdb, 0x48, 0x89, 0xf5,
+        0x48, 0x8d, 0x4a, 0xf0, 0x48, 0x83, 0xc7, 0x18, 0xbe, 0x03, 0x00, 0x00, 0x00, 0x48, 0xba, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0xff, 0xd0, 0x84, 0xc0, 0x74, 0xb1, 0x48, 0x89, 0xda, 0x48, 0x89, 0xee, 0x5b, 0x4c, 0x89,
+        0xe7, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5d, 0x41, 0x5c, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 31, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 43, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 79, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 89, .kind = JIT_HOLE_SYMBOL, .symbol = "table_t_get", .addend = 0},
+        {.offset = 115, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 5},
+    [OP_SET_PROPERTY] = {.size = 167, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x41, 0x55, 0x41, 0x54, 0x49, 0x89, 0xfc, 0x55, 0x53, 0x48, 0x89, 0xd3,
+        0x48, 0x83, 0xec, 0x08, 0x83, 0x7a, 0xe0, 0x03, 0x48, 0x8b, 0x7a, 0xe8, 0x74, 0x22, 0x48, 0x89,
+        0xd8, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xc4, 0x08, 0x48,
+        0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5b, 0x5d, 0x41, 0x5c, 0x41, 0x5d, 0xc3,
+        0x83, 0x3f, 0x04, 0x75, 0xd9, 0x48, 0x89, 0xd0, 0x48, 0x89, 0xf5, 0x4c, 0x8d, 0x6a, 0xf0, 0x8b,
+        0x4a, 0xf0, 0x4c, 0x8b, 0x42, 0xf8, 0x48, 0x83, 0xc7, 0x18, 0xbe, 0x03, 0x00, 0x00, 0x00, 0x48,
+        0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xba, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xd0, 0xf3,
+        0x0f, 0x6f, 0x43, 0xf0, 0x4c, 0x89, 0xea, 0x48, 0x89, 0xee, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x4c, 0x89, 0xe7, 0x0f, 0x11, 0x43, 0xe0, 0x48, 0x83, 0xc4, 0x08, 0x5b,
+        0x5d, 0x41, 0x5c, 0x41, 0x5d, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 35, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 49, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 97, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 107, .kind = JIT_HOLE_OPERAND, .symbol = "JIT_OPERAND", .addend = 0},
+        {.offset = 117, .kind = JIT_HOLE_SYMBOL, .symbol = "table_t_set", .addend = 0},
+        {.offset = 140, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 6},
+    [OP_EQUAL] = {.size = 143, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x41, 0x55, 0x4c, 0x8d, 0x6a, 0xf0, 0x41, 0x54, 0x49, 0x89, 0xf4, 0x55,
+        0x48, 0x89, 0xfd, 0x53, 0x48, 0x89, 0xd3, 0x48, 0x83, 0xec, 0x08, 0x83, 0x7a, 0xf0, 0x02, 0x75,
+        0x06, 0x83, 0x7a, 0xe0, 0x02, 0x74, 0x49, 0x8b, 0x53, 0xf0, 0x49, 0x8b, 0x4d, 0x08, 0x48, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x8b, 0x7b, 0xe0, 0x48, 0x8b, 0x73, 0xe8, 0xff,
+        0xd0, 0x66, 0x0f, 0xef, 0xc0, 0x0f, 0x11, 0x43, 0xe0, 0x88, 0x43, 0xe8, 0x48, 0x83, 0xc4, 0x08,
+        0x4c, 0x89, 0xea, 0x4c, 0x89, 0xe6, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x5b, 0x48, 0x89, 0xef, 0x5d, 0x41, 0x5c, 0x41, 0x5d, 0xff, 0xe0, 0x0f, 0x1f, 0x44, 0x00, 0x00,
+        0xf2, 0x0f, 0x10, 0x42, 0xe8, 0x66, 0x0f, 0x2e, 0x42, 0xf8, 0xba, 0x00, 0x00, 0x00, 0x00, 0x66,
+        0x0f, 0xef, 0xc0, 0x0f, 0x11, 0x43, 0xe0, 0x0f, 0x9b, 0xc0, 0x0f, 0x45, 0xc2, 0xeb, 0xba,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 48, .kind = JIT_HOLE_SYMBOL, .symbol = "value_t_equal", .addend = 0},
+        {.offset = 88, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+    [OP_GREATER] = {.size = 86, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x75, 0x06, 0x83, 0x7a, 0xe0, 0x02, 0x74, 0x20,
+        0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x10, 0x42, 0xe8, 0x66,
+        0x0f, 0x2f, 0x42, 0xf8, 0x66, 0x0f, 0xef, 0xc0, 0x0f, 0x11, 0x42, 0xe0, 0x0f, 0x97, 0x42, 0xe8,
+        0x48, 0x83, 0xea, 0x10, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 21, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 31, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 50, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_LESS] = {.size = 86, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x75, 0x06, 0x83, 0x7a, 0xe0, 0x02, 0x74, 0x20,
+        0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x10, 0x42, 0xf8, 0x66,
+        0x0f, 0x2f, 0x42, 0xe8, 0x66, 0x0f, 0xef, 0xc0, 0x0f, 0x11, 0x42, 0xe0, 0x0f, 0x97, 0x42, 0xe8,
+        0x48, 0x83, 0xea, 0x10, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 21, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 31, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 50, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_ADD] = {.size = 79, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x75, 0x06, 0x83, 0x7a, 0xe0, 0x02, 0x74, 0x20,
+        0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xf2, 0x0f, 0x10, 0x42, 0xe8, 0xf2, 0x0f, 0x58, 0x42, 0xf8, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xea, 0x10, 0xf2, 0x0f, 0x11, 0x42, 0xf8, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 21, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 31, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 60, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_SUBTRACT] = {.size = 79, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x75, 0x06, 0x83, 0x7a, 0xe0, 0x02, 0x74, 0x20,
+        0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xf2, 0x0f, 0x10, 0x42, 0xe8, 0xf2, 0x0f, 0x5c, 0x42, 0xf8, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xea, 0x10, 0xf2, 0x0f, 0x11, 0x42, 0xf8, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 21, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 31, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 60, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_MULTIPLY] = {.size = 79, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x75, 0x06, 0x83, 0x7a, 0xe0, 0x02, 0x74, 0x20,
+        0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xf2, 0x0f, 0x10, 0x42, 0xe8, 0xf2, 0x0f, 0x59, 0x42, 0xf8, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xea, 0x10, 0xf2, 0x0f, 0x11, 0x42, 0xf8, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 21, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 31, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 60, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_DIVIDE] = {.size = 94, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x75, 0x17, 0x83, 0x7a, 0xe0, 0x02, 0x75, 0x11,
+        0xf2, 0x0f, 0x10, 0x42, 0xf8, 0x66, 0x0f, 0xef, 0xc9, 0x66, 0x0f, 0x2e, 0xc1, 0x7a, 0x21, 0x75,
+        0x1f, 0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00,
+        0xf2, 0x0f, 0x10, 0x4a, 0xe8, 0x48, 0x83, 0xea, 0x10, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0xf2, 0x0f, 0x5e, 0xc8, 0xf2, 0x0f, 0x11, 0x4a, 0xf8, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 38, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 48, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 75, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_NOT] = {.size = 81, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x8b, 0x4a, 0xf0, 0xb8, 0x01, 0x00, 0x00, 0x00, 0x83, 0xf9, 0x01, 0x74,
+        0x1a, 0x85, 0xc9, 0x74, 0x33, 0x31, 0xc0, 0x83, 0xf9, 0x02, 0x75, 0x0f, 0x66, 0x0f, 0xef, 0xc0,
+        0x66, 0x0f, 0x2e, 0x42, 0xf8, 0x0f, 0x9b, 0xc1, 0x0f, 0x44, 0xc1, 0x66, 0x0f, 0xef, 0xc0, 0x0f,
+        0x11, 0x42, 0xf0, 0x88, 0x42, 0xf8, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xe0, 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00, 0x0f, 0xb6, 0x42, 0xf8, 0x83, 0xf0, 0x01, 0xeb,
+        0xda,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 56, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_NEGATE] = {.size = 58, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x83, 0x7a, 0xf0, 0x02, 0x74, 0x1e, 0x48, 0x89, 0xd0, 0x48, 0xa3, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0xc3, 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x48, 0x0f, 0xba, 0x7a, 0xf8, 0x3f, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 15, .kind = JIT_HOLE_SYMBOL, .symbol = "vm", .addend = 32},
+        {.offset = 25, .kind = JIT_HOLE_RESUME, .symbol = "JIT_RESUME", .addend = 0},
+        {.offset = 42, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 3},
+    [OP_PRINT] = {.size = 109, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x55,
+        0x49, 0xbd, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x54, 0x4c, 0x8d, 0x62, 0xf0,
+        0x55, 0x48, 0x89, 0xf5, 0x53, 0x48, 0x89, 0xfb, 0x48, 0x83, 0xec, 0x08, 0x8b, 0x72, 0xf0, 0x49,
+        0x8b, 0x7d, 0x00, 0x48, 0x8b, 0x52, 0xf8, 0xff, 0xd0, 0x49, 0x8b, 0x75, 0x00, 0xbf, 0x0a, 0x00,
+        0x00, 0x00, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xd0, 0x48, 0x83,
+        0xc4, 0x08, 0x4c, 0x89, 0xe2, 0x48, 0x89, 0xee, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x48, 0x89, 0xdf, 0x5b, 0x5d, 0x41, 0x5c, 0x41, 0x5d, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_SYMBOL, .symbol = "value_t_print", .addend = 0},
+        {.offset = 18, .kind = JIT_HOLE_SYMBOL, .symbol = "stdout", .addend = 0},
+        {.offset = 68, .kind = JIT_HOLE_SYMBOL, .symbol = "putc", .addend = 0},
+        {.offset = 90, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 4},
+    [OP_JUMP] = {.size = 16, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_TARGET, .symbol = "JIT_TARGET", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_LOOP] = {.size = 16, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 6, .kind = JIT_HOLE_TARGET, .symbol = "JIT_TARGET", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 1},
+    [OP_JUMP_IF_FALSE] = {.size = 66, .code = (const uint8_t[]){
+        0xf3, 0x0f, 0x1e, 0xfa, 0x8b, 0x42, 0xf0, 0x83, 0xf8, 0x01, 0x74, 0x2a, 0x85, 0xc0, 0x74, 0x20,
+        0x83, 0xf8, 0x02, 0x75, 0x0d, 0x66, 0x0f, 0xef, 0xc0, 0x66, 0x0f, 0x2e, 0x42, 0xf8, 0x7a, 0x02,
+        0x74, 0x14, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xe0, 0x66, 0x90,
+        0x80, 0x7a, 0xf8, 0x00, 0x75, 0xec, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xe0,
+    }, .holes = (const jit_hole_t[]){
+        {.offset = 36, .kind = JIT_HOLE_CONTINUE, .symbol = "JIT_CONTINUE", .addend = 0},
+        {.offset = 56, .kind = JIT_HOLE_TARGET, .symbol = "JIT_TARGET", .addend = 0},
+        {.kind = JIT_HOLE_NONE},
+    }, .hole_count = 2},
+};
+
+#endif
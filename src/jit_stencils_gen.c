@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Build tool: reads jit_stencils.o (an x86-64 ELF relocatable built with
+ * -mcmodel=large -ffunction-sections) and writes jit_stencils.h, the machine
+ * code of every stencil_* function plus the holes its relocations leave.
+ * Only absolute 64-bit relocations are accepted, so each hole is a movabs
+ * immediate the JIT can fill in with an address or an operand.
+ */
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STENCIL_PREFIX "stencil_"
+
+static const char *hole_kind(const char *symbol)
+{
+    if (strcmp(symbol, "JIT_CONTINUE") == 0) return "JIT_HOLE_CONTINUE";
+    if (strcmp(symbol, "JIT_TARGET") == 0) return "JIT_HOLE_TARGET";
+    if (strcmp(symbol, "JIT_RESUME") == 0) return "JIT_HOLE_RESUME";
+    if (strcmp(symbol, "JIT_OPERAND") == 0) return "JIT_HOLE_OPERAND";
+    return "JIT_HOLE_SYMBOL";
+}
+
+// the next instruction must be reached with a jump: a call would nest a native frame per instruction run
+static bool is_tail_jump(const uint8_t *code, const size_t size, const size_t hole)
+{
+    if (hole < 2 || (code[hole - 2] & 0xf8) != 0x48 || (code[hole - 1] & 0xf8) != 0xb8) {
+        return false;
+    }
+    const int reg = code[hole - 1] & 7;
+    const bool extended = code[hole - 2] & 1;
+    for (size_t i = hole + 8; i + 1 < size; i++) {
+        if (code[i] == 0xff && (code[i + 1] & 7) == reg && (code[i + 1] & 0xf8) == 0xe0 &&
+            (!extended || (i > 0 && code[i - 1] == 0x41))) {
+            return true; // ff e0+reg, jmp reg
+        }
+        if (code[i] == 0xff && (code[i + 1] & 7) == reg && (code[i + 1] & 0xf8) == 0xd0 &&
+            (!extended || (i > 0 && code[i - 1] == 0x41))) {
+            return false; // ff d0+reg, call reg
+        }
+    }
+    return false;
+}
+
+static uint8_t *read_object(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    const long length = ftell(file);
+    rewind(file);
+    uint8_t *bytes = length > 0 ? malloc(length) : NULL;
+    if (bytes == NULL || fread(bytes, 1, length, file) != (size_t)length) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        free(bytes);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = length;
+    return bytes;
+}
+
+int main(const int argc, const char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s jit_stencils.o jit_stencils.h\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    size_t size = 0;
+    uint8_t *object = read_object(argv[1], &size);
+    if (object == NULL) {
+        return EXIT_FAILURE;
+    }
+    const Elf64_Ehdr *header = (const Elf64_Ehdr*)(const void*)object;
+    if (size < sizeof *header || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_ident[EI_CLASS] != ELFCLASS64 || header->e_machine != EM_X86_64 || header->e_type != ET_REL ||
+        header->e_shoff + (size_t)header->e_shnum * sizeof(Elf64_Shdr) > size) {
+        fprintf(stderr, "%s is not an x86-64 relocatable object.\n", argv[1]);
+        free(object);
+        return EXIT_FAILURE;
+    }
+    const Elf64_Shdr *sections = (const Elf64_Shdr*)(const void*)(object + header->e_shoff);
+    const Elf64_Shdr *symtab = NULL;
+    for (int i = 0; i < header->e_shnum; i++) {
+        if (sections[i].sh_type == SHT_SYMTAB) {
+            symtab = &sections[i];
+        }
+    }
+    if (symtab == NULL) {
+        fprintf(stderr, "%s has no symbol table.\n", argv[1]);
+        free(object);
+        return EXIT_FAILURE;
+    }
+    const Elf64_Sym *symbols = (const Elf64_Sym*)(const void*)(object + symtab->sh_offset);
+    const size_t symbol_count = symtab->sh_size / sizeof(Elf64_Sym);
+    const char *names = (const char*)(object + sections[symtab->sh_link].sh_offset);
+    const char *section_names = (const char*)(object + sections[header->e_shstrndx].sh_offset);
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", argv[2]);
+        free(object);
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "#ifndef tater_jit_stencils_h\n#define tater_jit_stencils_h\n");
+    fprintf(out, "// generated by jit_stencils_gen from jit_stencils.c, regenerate with: meson compile jit-stencils -C build\n\n");
+
+    bool ok = true;
+    fprintf(out, "static const jit_stencil_t jit_stencils[] = {\n");
+    for (size_t s = 0; ok && s < symbol_count; s++) {
+        const Elf64_Sym *symbol = &symbols[s];
+        const char *name = names + symbol->st_name;
+        if (ELF64_ST_TYPE(symbol->st_info) != STT_FUNC || strncmp(name, STENCIL_PREFIX, strlen(STENCIL_PREFIX)) != 0) {
+            continue;
+        }
+        const Elf64_Shdr *text = &sections[symbol->st_shndx];
+        const uint8_t *code = object + text->sh_offset + symbol->st_value;
+        // OP_ stencils are indexed by opcode, the rest by name
+        const char *stencil = name + strlen(STENCIL_PREFIX);
+        if (strncmp(stencil, "OP_", 3) == 0) {
+            fprintf(out, "    [%s] = {.size = %lu, .code = (const uint8_t[]){", stencil, (unsigned long)symbol->st_size);
+        } else {
+            fprintf(out, "    [JIT_STENCIL_%s] = {.size = %lu, .code = (const uint8_t[]){", stencil, (unsigned long)symbol->st_size);
+        }
+        for (size_t i = 0; i < symbol->st_size; i++) {
+            fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n        ", code[i]);
+        }
+        fprintf(out, "\n    }, .holes = (const jit_hole_t[]){\n");
+
+        int hole_count = 0;
+        for (int r = 0; ok && r < header->e_shnum; r++) {
+            if (sections[r].sh_type != SHT_RELA || sections[r].sh_info != symbol->st_shndx) {
+                continue;
+            }
+            const Elf64_Rela *relocations = (const Elf64_Rela*)(const void*)(object + sections[r].sh_offset);
+            for (size_t i = 0; i < sections[r].sh_size / sizeof(Elf64_Rela); i++) {
+                const Elf64_Rela *relocation = &relocations[i];
+                const Elf64_Sym *target = &symbols[ELF64_R_SYM(relocation->r_info)];
+                const char *target_name = ELF64_ST_TYPE(target->st_info) == STT_SECTION ?
+                    section_names + sections[target->st_shndx].sh_name : names + target->st_name;
+                if (relocation->r_offset < symbol->st_value || relocation->r_offset + 8 > symbol->st_value + symbol->st_size) {
+                    continue;
+                }
+                if (ELF64_R_TYPE(relocation->r_info) != R_X86_64_64 || target->st_shndx != SHN_UNDEF) {
+                    fprintf(stderr, "%s: unsupported relocation against %s, stencils may only use extern symbols.\n", name, target_name);
+                    ok = false;
+                    break;
+                }
+                const char *kind = hole_kind(target_name);
+                const size_t offset = relocation->r_offset - symbol->st_value;
+                if ((strcmp(kind, "JIT_HOLE_CONTINUE") == 0 || strcmp(kind, "JIT_HOLE_TARGET") == 0) && !is_tail_jump(code, symbol->st_size, offset)) {
+                    fprintf(stderr, "%s: %s is not a tail call.\n", name, target_name);
+                    ok = false;
+                    break;
+                }
+                fprintf(out, "        {.offset = %lu, .kind = %s, .symbol = \"%s\", .addend = %ld},\n",
+                    (unsigned long)offset, kind, target_name, (long)relocation->r_addend);
+                hole_count++;
+            }
+        }
+        fprintf(out, "        {.kind = JIT_HOLE_NONE},\n    }, .hole_count = %d},\n", hole_count);
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n#endif\n");
+    fclose(out);
+    free(object);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
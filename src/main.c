@@ -18,6 +18,7 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,7 +26,13 @@
 #include <limits.h>
 
 #include "common.h"
+#include "aot.h"
+#include "cache.h"
+#include "compiler.h"
 #include "debug.h"
+#include "image.h"
+#include "metrics.h"
+#include "profile.h"
 #include "vm.h"
 #include "vmopcodes.h"
 
@@ -176,10 +183,89 @@ static char *read_file(const char *file_path)
     return buffer;
 }
 
-static int run_file(const char *file_path)
+static void cache_path_for(const char *file_path, char *cache_path)
+{
+    if (snprintf(cache_path, PATH_MAX, "%s%s", file_path, CACHE_FILE_SUFFIX) >= PATH_MAX) {
+        fprintf(stderr, gettext("Cache path too long for \"%s\".\n"), file_path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int compile_file(const char *file_path, const char *output_path, const bool debug)
+{
+    char cache_path[PATH_MAX];
+    if (output_path == NULL) {
+        cache_path_for(file_path, cache_path);
+        output_path = cache_path;
+    }
+
+    char *source = read_file(file_path);
+    obj_function_t *function = compiler_t_compile(source, debug);
+    int rv = EXIT_FAILURE;
+    if (function != NULL) {
+        vm_push(OBJ_VAL(function));
+        if (cache_t_write(output_path, file_path, source, function))
+            rv = EXIT_SUCCESS;
+        vm_pop();
+    }
+    free(source);
+    return rv;
+}
+
+static int emit_c_file(const char *file_path, const char *output_path)
+{
+    char c_path[PATH_MAX];
+    if (output_path == NULL) {
+        if (snprintf(c_path, PATH_MAX, "%s.c", file_path) >= PATH_MAX) {
+            fprintf(stderr, gettext("Output path too long for \"%s\".\n"), file_path);
+            return EXIT_FAILURE;
+        }
+        output_path = c_path;
+    }
+
+    char *source = read_file(file_path);
+    obj_function_t *function = compiler_t_compile(source, false);
+    int rv = EXIT_FAILURE;
+    if (function != NULL) {
+        vm_push(OBJ_VAL(function));
+        if (aot_t_emit_c(function, file_path, output_path))
+            rv = EXIT_SUCCESS;
+        vm_pop();
+    }
+    free(source);
+    return rv;
+}
+
+static int dump_file(const char *file_path, const int optimization_level)
+{
+    char *source = read_file(file_path);
+    printf(gettext("-- before optimization --\n"));
+    compiler_t_set_optimization_level(0);
+    const bool before = compiler_t_compile(source, true) != NULL;
+    printf(gettext("-- after optimization --\n"));
+    compiler_t_set_optimization_level(optimization_level);
+    const bool after = compiler_t_compile(source, true) != NULL;
+    free(source);
+    return before && after ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_file(const char *file_path, const bool use_cache)
 {
     char *source = read_file(file_path);
-    vm_t_interpret_result_t r = vm_t_interpret(source);
+    vm_t_interpret_result_t r;
+
+    // a stale or foreign .totc is silently ignored in favor of the source
+    obj_function_t *function = NULL;
+    if (use_cache) {
+        char cache_path[PATH_MAX];
+        cache_path_for(file_path, cache_path);
+        function = cache_t_load(cache_path, file_path, source);
+    }
+    if (function != NULL) {
+        r = vm_t_interpret_function(function);
+    } else {
+        r = vm_t_interpret(source);
+    }
     free(source);
     switch (r) {
         case INTERPRET_OK:
@@ -212,6 +298,27 @@ static void version(const char *name)
 static void help(const char *name)
 {
     printf(gettext("Usage: %s [options] [path | -]\n"), name);
+    printf("  -c, %s\n", gettext("Compile the file to bytecode (.totc) without running it"));
+    printf("  -o, %s\n", gettext("Bytecode or C output path when compiling"));
+    printf("      --emit-c, %s\n", gettext("Translate the file to C (.tot.c) for building a standalone executable"));
+    printf("      --profile-hot, %s\n", gettext("Count calls and loop iterations, reporting the hottest functions on exit"));
+    printf("      --profile=PATH, %s\n", gettext("Sample the call stack, writing collapsed stacks for flame graphs to PATH"));
+    printf("      --profile-calls, %s\n", gettext("Time every call, reporting calls and inclusive and exclusive time on exit"));
+    printf("      --alloc-profile, %s\n", gettext("Record the function and line of every allocation, reporting the top sites on exit"));
+    printf("      --perf-map, %s\n", gettext("Write /tmp/perf-PID.map naming the native code of -j and -J for perf"));
+    printf("      --metrics=PATH, %s\n", gettext("Write Prometheus metrics to PATH on SIGUSR1 and on exit"));
+    printf("      --metrics-interval=SECONDS, %s\n", gettext("Also write the metrics every SECONDS"));
+#ifdef TATER_OPSTATS
+    printf("      --opstats, %s\n", gettext("Count executed opcodes and opcode pairs, reporting them on exit"));
+#endif
+    printf("  -I, %s\n", gettext("Load a heap image before running"));
+    printf("  -S, %s\n", gettext("Save the heap to an image after running"));
+    printf("  -l, %s\n", gettext("Compile function bodies on their first call"));
+    printf("  -D, %s\n", gettext("Disassemble the file before and after optimization without running it"));
+    printf("  -O, %s\n", gettext("Optimization level: 0 none, 1 constant folding (default), 2 adds the IR passes"));
+    printf("  -F, %s\n", gettext("Maximum call depth (default 4096)"));
+    printf("  -j, %s\n", gettext("Compile hot functions to native code, where the build supports it"));
+    printf("  -J, %s\n", gettext("Like -j, stitching together the precompiled opcode stencils instead"));
     printf("  -d, %s\n", gettext("Enable debugging"));
     printf("  -s, %s\n", gettext("Enable garbage collector stress testing"));
     printf("  -t, %s\n", gettext("Enable garbage collector tracing"));
@@ -224,20 +331,121 @@ static void help(const char *name)
 #define DEBUG_OPT 'd'
 #define GC_STRESS_OPT 's'
 #define GC_TRACE_OPT 't'
+#define COMPILE_OPT 'c'
+#define OUTPUT_OPT 'o'
+#define LOAD_IMAGE_OPT 'I'
+#define SAVE_IMAGE_OPT 'S'
+#define LAZY_COMPILE_OPT 'l'
+#define DUMP_OPT 'D'
+#define OPTIMIZE_OPT 'O'
+#define FRAMES_MAX_OPT 'F'
+#define JIT_OPT 'j'
+#define JIT_STENCILS_OPT 'J'
+#define EMIT_C_OPT 256 // long options only
+#define PROFILE_HOT_OPT 257
+#define PROFILE_OPT 258
+#define PROFILE_CALLS_OPT 259
+#define OPSTATS_OPT 260
+#define ALLOC_PROFILE_OPT 261
+#define PERF_MAP_OPT 262
+#define METRICS_OPT 263
+#define METRICS_INTERVAL_OPT 264
 
 int main(const int argc, const char *argv[])
 {
     bool debug = false;
     bool gc_trace = false;
     bool gc_stress = false;
+    bool compile_only = false;
+    bool lazy_compile = false;
+    bool dump = false;
+    bool emit_c = false;
+    bool profile_hot = false;
+    bool profile_calls = false;
+    bool alloc_profile = false;
+    bool perf_map = false;
+#ifdef TATER_OPSTATS
+    bool opstats = false;
+#endif
+    bool jit = false;
+    bool jit_stencils = false;
+    int optimization_level = 1;
+    int frames_max = FRAMES_MAX;
+    const char *output_path = NULL;
+    const char *load_image_path = NULL;
+    const char *save_image_path = NULL;
+    const char *profile_path = NULL;
+    const char *metrics_path = NULL;
+    int metrics_interval = 0;
 
+    static const struct option long_options[] = {
+        {"emit-c", no_argument, NULL, EMIT_C_OPT},
+        {"profile-hot", no_argument, NULL, PROFILE_HOT_OPT},
+        {"profile", required_argument, NULL, PROFILE_OPT},
+        {"profile-calls", no_argument, NULL, PROFILE_CALLS_OPT},
+        {"alloc-profile", no_argument, NULL, ALLOC_PROFILE_OPT},
+        {"perf-map", no_argument, NULL, PERF_MAP_OPT},
+        {"metrics", required_argument, NULL, METRICS_OPT},
+        {"metrics-interval", required_argument, NULL, METRICS_INTERVAL_OPT},
+#ifdef TATER_OPSTATS
+        {"opstats", no_argument, NULL, OPSTATS_OPT},
+#endif
+        {NULL, 0, NULL, 0},
+    };
     opterr = 0; // silence warnings
     int option = -1;
-    while((option = getopt(argc, (char **)argv, "+dtsvh")) != -1) {
+    while((option = getopt_long(argc, (char **)argv, "+dtsvhlcjJDo:I:S:O:F:", long_options, NULL)) != -1) {
         switch (option) {
             case DEBUG_OPT: debug = true; break;
             case GC_TRACE_OPT: gc_trace = true; break;
             case GC_STRESS_OPT: gc_stress = true; break;
+            case COMPILE_OPT: compile_only = true; break;
+            case LAZY_COMPILE_OPT: lazy_compile = true; break;
+            case DUMP_OPT: dump = true; break;
+            case EMIT_C_OPT: emit_c = true; break;
+            case PROFILE_HOT_OPT: profile_hot = true; break;
+            case PROFILE_OPT: profile_path = optarg; break;
+            case PROFILE_CALLS_OPT: profile_calls = true; break;
+            case ALLOC_PROFILE_OPT: alloc_profile = true; break;
+            case PERF_MAP_OPT: perf_map = true; break;
+            case METRICS_OPT: metrics_path = optarg; break;
+            case METRICS_INTERVAL_OPT: {
+                char *end = NULL;
+                const long interval = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || interval < 1 || interval > INT_MAX) {
+                    fprintf(stderr, gettext("Invalid metrics interval \"%s\".\n"), optarg);
+                    return EXIT_FAILURE;
+                }
+                metrics_interval = (int)interval;
+                break;
+            }
+#ifdef TATER_OPSTATS
+            case OPSTATS_OPT: opstats = true; break;
+#endif
+            case JIT_OPT: jit = true; break;
+            case JIT_STENCILS_OPT: jit_stencils = true; break;
+            case OUTPUT_OPT: output_path = optarg; break;
+            case LOAD_IMAGE_OPT: load_image_path = optarg; break;
+            case SAVE_IMAGE_OPT: save_image_path = optarg; break;
+            case OPTIMIZE_OPT: {
+                char *end = NULL;
+                optimization_level = (int)strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || optimization_level < 0 || optimization_level > 2) {
+                    fprintf(stderr, gettext("Invalid optimization level \"%s\".\n"), optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case FRAMES_MAX_OPT: {
+                char *end = NULL;
+                const long depth = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || depth < 1 || depth > INT_MAX) {
+                    fprintf(stderr, gettext("Invalid call depth \"%s\".\n"), optarg);
+                    return EXIT_FAILURE;
+                }
+                frames_max = (int)depth;
+                break;
+            }
             case VERSION_OPT: version(argv[0]); return EXIT_SUCCESS;
             case HELP_OPT: help(argv[0]); return EXIT_SUCCESS;
             default: help(argv[0]); return EXIT_FAILURE;
@@ -245,21 +453,98 @@ int main(const int argc, const char *argv[])
     }
 
     vm_t_init();
+    compiler_t_set_optimization_level(optimization_level);
+    vm_set_frames_max(frames_max);
     if (debug) vm_toggle_stack_trace();
     if (gc_trace) vm_toggle_gc_trace();
     if (gc_stress) vm_toggle_gc_stress();
+    if (lazy_compile && !compile_only && !emit_c) vm_toggle_lazy_compile(); // bytecode caches are always complete
+    if (jit) vm_toggle_jit();
+    if (jit_stencils) vm_toggle_jit_stencils();
+    if (profile_hot) vm_toggle_profile_hot();
+    if (profile_calls) vm_toggle_profile_calls();
+    if (alloc_profile) vm_toggle_alloc_profile();
+#ifdef TATER_OPSTATS
+    if (opstats) vm_toggle_opstats();
+#endif
+
+    if (load_image_path != NULL && !image_t_load(load_image_path)) {
+        vm_t_free();
+        return EXIT_FAILURE;
+    }
+    if (profile_path != NULL && !profile_t_sampler_start(profile_path, PROFILE_SAMPLE_HZ)) {
+        vm_t_free();
+        return EXIT_FAILURE;
+    }
+    if (perf_map && !profile_t_perf_map_open()) {
+        vm_t_free();
+        return EXIT_FAILURE;
+    }
+    if (metrics_path != NULL && !metrics_t_start(metrics_path, metrics_interval)) {
+        vm_t_free();
+        return EXIT_FAILURE;
+    }
 
     int rv = 0;
-    if (optind == argc) { // no args
+    if (dump) {
+        if (optind == argc) {
+            help(argv[0]);
+            rv = EXIT_FAILURE;
+        } else {
+            rv = dump_file(argv[optind], optimization_level);
+        }
+    } else if (emit_c) {
+        if (optind == argc) {
+            help(argv[0]);
+            rv = EXIT_FAILURE;
+        } else {
+            rv = emit_c_file(argv[optind], output_path);
+        }
+    } else if (compile_only) {
+        if (optind == argc) {
+            help(argv[0]);
+            rv = EXIT_FAILURE;
+        } else {
+            rv = compile_file(argv[optind], output_path, debug);
+        }
+    } else if (optind == argc) { // no args
         vm_set_argc_argv(argc, argv); // repl gets ours?
         vm_inherit_env();
         rv = repl();
     } else {
         vm_set_argc_argv(argc - optind, argv + optind);
         vm_inherit_env();
-        rv = run_file(argv[optind]);
+        rv = run_file(argv[optind], !debug); // debug wants to see the compiler output
+    }
+
+    if (save_image_path != NULL && rv == EXIT_SUCCESS && !image_t_write(save_image_path)) {
+        rv = EXIT_FAILURE;
     }
 
+    if (profile_path != NULL && !profile_t_sampler_stop()) {
+        rv = EXIT_FAILURE;
+    }
+    if (perf_map && !profile_t_perf_map_close()) {
+        rv = EXIT_FAILURE;
+    }
+    if (metrics_path != NULL && !metrics_t_stop()) {
+        rv = EXIT_FAILURE;
+    }
+    if (profile_hot) {
+        profile_t_hot_report(stderr, PROFILE_HOT_LIMIT);
+    }
+    if (profile_calls) {
+        profile_t_leave(1); // anything a runtime error left running
+        profile_t_calls_report(stderr, PROFILE_CALLS_LIMIT);
+    }
+    if (alloc_profile) {
+        profile_t_alloc_report(stderr, PROFILE_ALLOC_LIMIT);
+    }
+#ifdef TATER_OPSTATS
+    if (opstats) {
+        profile_t_opstats_report(stderr, PROFILE_OPSTATS_LIMIT);
+    }
+#endif
     vm_t_free();
     return rv;
 }
@@ -21,9 +21,10 @@
 
 #include "common.h"
 #include "memory.h"
+#include "profile.h"
 #include "vm.h"
 
-void *reallocate(void *pointer, const size_t old_size, const size_t new_size)
+static void *resize(void *pointer, const size_t old_size, const size_t new_size)
 {
     vm.bytes_allocated += new_size - old_size;
     if (new_size > old_size) {
@@ -44,3 +45,16 @@ void *reallocate(void *pointer, const size_t old_size, const size_t new_size)
     }
     return result;
 }
+
+void *reallocate(void *pointer, const size_t old_size, const size_t new_size)
+{
+    if (vm.flags & VM_FLAG_ALLOC_PROFILE && new_size > old_size) {
+        profile_t_alloc_growth(new_size - old_size);
+    }
+    return resize(pointer, old_size, new_size);
+}
+
+void *reallocate_object(const size_t size)
+{
+    return resize(NULL, 0, size);
+}
@@ -36,5 +36,7 @@
     reallocate(pointer, sizeof(type) * (old_count), 0)
 
 void *reallocate(void *pointer, const size_t old_size, const size_t new_size);
+// for allocate_object, which charges --alloc-profile with the object rather than as growth
+void *reallocate_object(const size_t size);
 
 #endif
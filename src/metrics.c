@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "common.h"
+#include "metrics.h"
+#include "vm.h"
+
+volatile sig_atomic_t metrics_pending = 0;
+
+// one export per process, like the signals and the interval timer
+static char *metrics_path = NULL;
+static int metrics_interval = 0;
+
+static void metrics_signal(int)
+{
+    metrics_pending = 1;
+}
+
+bool metrics_t_start(const char *path, const int interval)
+{
+    if (path == NULL || interval < 0) {
+        return false;
+    }
+    metrics_path = strdup(path);
+    if (metrics_path == NULL) {
+        fprintf(stderr, "Failed to allocate metrics path.\n");
+        exit(EXIT_FAILURE);
+    }
+    metrics_interval = interval;
+
+    struct sigaction action = {0};
+    action.sa_handler = metrics_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    const struct itimerval timer = {
+        .it_interval = {.tv_sec = interval, .tv_usec = 0},
+        .it_value = {.tv_sec = interval, .tv_usec = 0},
+    };
+    if (sigaction(SIGUSR1, &action, NULL) == -1 ||
+        (interval > 0 && (sigaction(SIGALRM, &action, NULL) == -1 || setitimer(ITIMER_REAL, &timer, NULL) == -1))) {
+        perror(path);
+        free(metrics_path);
+        metrics_path = NULL;
+        return false;
+    }
+    vm.flags |= VM_FLAG_METRICS;
+    return true;
+}
+
+static int interned_strings(void)
+{
+    int count = 0;
+    for (int i = 0; i < vm.strings.capacity; i++) {
+        if (!IS_EMPTY(vm.strings.entries[i].key)) { // tombstones are counted in vm.strings.count
+            count++;
+        }
+    }
+    return count;
+}
+
+static void metric(FILE *f, const char *name, const char *type, const char *help)
+{
+    fprintf(f, "# HELP " METRICS_PREFIX "%s %s\n", name, help);
+    fprintf(f, "# TYPE " METRICS_PREFIX "%s %s\n", name, type);
+    fprintf(f, METRICS_PREFIX "%s ", name);
+}
+
+void metrics_t_print(FILE *f)
+{
+    metric(f, "instructions_total", "counter", "Bytecode instructions the interpreter dispatched, estimated from a sample.");
+    fprintf(f, "%" PRIu64 "\n", vm.counters.instructions);
+    metric(f, "calls_total", "counter", "Calls to functions, methods and natives.");
+    fprintf(f, "%" PRIu64 "\n", vm.counters.calls);
+    metric(f, "allocations_total", "counter", "Objects allocated.");
+    fprintf(f, "%" PRIu64 "\n", vm.counters.allocations);
+    metric(f, "gc_cycles_total", "counter", "Garbage collections.");
+    fprintf(f, "%" PRIu64 "\n", vm.counters.gc_cycles);
+    metric(f, "gc_pause_seconds_total", "counter", "Time spent collecting garbage.");
+    fprintf(f, "%.9f\n", (double)vm.counters.gc_ns / 1e9);
+    metric(f, "heap_bytes", "gauge", "Bytes allocated on the heap.");
+    fprintf(f, "%zu\n", vm.bytes_allocated);
+    metric(f, "interned_strings", "gauge", "Strings in the intern table.");
+    fprintf(f, "%d\n", interned_strings());
+    metric(f, "open_files", "gauge", "Files opened by the script and not yet closed.");
+    fprintf(f, "%d\n", vm.counters.open_files);
+}
+
+bool metrics_t_write(void)
+{
+    metrics_pending = 0;
+    if (metrics_path == NULL) {
+        return false;
+    }
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, PATH_MAX, "%s.%d", metrics_path, (int)getpid()) >= PATH_MAX) {
+        fprintf(stderr, gettext("Metrics path too long \"%s\".\n"), metrics_path);
+        return false;
+    }
+    FILE *f = fopen(tmp_path, "w");
+    if (f == NULL) {
+        perror(tmp_path);
+        return false;
+    }
+    metrics_t_print(f);
+    if (fclose(f) != 0) {
+        perror(tmp_path);
+        unlink(tmp_path);
+        return false;
+    }
+    if (rename(tmp_path, metrics_path) == -1) {
+        perror(metrics_path);
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+bool metrics_t_stop(void)
+{
+    if (metrics_path == NULL) {
+        return false;
+    }
+    if (metrics_interval > 0) {
+        const struct itimerval off = {0};
+        setitimer(ITIMER_REAL, &off, NULL);
+        signal(SIGALRM, SIG_DFL);
+    }
+    signal(SIGUSR1, SIG_DFL);
+    vm.flags &= ~VM_FLAG_METRICS;
+
+    const bool ok = metrics_t_write();
+    free(metrics_path);
+    metrics_path = NULL;
+    metrics_interval = 0;
+    return ok;
+}
@@ -0,0 +1,46 @@
+#ifndef tater_metrics_h
+#define tater_metrics_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define METRICS_PREFIX "tater_"
+#define METRICS_SAMPLE_RATE 16 // run() counts about one in this many stretches of instructions
+
+/*
+ * Metrics export: the VM keeps vm.counters as it runs. Counting every
+ * instruction would slow them all down, so run() counts a random sample of the
+ * stretches between loop backedges and returns instead. metrics_t_write writes
+ * the counters with the heap size, interned strings and open files in the
+ * Prometheus text format, for the node exporter's textfile collector. With
+ * metrics_t_start SIGUSR1, and SIGALRM every interval seconds when one is
+ * given, only mark a write as pending; the VM makes it at the next call or
+ * loop backedge, so like the profilers it keeps functions out of the JIT,
+ * whose native loops never get back to one. Writes go through a temporary and a rename, so a scrape
+ * never sees half a file.
+ */
+extern volatile sig_atomic_t metrics_pending;
+bool metrics_t_start(const char *path, const int interval);
+void metrics_t_print(FILE *f);
+bool metrics_t_write(void);
+bool metrics_t_stop(void); // with a last write
+
+#endif
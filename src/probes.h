@@ -0,0 +1,58 @@
+#ifndef tater_probes_h
+#define tater_probes_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Static tracepoints in the tater provider, built in with -Dusdt=enabled. Each
+ * one is a single nop until bpftrace, perf or systemtap attaches to it, and
+ * expands to nothing at all otherwise.
+ *
+ *   gc__start(bytes_allocated)
+ *   gc__done(bytes_before, bytes_after)
+ *   function__entry(name, line, depth)
+ *   function__return(name, line, depth)
+ *   compile__start(name, line)
+ *   compile__done(name, ok)
+ *   runtime__error(message, name, line)
+ *
+ * name is the function name ("script" at the top level) and line the line it
+ * starts on, except for runtime__error where it is the line that failed.
+ */
+#include <stdbool.h>
+
+#ifdef TATER_USDT
+#include <sys/sdt.h>
+#define TATER_PROBE_GC_START(bytes) DTRACE_PROBE1(tater, gc__start, bytes)
+#define TATER_PROBE_GC_DONE(before, after) DTRACE_PROBE2(tater, gc__done, before, after)
+#define TATER_PROBE_FUNCTION_ENTRY(name, line, depth) DTRACE_PROBE3(tater, function__entry, name, line, depth)
+#define TATER_PROBE_FUNCTION_RETURN(name, line, depth) DTRACE_PROBE3(tater, function__return, name, line, depth)
+#define TATER_PROBE_COMPILE_START(name, line) DTRACE_PROBE2(tater, compile__start, name, line)
+#define TATER_PROBE_COMPILE_DONE(name, ok) DTRACE_PROBE2(tater, compile__done, name, ok)
+#define TATER_PROBE_RUNTIME_ERROR(message, name, line) DTRACE_PROBE3(tater, runtime__error, message, name, line)
+#else
+#define TATER_PROBE_GC_START(bytes) do { } while (false)
+#define TATER_PROBE_GC_DONE(before, after) do { } while (false)
+#define TATER_PROBE_FUNCTION_ENTRY(name, line, depth) do { } while (false)
+#define TATER_PROBE_FUNCTION_RETURN(name, line, depth) do { } while (false)
+#define TATER_PROBE_COMPILE_START(name, line) do { } while (false)
+#define TATER_PROBE_COMPILE_DONE(name, ok) do { } while (false)
+#define TATER_PROBE_RUNTIME_ERROR(message, name, line) do { } while (false)
+#endif
+
+#endif
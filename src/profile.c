@@ -0,0 +1,749 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "common.h"
+#include "profile.h"
+#include "vm.h"
+#include "vmopcodes.h"
+
+void profile_t_count_backedge(obj_function_t *function, const int offset)
+{
+    if (function->loop_counts == NULL) {
+        function->loop_counts = calloc(function->chunk.count, sizeof *function->loop_counts);
+        if (function->loop_counts == NULL) {
+            fprintf(stderr, "Failed to allocate loop counters.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    function->loop_counts[offset]++;
+}
+
+uint64_t profile_t_backedges(const obj_function_t *function)
+{
+    uint64_t total = 0;
+    for (int offset = 0; function->loop_counts != NULL && offset < function->chunk.count; offset++) {
+        total += function->loop_counts[offset];
+    }
+    return total;
+}
+
+static uint64_t heat(const obj_function_t *function)
+{
+    return function->call_count + profile_t_backedges(function);
+}
+
+int profile_t_hot_functions(obj_function_t **functions, const int max)
+{
+    // insertion into the sorted prefix, max is small
+    int count = 0;
+    for (obj_t *o = vm.objects; o != NULL; o = o->next) {
+        if (o->type != OBJ_FUNCTION) {
+            continue;
+        }
+        obj_function_t *function = (obj_function_t*)o;
+        const uint64_t h = heat(function);
+        if (h == 0 || (count == max && (max == 0 || h <= heat(functions[max - 1])))) {
+            continue;
+        }
+        int at = count < max ? count++ : max - 1;
+        for (; at > 0 && heat(functions[at - 1]) < h; at--) {
+            functions[at] = functions[at - 1];
+        }
+        functions[at] = function;
+    }
+    return count;
+}
+
+void profile_t_hot_report(FILE *f, const int limit)
+{
+    obj_function_t **functions = malloc(sizeof *functions * (limit > 0 ? limit : 1));
+    if (functions == NULL) {
+        fprintf(stderr, "Failed to allocate profile report.\n");
+        exit(EXIT_FAILURE);
+    }
+    const int count = profile_t_hot_functions(functions, limit);
+    fprintf(f, gettext("-- hot functions --\n"));
+    fprintf(f, "%12s %12s  %s\n", gettext("calls"), gettext("backedges"), gettext("function"));
+    for (int i = 0; i < count; i++) {
+        const obj_function_t *function = functions[i];
+        fprintf(f, "%12" PRIu64 " %12" PRIu64 "  %s (line %d)\n", function->call_count, profile_t_backedges(function),
+            function->name != NULL ? function->name->chars : "<script>", chunk_t_get_line(&function->chunk, 0));
+        for (int offset = 0; function->loop_counts != NULL && offset < function->chunk.count; offset++) {
+            if (function->loop_counts[offset] > 0) {
+                // a for loop has two backedges, into the increment and back to the condition
+                fprintf(f, "%12s %12" PRIu64 "    %s %d, %s %04d\n", "", function->loop_counts[offset],
+                    gettext("loop at line"), chunk_t_get_line(&function->chunk, offset), gettext("offset"), offset);
+            }
+        }
+    }
+    free(functions);
+}
+
+volatile sig_atomic_t profile_sample_pending = 0;
+
+typedef struct {
+    char *stack; // collapsed frames, NULL for an empty slot
+    uint64_t count;
+} profile_stack_t;
+
+// one sampler per process, SIGPROF and the interval timer are too
+static struct {
+    char *path;
+    profile_stack_t *stacks; // open addressing on the collapsed stack
+    int capacity;
+    int count;
+    char *buffer;
+    size_t buffer_capacity;
+} sampler;
+
+static void profile_signal(int)
+{
+    profile_sample_pending = 1;
+}
+
+bool profile_t_sampler_start(const char *path, const int hz)
+{
+    if (path == NULL || hz <= 0 || hz > 1000000) {
+        return false;
+    }
+    sampler.path = strdup(path);
+    if (sampler.path == NULL) {
+        fprintf(stderr, "Failed to allocate profile path.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = profile_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    const struct itimerval timer = {
+        .it_interval = {.tv_sec = 0, .tv_usec = 1000000 / hz},
+        .it_value = {.tv_sec = 0, .tv_usec = 1000000 / hz},
+    };
+    if (sigaction(SIGPROF, &action, NULL) == -1 || setitimer(ITIMER_PROF, &timer, NULL) == -1) {
+        perror(path);
+        free(sampler.path);
+        sampler.path = NULL;
+        return false;
+    }
+    vm.flags |= VM_FLAG_PROFILE_SAMPLE;
+    return true;
+}
+
+static uint32_t hash_stack(const char *stack, const size_t length)
+{
+    uint32_t hash = 2166136261u; // FNV-1a, as for strings
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)stack[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static profile_stack_t *find_stack(profile_stack_t *stacks, const int capacity, const char *stack, const size_t length)
+{
+    uint32_t index = hash_stack(stack, length) & (capacity - 1);
+    for (;;) {
+        profile_stack_t *entry = &stacks[index];
+        if (entry->stack == NULL || (strncmp(entry->stack, stack, length) == 0 && entry->stack[length] == '\0')) {
+            return entry;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void count_stack(const char *stack, const size_t length)
+{
+    if (sampler.count + 1 > sampler.capacity * 3 / 4) {
+        const int capacity = sampler.capacity < 64 ? 64 : sampler.capacity * 2;
+        profile_stack_t *stacks = calloc(capacity, sizeof *stacks);
+        if (stacks == NULL) {
+            fprintf(stderr, "Failed to allocate profile samples.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < sampler.capacity; i++) {
+            if (sampler.stacks[i].stack != NULL) {
+                *find_stack(stacks, capacity, sampler.stacks[i].stack, strlen(sampler.stacks[i].stack)) = sampler.stacks[i];
+            }
+        }
+        free(sampler.stacks);
+        sampler.stacks = stacks;
+        sampler.capacity = capacity;
+    }
+
+    profile_stack_t *entry = find_stack(sampler.stacks, sampler.capacity, stack, length);
+    if (entry->stack == NULL) {
+        entry->stack = strndup(stack, length);
+        if (entry->stack == NULL) {
+            fprintf(stderr, "Failed to allocate profile samples.\n");
+            exit(EXIT_FAILURE);
+        }
+        sampler.count++;
+    }
+    entry->count++;
+}
+
+void profile_t_sample(void)
+{
+    profile_sample_pending = 0;
+    size_t length = 0;
+    for (int i = 0; i < vm.frame_count; i++) {
+        const call_frame_t *frame = &vm.frames[i];
+        const obj_function_t *function = frame->closure->function;
+        const char *name = function->name != NULL ? function->name->chars : "<script>";
+        // callers sit just past their call instruction
+        const int offset = frame->ip > function->chunk.code ? frame->ip - function->chunk.code - 1 : 0;
+
+        const size_t needed = length + strlen(name) + 16;
+        if (needed > sampler.buffer_capacity) {
+            sampler.buffer_capacity = needed * 2;
+            sampler.buffer = realloc(sampler.buffer, sampler.buffer_capacity);
+            if (sampler.buffer == NULL) {
+                fprintf(stderr, "Failed to allocate profile samples.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        length += snprintf(sampler.buffer + length, sampler.buffer_capacity - length, "%s%s:%d",
+            i ? ";" : "", name, chunk_t_get_line(&function->chunk, offset));
+    }
+    if (length > 0) {
+        count_stack(sampler.buffer, length);
+    }
+}
+
+static int compare_stacks(const void *a, const void *b)
+{
+    return strcmp(((const profile_stack_t*)a)->stack, ((const profile_stack_t*)b)->stack);
+}
+
+bool profile_t_sampler_stop(void)
+{
+    if (sampler.path == NULL) {
+        return false;
+    }
+    const struct itimerval off = {0};
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_DFL);
+    vm.flags &= ~VM_FLAG_PROFILE_SAMPLE;
+    profile_sample_pending = 0;
+
+    // packed and sorted so the same run writes the same file
+    int count = 0;
+    for (int i = 0; i < sampler.capacity; i++) {
+        if (sampler.stacks[i].stack != NULL) {
+            sampler.stacks[count++] = sampler.stacks[i];
+        }
+    }
+    if (count > 0) {
+        qsort(sampler.stacks, count, sizeof *sampler.stacks, compare_stacks);
+    }
+
+    bool ok = false;
+    FILE *f = fopen(sampler.path, "w");
+    if (f == NULL) {
+        perror(sampler.path);
+    } else {
+        for (int i = 0; i < count; i++) {
+            fprintf(f, "%s %" PRIu64 "\n", sampler.stacks[i].stack, sampler.stacks[i].count);
+        }
+        ok = fclose(f) == 0;
+        if (!ok) {
+            perror(sampler.path);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(sampler.stacks[i].stack);
+    }
+    free(sampler.stacks);
+    free(sampler.buffer);
+    free(sampler.path);
+    memset(&sampler, 0, sizeof sampler);
+    return ok;
+}
+
+typedef struct {
+    profile_time_t *time;
+    int depth;
+    uint64_t start;
+    uint64_t children; // inclusive time of the calls made from this one
+} profile_call_t;
+
+static struct {
+    profile_call_t *calls;
+    int count;
+    int capacity;
+} call_stack;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void profile_t_leave(const int depth)
+{
+    if (call_stack.count == 0 || call_stack.calls[call_stack.count - 1].depth < depth) {
+        return;
+    }
+    const uint64_t now = monotonic_ns();
+    while (call_stack.count > 0 && call_stack.calls[call_stack.count - 1].depth >= depth) {
+        const profile_call_t *call = &call_stack.calls[--call_stack.count];
+        const uint64_t elapsed = now - call->start;
+        call->time->exclusive_ns += elapsed - call->children;
+        if (--call->time->active == 0) {
+            call->time->inclusive_ns += elapsed;
+        }
+        if (call_stack.count > 0) {
+            call_stack.calls[call_stack.count - 1].children += elapsed;
+        }
+    }
+}
+
+void profile_t_enter(profile_time_t *time, const int depth)
+{
+    profile_t_leave(depth);
+    if (call_stack.count == call_stack.capacity) {
+        call_stack.capacity = call_stack.capacity < 64 ? 64 : call_stack.capacity * 2;
+        call_stack.calls = realloc(call_stack.calls, sizeof *call_stack.calls * call_stack.capacity);
+        if (call_stack.calls == NULL) {
+            fprintf(stderr, "Failed to allocate profile call stack.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    time->calls++;
+    time->active++;
+    call_stack.calls[call_stack.count++] = (profile_call_t){.time = time, .depth = depth, .start = monotonic_ns(), .children = 0};
+}
+
+static const profile_time_t *time_of(const obj_t *o)
+{
+    static const profile_time_t untimed = {0};
+    switch (o->type) {
+        case OBJ_FUNCTION: return &((const obj_function_t*)o)->time;
+        case OBJ_NATIVE: return &((const obj_native_t*)o)->time;
+        default: return &untimed;
+    }
+}
+
+static int compare_exclusive(const void *a, const void *b)
+{
+    const uint64_t x = time_of(*(obj_t* const*)a)->exclusive_ns;
+    const uint64_t y = time_of(*(obj_t* const*)b)->exclusive_ns;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int profile_t_timed(obj_t **callables, const int max)
+{
+    int count = 0, total = 0;
+    for (obj_t *o = vm.objects; o != NULL; o = o->next) {
+        total += time_of(o)->calls > 0;
+    }
+    obj_t **all = malloc(sizeof *all * (total > 0 ? total : 1));
+    if (all == NULL) {
+        fprintf(stderr, "Failed to allocate profile report.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (obj_t *o = vm.objects; o != NULL; o = o->next) {
+        if (time_of(o)->calls > 0) {
+            all[count++] = o;
+        }
+    }
+    qsort(all, count, sizeof *all, compare_exclusive);
+    count = count < max ? count : max;
+    memcpy(callables, all, sizeof *all * count);
+    free(all);
+    return count;
+}
+
+void profile_t_calls_report(FILE *f, const int limit)
+{
+    obj_t **callables = malloc(sizeof *callables * (limit > 0 ? limit : 1));
+    if (callables == NULL) {
+        fprintf(stderr, "Failed to allocate profile report.\n");
+        exit(EXIT_FAILURE);
+    }
+    const int count = profile_t_timed(callables, limit);
+    fprintf(f, gettext("-- function profile --\n"));
+    fprintf(f, "%12s %14s %14s  %s\n", gettext("calls"), gettext("inclusive ms"), gettext("exclusive ms"), gettext("function"));
+    for (int i = 0; i < count; i++) {
+        const profile_time_t *time = time_of(callables[i]);
+        fprintf(f, "%12" PRIu64 " %14.3f %14.3f  ", time->calls, time->inclusive_ns / 1e6, time->exclusive_ns / 1e6);
+        if (callables[i]->type == OBJ_NATIVE) {
+            fprintf(f, "%s (native)\n", ((obj_native_t*)callables[i])->name->chars);
+        } else {
+            const obj_function_t *function = (obj_function_t*)callables[i];
+            fprintf(f, "%s (line %d)\n", function->name != NULL ? function->name->chars : "<script>",
+                chunk_t_get_line(&function->chunk, 0));
+        }
+    }
+    free(callables);
+}
+
+#define ALLOC_BUFFER -1 // site kind for reallocate growth, object sites use their obj_type_t
+
+typedef struct {
+    const obj_function_t *function; // NULL outside any call, while compiling
+    char *name; // copied, the function may be freed before the report
+    int line;
+    int kind;
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t survivors; // objects from here still reachable at a collection
+    uint64_t survivor_bytes;
+} profile_site_t;
+
+typedef struct {
+    const obj_t *object; // NULL for an empty slot
+    int site; // -1 once freed, a tombstone
+    bool survived;
+    size_t size;
+} profile_object_t;
+
+static struct {
+    profile_site_t *sites;
+    int count;
+    int capacity;
+    int *index; // open addressing into sites, -1 for an empty slot
+    int index_capacity;
+    profile_object_t *objects; // open addressing on the object address
+    int object_count; // live objects and tombstones
+    int object_capacity;
+} allocs;
+
+static uint32_t hash_site(const obj_function_t *function, const int line, const int kind)
+{
+    uint64_t key = (uintptr_t)function ^ ((uint64_t)(uint32_t)line << 8) ^ (uint32_t)(kind + 1);
+    key *= 0x9e3779b97f4a7c15u;
+    return (uint32_t)(key >> 32);
+}
+
+static int *find_site(int *index, const int capacity, const obj_function_t *function, const int line, const int kind)
+{
+    uint32_t slot = hash_site(function, line, kind) & (capacity - 1);
+    for (;;) {
+        const int site = index[slot];
+        if (site == -1 || (allocs.sites[site].function == function && allocs.sites[site].line == line && allocs.sites[site].kind == kind)) {
+            return &index[slot];
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+}
+
+static int *new_index(const int capacity)
+{
+    int *index = malloc(sizeof *index * capacity);
+    if (index == NULL) {
+        fprintf(stderr, "Failed to allocate allocation profile.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(index, -1, sizeof *index * capacity);
+    return index;
+}
+
+static int current_site(const int kind)
+{
+    const obj_function_t *function = NULL;
+    int line = 0;
+    if (vm.frame_count > 0 && vm.frames[vm.frame_count - 1].closure != NULL) {
+        const call_frame_t *frame = &vm.frames[vm.frame_count - 1];
+        function = frame->closure->function;
+        const int offset = frame->ip > function->chunk.code ? frame->ip - function->chunk.code - 1 : 0;
+        line = chunk_t_get_line(&function->chunk, offset);
+    }
+
+    if (allocs.count + 1 > allocs.index_capacity * 3 / 4) {
+        const int capacity = allocs.index_capacity < 64 ? 64 : allocs.index_capacity * 2;
+        int *index = new_index(capacity);
+        for (int i = 0; i < allocs.count; i++) {
+            *find_site(index, capacity, allocs.sites[i].function, allocs.sites[i].line, allocs.sites[i].kind) = i;
+        }
+        free(allocs.index);
+        allocs.index = index;
+        allocs.index_capacity = capacity;
+    }
+    int *slot = find_site(allocs.index, allocs.index_capacity, function, line, kind);
+    if (*slot != -1) {
+        return *slot;
+    }
+
+    if (allocs.count == allocs.capacity) {
+        allocs.capacity = allocs.capacity < 64 ? 64 : allocs.capacity * 2;
+        allocs.sites = realloc(allocs.sites, sizeof *allocs.sites * allocs.capacity);
+        if (allocs.sites == NULL) {
+            fprintf(stderr, "Failed to allocate allocation profile.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    const char *name = function == NULL ? "<compile>" : function->name != NULL ? function->name->chars : "<script>";
+    allocs.sites[allocs.count] = (profile_site_t){.function = function, .name = strdup(name), .line = line, .kind = kind};
+    if (allocs.sites[allocs.count].name == NULL) {
+        fprintf(stderr, "Failed to allocate allocation profile.\n");
+        exit(EXIT_FAILURE);
+    }
+    *slot = allocs.count;
+    return allocs.count++;
+}
+
+static profile_object_t *find_object(profile_object_t *objects, const int capacity, const obj_t *object)
+{
+    uint32_t slot = (uint32_t)(((uintptr_t)object >> 4) * 0x9e3779b1u) & (capacity - 1);
+    for (;;) {
+        profile_object_t *entry = &objects[slot];
+        if (entry->object == NULL || entry->object == object) {
+            return entry;
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+}
+
+void profile_t_alloc_object(const obj_t *object, const size_t size)
+{
+    const int site = current_site(object->type);
+    allocs.sites[site].count++;
+    allocs.sites[site].bytes += size;
+
+    if (allocs.object_count + 1 > allocs.object_capacity * 3 / 4) {
+        // rehashing drops the tombstones, so only grow when live objects need the room
+        int live = 0;
+        for (int i = 0; i < allocs.object_capacity; i++) {
+            live += allocs.objects[i].object != NULL && allocs.objects[i].site != -1;
+        }
+        int capacity = allocs.object_capacity < 256 ? 256 : allocs.object_capacity;
+        while (live + 1 > capacity / 2) {
+            capacity *= 2;
+        }
+        profile_object_t *objects = calloc(capacity, sizeof *objects);
+        if (objects == NULL) {
+            fprintf(stderr, "Failed to allocate allocation profile.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < allocs.object_capacity; i++) {
+            if (allocs.objects[i].object != NULL && allocs.objects[i].site != -1) {
+                *find_object(objects, capacity, allocs.objects[i].object) = allocs.objects[i];
+            }
+        }
+        free(allocs.objects);
+        allocs.objects = objects;
+        allocs.object_capacity = capacity;
+        allocs.object_count = live;
+    }
+    profile_object_t *entry = find_object(allocs.objects, allocs.object_capacity, object);
+    if (entry->object == NULL) {
+        allocs.object_count++;
+    }
+    *entry = (profile_object_t){.object = object, .site = site, .survived = false, .size = size};
+}
+
+void profile_t_alloc_growth(const size_t size)
+{
+    const int site = current_site(ALLOC_BUFFER);
+    allocs.sites[site].count++;
+    allocs.sites[site].bytes += size;
+}
+
+void profile_t_alloc_survived(const obj_t *object)
+{
+    if (allocs.object_capacity == 0) {
+        return;
+    }
+    profile_object_t *entry = find_object(allocs.objects, allocs.object_capacity, object);
+    if (entry->object == NULL || entry->site == -1 || entry->survived) {
+        return; // allocated before profiling started, or already counted
+    }
+    entry->survived = true;
+    allocs.sites[entry->site].survivors++;
+    allocs.sites[entry->site].survivor_bytes += entry->size;
+}
+
+void profile_t_alloc_freed(const obj_t *object)
+{
+    if (allocs.object_capacity == 0) {
+        return;
+    }
+    profile_object_t *entry = find_object(allocs.objects, allocs.object_capacity, object);
+    if (entry->object != NULL) {
+        entry->site = -1; // keep the slot so probing goes on past it
+    }
+}
+
+typedef int (*compare_sites_fn)(const void *, const void *);
+
+#define COMPARE_SITES(field) \
+    static int compare_sites_by_##field(const void *a, const void *b) \
+    { \
+        const uint64_t x = allocs.sites[*(const int*)a].field; \
+        const uint64_t y = allocs.sites[*(const int*)b].field; \
+        return x < y ? 1 : x > y ? -1 : 0; \
+    }
+COMPARE_SITES(count)
+COMPARE_SITES(bytes)
+COMPARE_SITES(survivors)
+#undef COMPARE_SITES
+
+static void alloc_table(FILE *f, const char *title, int *order, const compare_sites_fn compare, const bool survivors, const int limit)
+{
+    int count = 0;
+    for (int i = 0; i < allocs.count; i++) {
+        if (!survivors || allocs.sites[i].survivors > 0) {
+            order[count++] = i;
+        }
+    }
+    qsort(order, count, sizeof *order, compare);
+    fprintf(f, "%s\n", title);
+    if (survivors) {
+        fprintf(f, "%12s %14s %12s  %-16s %s\n", gettext("survivors"), gettext("bytes"), gettext("allocated"), gettext("type"), gettext("site"));
+    } else {
+        fprintf(f, "%12s %14s %12s  %-16s %s\n", gettext("count"), gettext("bytes"), gettext("survivors"), gettext("type"), gettext("site"));
+    }
+    for (int i = 0; i < count && i < limit; i++) {
+        const profile_site_t *site = &allocs.sites[order[i]];
+        const char *kind = site->kind == ALLOC_BUFFER ? "buffer" : obj_type_names[site->kind];
+        if (survivors) {
+            fprintf(f, "%12" PRIu64 " %14" PRIu64 " %12" PRIu64 "  %-16s %s", site->survivors, site->survivor_bytes,
+                site->count, kind, site->name);
+        } else {
+            fprintf(f, "%12" PRIu64 " %14" PRIu64 " %12" PRIu64 "  %-16s %s", site->count, site->bytes,
+                site->survivors, kind, site->name);
+        }
+        if (site->function != NULL) {
+            fprintf(f, ":%d", site->line);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+void profile_t_alloc_report(FILE *f, const int limit)
+{
+    int *order = malloc(sizeof *order * (allocs.count > 0 ? allocs.count : 1));
+    if (order == NULL) {
+        fprintf(stderr, "Failed to allocate allocation report.\n");
+        exit(EXIT_FAILURE);
+    }
+    alloc_table(f, gettext("-- allocation sites by count --"), order, compare_sites_by_count, false, limit);
+    alloc_table(f, gettext("-- allocation sites by bytes --"), order, compare_sites_by_bytes, false, limit);
+    alloc_table(f, gettext("-- allocation sites surviving a collection --"), order, compare_sites_by_survivors, true, limit);
+    free(order);
+}
+#undef ALLOC_BUFFER
+
+static FILE *perf_map = NULL;
+
+bool profile_t_perf_map_open(void)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/tmp/perf-%ld.map", (long)getpid());
+    perf_map = fopen(path, "w");
+    if (perf_map == NULL) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+void profile_t_perf_map_add(const void *code, const size_t size, const obj_function_t *function)
+{
+    if (perf_map == NULL) {
+        return;
+    }
+    // perf reads the map when it reports, after we may have exited, so each line goes out whole
+    fprintf(perf_map, "%" PRIxPTR " %zx tater:%s:%d\n", (uintptr_t)code, size,
+        function->name != NULL ? function->name->chars : "<script>", chunk_t_get_line(&function->chunk, 0));
+    fflush(perf_map);
+}
+
+bool profile_t_perf_map_close(void)
+{
+    if (perf_map == NULL) {
+        return false;
+    }
+    const bool ok = fclose(perf_map) == 0;
+    perf_map = NULL;
+    return ok;
+}
+
+#ifdef TATER_OPSTATS
+profile_opstats_t profile_opstats;
+
+typedef struct {
+    uint64_t count;
+    uint8_t previous;
+    uint8_t op;
+} profile_op_count_t;
+
+static int compare_op_counts(const void *a, const void *b)
+{
+    const uint64_t x = ((const profile_op_count_t*)a)->count;
+    const uint64_t y = ((const profile_op_count_t*)b)->count;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static const char *op_name(const uint8_t op)
+{
+    return op < INVALID_OPCODE ? op_code_name[op] : "?";
+}
+
+void profile_t_opstats_report(FILE *f, const int limit)
+{
+    profile_op_count_t ops[UINT8_COUNT];
+    uint64_t total = 0;
+    int count = 0;
+    for (int op = 0; op < UINT8_COUNT; op++) {
+        if (profile_opstats.ops[op] > 0) {
+            ops[count++] = (profile_op_count_t){.count = profile_opstats.ops[op], .op = op};
+            total += profile_opstats.ops[op];
+        }
+    }
+    qsort(ops, count, sizeof *ops, compare_op_counts);
+    fprintf(f, gettext("-- opcodes --\n"));
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%14" PRIu64 " %6.2f%%  %s\n", ops[i].count, 100.0 * ops[i].count / total, op_name(ops[i].op));
+    }
+
+    profile_op_count_t *pairs = malloc(sizeof *pairs * UINT8_COUNT * UINT8_COUNT);
+    if (pairs == NULL) {
+        fprintf(stderr, "Failed to allocate opcode report.\n");
+        exit(EXIT_FAILURE);
+    }
+    count = 0;
+    for (int previous = 0; previous < UINT8_COUNT; previous++) {
+        for (int op = 0; op < UINT8_COUNT; op++) {
+            if (profile_opstats.pairs[previous][op] > 0) {
+                pairs[count++] = (profile_op_count_t){.count = profile_opstats.pairs[previous][op], .previous = previous, .op = op};
+            }
+        }
+    }
+    qsort(pairs, count, sizeof *pairs, compare_op_counts);
+    // the first instruction ever run pairs with opcode 0, which is one count off at most
+    fprintf(f, gettext("-- opcode pairs --\n"));
+    for (int i = 0; i < count && i < limit; i++) {
+        fprintf(f, "%14" PRIu64 " %6.2f%%  %s %s\n", pairs[i].count, 100.0 * pairs[i].count / total,
+            op_name(pairs[i].previous), op_name(pairs[i].op));
+    }
+    free(pairs);
+}
+#endif
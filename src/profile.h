@@ -0,0 +1,120 @@
+#ifndef tater_profile_h
+#define tater_profile_h
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "type.h"
+
+#define PROFILE_HOT_LIMIT 20 // functions listed by the --profile-hot report
+#define PROFILE_SAMPLE_HZ 997 // default --profile rate, off the round numbers other timers tick at
+#define PROFILE_CALLS_LIMIT 30 // functions listed by the --profile-calls report and profile_dump()
+#define PROFILE_OPSTATS_LIMIT 40 // opcode pairs listed by the --opstats report
+#define PROFILE_ALLOC_LIMIT 20 // sites listed in each table of the --alloc-profile report
+
+/*
+ * Hot spot counters: with vm_toggle_profile_hot the VM counts the calls of
+ * every function (obj_function_t.call_count) and the backedges taken by each
+ * of its loops (obj_function_t.loop_counts). Functions are not compiled by the
+ * JIT while counting, so every iteration is seen.
+ */
+void profile_t_count_backedge(obj_function_t *function, const int offset);
+uint64_t profile_t_backedges(const obj_function_t *function);
+// the live functions with any count, hottest (calls plus backedges) first, up to max of them
+int profile_t_hot_functions(obj_function_t **functions, const int max);
+void profile_t_hot_report(FILE *f, const int limit);
+
+/*
+ * Sampling profiler: SIGPROF only marks a sample as pending, the VM takes it
+ * at the next call or loop backedge where every frame's ip is current, by
+ * calling profile_t_sample. Stacks are written as collapsed lines
+ * ("<script>:12;outer:3;inner:1 42") for flamegraph.pl or speedscope.
+ */
+extern volatile sig_atomic_t profile_sample_pending;
+bool profile_t_sampler_start(const char *path, const int hz);
+void profile_t_sample(void);
+bool profile_t_sampler_stop(void);
+
+/*
+ * Function profiler: with vm_toggle_profile_calls the VM calls
+ * profile_t_enter for every closure call and native call and profile_t_leave
+ * on return, timing them with the monotonic clock into the profile_time_t of
+ * the function or native. Calls are keyed by frame depth, so leaving a depth
+ * also closes anything above it that a tail call replaced or an error
+ * unwound. A native sits between its caller's frame and any frame it calls
+ * back into, so depths count two per frame.
+ */
+#define PROFILE_FRAME_DEPTH(frame_count) ((frame_count) * 2)
+#define PROFILE_NATIVE_DEPTH(frame_count) ((frame_count) * 2 + 1) // called from the frame_count'th frame
+void profile_t_enter(profile_time_t *time, const int depth);
+void profile_t_leave(const int depth);
+// the callables with any completed call, most exclusive time first, up to max of them
+int profile_t_timed(obj_t **callables, const int max);
+void profile_t_calls_report(FILE *f, const int limit);
+
+/*
+ * Allocation sites: with vm_toggle_alloc_profile allocate_object and the
+ * growth paths of reallocate charge each allocation to its site, the running
+ * function and line plus the object type (or "buffer" for arrays, tables and
+ * strings growing). run() keeps the current frame's ip up to date meanwhile.
+ * Objects are remembered until they are freed, so sweep can tell which sites
+ * allocate objects that live through a collection.
+ */
+void profile_t_alloc_object(const obj_t *object, const size_t size);
+void profile_t_alloc_growth(const size_t size);
+void profile_t_alloc_survived(const obj_t *object);
+void profile_t_alloc_freed(const obj_t *object);
+void profile_t_alloc_report(FILE *f, const int limit);
+
+/*
+ * perf map: profile_t_perf_map_open creates /tmp/perf-<pid>.map, where
+ * Linux perf looks up symbols for code it finds no ELF file for, and the JIT
+ * adds a line for every function it installs, so perf report shows native
+ * code as tater:<function>:<line> instead of an unknown address.
+ */
+bool profile_t_perf_map_open(void);
+void profile_t_perf_map_add(const void *code, const size_t size, const obj_function_t *function);
+bool profile_t_perf_map_close(void);
+
+#ifdef TATER_OPSTATS
+/*
+ * Opcode statistics, built with -Dopstats=true: --opstats gives run() a
+ * dispatch table that counts each executed opcode and each pair of
+ * consecutive ones before going on to the instruction.
+ */
+typedef struct {
+    uint64_t ops[UINT8_COUNT];
+    uint64_t pairs[UINT8_COUNT][UINT8_COUNT]; // [previous][current]
+    uint8_t previous;
+} profile_opstats_t;
+
+extern profile_opstats_t profile_opstats;
+
+static inline void profile_t_count_op(const uint8_t op)
+{
+    profile_opstats.ops[op]++;
+    profile_opstats.pairs[profile_opstats.previous][op]++;
+    profile_opstats.previous = op;
+}
+
+void profile_t_opstats_report(FILE *f, const int limit);
+#endif
+
+#endif
@@ -17,6 +17,7 @@
  */
 
 
+#define _GNU_SOURCE
 #include <stdbool.h>
 #include <string.h>
 
@@ -32,10 +33,21 @@ typedef struct {
 static scanner_t scanner;
 
 void scanner_t_init(const char *source)
+{
+    scanner_t_init_at_line(source, 1);
+}
+
+void scanner_t_init_at_line(const char *source, const int line)
 {
     scanner.start = source;
     scanner.current = source;
-    scanner.line = 1;
+    scanner.line = line;
+}
+
+// unsigned so -ftrapv does not turn every token length into a libgcc call
+static int span(const char *from, const char *to)
+{
+    return (int)((uintptr_t)to - (uintptr_t)from);
 }
 
 static token_t make_token(const token_type_t type)
@@ -43,7 +55,7 @@ static token_t make_token(const token_type_t type)
     token_t token;
     token.type = type;
     token.start = scanner.start;
-    token.length = (int)(scanner.current - scanner.start);
+    token.length = span(scanner.start, scanner.current);
     token.line = scanner.line;
     return token;
 }
@@ -86,45 +98,51 @@ static char peek_next(void) {
     return scanner.current[1];
 }
 
+// works on a local cursor so the loops are not reloading scanner.current through char aliasing
 static void skip_whitespace(void)
 {
+    const char *current = scanner.current;
     for (;;) {
-        char c = peek();
-        switch (c) {
+        switch (*current) {
             case ' ':
             case '\r':
             case '\t': {
-                advance();
+                current++;
+                while (*current == ' ') current++; // indentation
                 break;
             }
             case '\n': {
                 scanner.line++;
-                advance();
+                current++;
                 break;
             }
             case '#': {
-                while (peek() != '\n' && !is_at_end()) advance();
+                current = strchrnul(current, '\n');
                 break;
             }
             case '/': {
-                if (peek_next() == '/') {
-                    while (peek() != '\n' && !is_at_end()) advance();
-                } else {
-                    return;
+                if (current[1] == '/') {
+                    current = strchrnul(current, '\n');
+                    break;
                 }
-                break;
+                scanner.current = current;
+                return;
+            }
+            default: {
+                scanner.current = current;
+                return;
             }
-            default: return;
         }
     }
 }
 
 static token_t string(void)
 {
-    while (peek() != '"' && !is_at_end()) {
-        if (peek() == '\n') scanner.line++;
-        advance();
+    const char *end = strchrnul(scanner.current, '"');
+    for (const char *nl = scanner.current; (nl = memchr(nl, '\n', (uintptr_t)end - (uintptr_t)nl)) != NULL; nl++) {
+        scanner.line++;
     }
+    scanner.current = end;
     if (is_at_end())
         return error_token(gettext("Unterminated string."));
     advance();
@@ -134,7 +152,7 @@ static token_t string(void)
 
 static bool is_digit(const char c)
 {
-    return c >= '0' && c <= '9';
+    return (unsigned char)(c - '0') < 10;
 }
 static bool is_hexdigit(const char c)
 {
@@ -179,107 +197,67 @@ static token_t number(void)
 
 static bool is_alpha(const char c)
 {
-    return (c >= 'a' && c <='z') || (c >= 'A' && c<= 'Z') || c == '_';
+    return (unsigned char)((c | 0x20) - 'a') < 26 || c == '_';
 }
 
-static token_type_t check_keyword(int start, int length, const char *rest, token_type_t type)
-{
-    if (scanner.current - scanner.start == start + length && memcmp(scanner.start+start, rest, length) == 0) {
-        return type;
-    }
-    return TOKEN_IDENTIFIER;
-}
+typedef struct {
+    const char *name;
+    int length;
+    token_type_t type;
+} keyword_t;
+
+/*
+ * Perfect hash over the first two characters and the length. If a keyword
+ * is added the multipliers need to be searched for again so every keyword
+ * still lands in its own slot.
+ */
+#define KEYWORD_HASH(s, length) ((((unsigned)(unsigned char)(s)[0] * 2u) + ((unsigned)(unsigned char)(s)[1] * 25u) + ((unsigned)(length) * 6u)) & 63u)
+#define KEYWORD_MIN_LEN 2
+#define KEYWORD_MAX_LEN 8
+
+static const keyword_t keywords[64] = {
+    [4] = {"break", 5, TOKEN_BREAK},
+    [7] = {"let", 3, TOKEN_LET},
+    [10] = {"error", 5, TOKEN_PERROR},
+    [12] = {"or", 2, TOKEN_OR},
+    [13] = {"continue", 8, TOKEN_CONTINUE},
+    [15] = {"default", 7, TOKEN_DEFAULT},
+    [17] = {"type", 4, TOKEN_TYPE},
+    [18] = {"and", 3, TOKEN_AND},
+    [20] = {"if", 2, TOKEN_IF},
+    [22] = {"fn", 2, TOKEN_FN},
+    [23] = {"case", 4, TOKEN_CASE},
+    [26] = {"exit", 4, TOKEN_EXIT},
+    [27] = {"self", 4, TOKEN_SELF},
+    [32] = {"print", 5, TOKEN_PRINT},
+    [33] = {"assert", 6, TOKEN_ASSERT},
+    [34] = {"true", 4, TOKEN_TRUE},
+    [35] = {"false", 5, TOKEN_FALSE},
+    [37] = {"return", 6, TOKEN_RETURN},
+    [41] = {"switch", 6, TOKEN_SWITCH},
+    [46] = {"else", 4, TOKEN_ELSE},
+    [47] = {"nil", 3, TOKEN_NIL},
+    [49] = {"super", 5, TOKEN_SUPER},
+    [52] = {"while", 5, TOKEN_WHILE},
+    [53] = {"for", 3, TOKEN_FOR},
+};
+
 static token_type_t identifier_type(void)
 {
-    switch (scanner.start[0]) {
-        case 'a': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'n': return check_keyword(2, 1, "d", TOKEN_AND);
-                    case 's': return check_keyword(2, 4, "sert", TOKEN_ASSERT);
-                    default: ; // default returned below
-                }
-            }
-            break;
-        }
-        case 'b': return check_keyword(1, 4, "reak", TOKEN_BREAK);
-        case 'c': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a': return check_keyword(2, 2, "se", TOKEN_CASE);
-                    case 'o': return check_keyword(2, 6, "ntinue", TOKEN_CONTINUE);
-                    default: ; // default returned below
-                }
-            }
-            break;
-        }
-        case 'd': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'e': return check_keyword(2, 5, "fault", TOKEN_DEFAULT);
-                    default: ; // default returned below
-                }
-            }
-            break;
-        }
-        case 'e': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'l': return check_keyword(2, 2, "se", TOKEN_ELSE);
-                    case 'x': return check_keyword(2, 2, "it", TOKEN_EXIT);
-                    case 'r': return check_keyword(2, 3, "ror", TOKEN_PERROR);
-                    default: ; // default returned below
-                }
-            }
-            break;
-        }
-        case 'f': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a': return check_keyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o': return check_keyword(2, 1, "r", TOKEN_FOR);
-                    case 'n': return TOKEN_FN;
-                    default: ; // default returned below
-                }
-            }
-            break;
-        }
-        case 'i': return check_keyword(1, 1, "f", TOKEN_IF);
-        case 'l': return check_keyword(1, 2, "et", TOKEN_LET);
-        case 'n': return check_keyword(1, 2, "il", TOKEN_NIL);
-        case 'o': return check_keyword(1, 1, "r", TOKEN_OR);
-        case 'p': return check_keyword(1, 4, "rint", TOKEN_PRINT);
-        case 'r': return check_keyword(1, 5, "eturn", TOKEN_RETURN);
-        case 's': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'e': return check_keyword(2, 2, "lf", TOKEN_SELF);
-                    case 'u': return check_keyword(2, 3, "per", TOKEN_SUPER);
-                    case 'w': return check_keyword(2, 4, "itch", TOKEN_SWITCH);
-                    default: ;  // default returned below
-                }
-            }
-            break;
-        }
-        case 't': {
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'r': return check_keyword(2, 2, "ue", TOKEN_TRUE);
-                    case 'y': return check_keyword(2, 2, "pe", TOKEN_TYPE);
-                    default: ;  // default returned below
-                }
-            }
-            break;
-        }
-        case 'w': return check_keyword(1, 4, "hile", TOKEN_WHILE);
-        default: ; // default return below
-    }
+    const int length = span(scanner.start, scanner.current);
+    if (length < KEYWORD_MIN_LEN || length > KEYWORD_MAX_LEN)
+        return TOKEN_IDENTIFIER;
+    const keyword_t *keyword = &keywords[KEYWORD_HASH(scanner.start, length)];
+    if (keyword->length == length && memcmp(keyword->name, scanner.start, length) == 0)
+        return keyword->type;
     return TOKEN_IDENTIFIER;
 }
 
 static token_t identifier(void)
 {
-    while (is_alpha(peek()) || is_digit(peek())) advance();
+    const char *current = scanner.current;
+    while (is_alpha(*current) || is_digit(*current)) current++;
+    scanner.current = current;
     return make_token(identifier_type());
 }
 
@@ -377,3 +355,8 @@ token_t scanner_t_scan_token(void)
         default: return error_token(gettext("Unexpected character."));
     }
 }
+
+#undef KEYWORD_HASH
+#undef KEYWORD_MIN_LEN
+#undef KEYWORD_MAX_LEN
+
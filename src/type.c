@@ -22,6 +22,7 @@
 
 #include "debug.h"
 #include "memory.h"
+#include "profile.h"
 #include "type.h"
 #include "vm.h"
 
@@ -31,14 +32,18 @@
 static obj_t *allocate_object(const size_t size, const obj_type_t type)
 {
     assert(!vm_gc_active()); // attempt to catch us allocating during garbage collection
-    obj_t *object = (obj_t*)reallocate(NULL, 0, size);
+    obj_t *object = (obj_t*)reallocate_object(size);
     object->type = type;
     object->is_marked = false;
     object->next = vm.objects; // add to our vm's linked list of objects so we always have a reference to it
     vm.objects = object;
+    vm.counters.allocations++;
     if (vm.flags & VM_FLAG_GC_TRACE) {
         printf("%p allocate %zu for %s\n", (void*)object, size, obj_type_names[type]);
     }
+    if (vm.flags & VM_FLAG_ALLOC_PROFILE) {
+        profile_t_alloc_object(object, size);
+    }
     return object;
 }
 
@@ -117,6 +122,7 @@ obj_file_t *obj_file_t_allocate(obj_string_t *path, obj_string_t *mode)
     }
 
     file->fd = fd;
+    vm.counters.open_files++;
     file->path = path;
     file->mode = mode;
 
@@ -142,7 +148,14 @@ obj_function_t *obj_function_t_allocate(void)
     obj_function_t *function = ALLOCATE_OBJ(obj_function_t, OBJ_FUNCTION);
     function->arity = 0;
     function->upvalue_count = 0;
+    function->max_slots = 0;
     function->name = NULL;
+    function->lazy = NULL;
+    function->jit = NULL;
+    function->hotness = 0;
+    function->call_count = 0;
+    function->loop_counts = NULL;
+    function->time = (profile_time_t){0};
     chunk_t_init(&function->chunk);
     return function;
 }
@@ -153,6 +166,7 @@ obj_native_t *obj_native_t_allocate(native_fn_t function, const obj_string_t *na
     native->name = name;
     native->arity = arity;
     native->function = function;
+    native->time = (profile_time_t){0};
     return native;
 }
 
@@ -171,7 +185,7 @@ static obj_string_t *allocate_string(char *chars, const int length, const uint32
     return string;
 }
 
-static uint32_t hash_string(const char *key, const int length)
+uint32_t hash_string(const char *key, const int length)
 {
     uint32_t hash = 2166136261u;
     for (int i = 0; i < length; i++) {
@@ -562,9 +576,9 @@ bool table_t_delete(table_t *table, const value_t key)
     if (IS_EMPTY(table_entry->key))
         return false;
 
-    // place a tombstone table_entry
+    // place a tombstone table_entry, told apart from a never used one by its value so probing goes on past it
     table_entry->key = EMPTY_VAL;
-    table_entry->value = NIL_VAL;
+    table_entry->value = TRUE_VAL;
     return true;
 }
 
@@ -588,7 +602,11 @@ obj_string_t *table_t_find_key_by_str(const table_t *table, const char *chars, c
         table_entry_t *table_entry = &table->entries[index];
 
         if (IS_EMPTY(table_entry->key)) {
-            return NULL;
+            if (IS_NIL(table_entry->value)) {
+                return NULL;
+            }
+            index = (index + 1) & (table->capacity - 1);
+            continue; // a tombstone
         }
         obj_string_t *string = AS_STRING(table_entry->key);
         if (string->hash == hash && string->length == length && memcmp(string->chars, chars, length) == 0) {
@@ -671,6 +689,15 @@ void chunk_t_write(chunk_t *chunk, const uint8_t byte, const int line)
     line_info->line = line;
 }
 
+// drop every instruction from count onward, used when the compiler rewrites code it just emitted
+void chunk_t_truncate(chunk_t *chunk, const int count)
+{
+    chunk->count = count;
+    while (chunk->line_count > 0 && chunk->lines[chunk->line_count - 1].offset >= count) {
+        chunk->line_count--;
+    }
+}
+
 int chunk_t_get_line(const chunk_t *chunk, const int instruction)
 {
     int start = 0;
@@ -729,20 +756,5 @@ void value_t_mark(value_t value)
         obj_t_mark(AS_OBJ(value));
 }
 
-/* Used by OP_CONSTANT_LONG
-void write_constant(chunk_t *chunk, const value_t value, const int line)
-{
-    int index = chunk_t_add_constant(chunk, value);
-    if (index < 256) {
-        chunk_t_write(chunk, OP_CONSTANT, line);
-        chunk_t_write(chunk, (uint8_t)index, line);
-    } else {
-        chunk_t_write(chunk, OP_CONSTANT_LONG, line);
-        chunk_t_write(chunk, (uint8_t)(index & 0xff), line);
-        chunk_t_write(chunk, (uint8_t)((index >> 8) & 0xff), line);
-        chunk_t_write(chunk, (uint8_t)((index >> 16) & 0xff), line);
-    }
-}
-*/
 #undef TABLE_MAX_LOAD
 #undef ALLOCATE_OBJ
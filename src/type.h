@@ -170,12 +170,37 @@ typedef struct {
     table_entry_t *entries;
 } table_t;
 
+typedef struct {
+    obj_string_t *source; // "(parameters) { body }", compiled on the first call
+    value_list_t upvalue_names; // captured while skimming, in upvalue index order
+    int line;
+    uint8_t function_type;
+    bool in_type;
+    bool has_supertype;
+} lazy_function_t;
+
+// time spent in a function or native, maintained only while VM_FLAG_PROFILE_CALLS is set, see profile.h
+typedef struct {
+    uint64_t calls;
+    uint64_t inclusive_ns;
+    uint64_t exclusive_ns;
+    int active; // its calls still running, so recursion adds inclusive time once
+} profile_time_t;
+
 typedef struct {
     obj_t obj;
     int arity;
     int upvalue_count;
+    int max_slots; // locals at the deepest point of the body, for the stack room a call needs
     chunk_t chunk;
     obj_string_t *name;
+    lazy_function_t *lazy; // NULL once compiled
+    struct jit *jit; // native code once hot, see jit.h
+    int hotness;
+    // maintained only while VM_FLAG_PROFILE_HOT is set, see profile.h
+    uint64_t call_count;
+    uint64_t *loop_counts; // backedges taken by each OP_LOOP, indexed by its offset
+    profile_time_t time;
 } obj_function_t;
 
 typedef bool (*native_fn_t)(const int arg_count, const value_t *args);
@@ -185,6 +210,7 @@ typedef struct {
     int arity;
     const obj_string_t *name;
     native_fn_t function;
+    profile_time_t time;
 } obj_native_t;
 
 typedef struct obj_upvalue {
@@ -261,6 +287,7 @@ obj_file_t *obj_file_t_allocate(obj_string_t *path, obj_string_t *mode);
 
 obj_string_t *obj_string_t_copy_own(char *chars, const int length, const bool intern);
 obj_string_t *obj_string_t_copy_from(const char *chars, const int length, const bool intern);
+uint32_t hash_string(const char *key, const int length);
 void obj_t_print(FILE *stream, const value_t value);
 obj_string_t *obj_t_to_obj_string_t(const value_t value);
 void obj_t_mark(obj_t *obj);
@@ -292,6 +319,7 @@ void table_t_copy_to(const table_t *from, table_t *to);
 void chunk_t_init(chunk_t *chunk);
 void chunk_t_free(chunk_t *chunk);
 void chunk_t_write(chunk_t *chunk, const uint8_t byte, const int line);
+void chunk_t_truncate(chunk_t *chunk, const int count);
 int chunk_t_add_constant(chunk_t *chunk, const value_t value);
 int chunk_t_get_line(const chunk_t *chunk, const int instruction);
 
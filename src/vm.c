@@ -29,11 +29,16 @@
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "jit.h"
 #include "memory.h"
+#include "metrics.h"
+#include "probes.h"
+#include "profile.h"
 #include "type.h"
 #include "vm.h"
 
 #define GC_HEAP_GROW_FACTOR 2
+#define TRACE_EDGE_FRAMES 10 // a deeper stack trace prints this many innermost and outermost frames
 
 vm_t vm;
 
@@ -52,12 +57,76 @@ void vm_toggle_stack_trace(void)
     vm.flags ^= VM_FLAG_STACK_TRACE;
 }
 
+void vm_toggle_lazy_compile(void)
+{
+    vm.flags ^= VM_FLAG_LAZY_COMPILE;
+}
+
+void vm_toggle_jit(void)
+{
+    vm.flags ^= VM_FLAG_JIT;
+}
+
+void vm_toggle_jit_stencils(void)
+{
+    vm.flags ^= VM_FLAG_JIT_STENCILS;
+}
+
+void vm_toggle_profile_hot(void)
+{
+    vm.flags ^= VM_FLAG_PROFILE_HOT;
+}
+
+void vm_toggle_profile_calls(void)
+{
+    vm.flags ^= VM_FLAG_PROFILE_CALLS;
+}
+
+void vm_toggle_alloc_profile(void)
+{
+    vm.flags ^= VM_FLAG_ALLOC_PROFILE;
+}
+
+#ifdef TATER_OPSTATS
+void vm_toggle_opstats(void)
+{
+    vm.flags ^= VM_FLAG_OPSTATS;
+}
+#endif
+
 static bool clock_native(const int, const value_t*)
 {
     vm_push(NUMBER_VAL((double)clock()));
     return true;
 }
 
+static bool profile_dump_native(const int, const value_t*)
+{
+    profile_t_calls_report(stderr, PROFILE_CALLS_LIMIT);
+    vm_push(NIL_VAL);
+    return true;
+}
+
+static uint64_t clock_ns(const clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// wall clock time, exact to within a few hundred ns as a double
+static bool time_ns_native(const int, const value_t*)
+{
+    vm_push(NUMBER_VAL((double)clock_ns(CLOCK_REALTIME)));
+    return true;
+}
+
+static bool monotonic_ns_native(const int, const value_t*)
+{
+    vm_push(NUMBER_VAL((double)clock_ns(CLOCK_MONOTONIC)));
+    return true;
+}
+
 static void reset_stack(void)
 {
     vm.stack_top = vm.stack;
@@ -65,6 +134,11 @@ static void reset_stack(void)
     vm.open_upvalues = NULL;
 }
 
+static const char *function_name(const obj_function_t *function)
+{
+    return function->name == NULL ? "script" : function->name->chars;
+}
+
 static void runtime_error(const char *format, ...)
 {
     va_list args;
@@ -74,23 +148,141 @@ static void runtime_error(const char *format, ...)
 # pragma GCC diagnostic ignored "-Wformat-security"
 # pragma GCC diagnostic ignored "-Wstrict-prototypes"
 # pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#ifdef TATER_USDT
+    if (vm.frame_count > 0) {
+        const call_frame_t *frame = &vm.frames[vm.frame_count - 1];
+        const obj_function_t *function = frame->closure->function;
+        char message[256];
+        va_list copy;
+        va_copy(copy, args);
+        vsnprintf(message, sizeof(message), format, copy); // Flawfinder: disable
+        va_end(copy);
+        TATER_PROBE_RUNTIME_ERROR(message, function_name(function),
+            chunk_t_get_line(&function->chunk, (int)(frame->ip - function->chunk.code - 1)));
+    }
+#endif
     vfprintf(stderr, format, args); // Flawfinder: disable
 # pragma GCC diagnostic pop
     va_end(args);
     fprintf(stderr, "\n");
 
     for (int i = vm.frame_count - 1; i >= 0; i--) {
+        if (i == vm.frame_count - 1 - TRACE_EDGE_FRAMES && i > TRACE_EDGE_FRAMES) {
+            const int skipped = i - TRACE_EDGE_FRAMES + 1;
+            fprintf(stderr, ngettext("... %d more frame\n", "... %d more frames\n", skipped), skipped);
+            i = TRACE_EDGE_FRAMES - 1;
+        }
         const call_frame_t *frame = &vm.frames[i];
         const obj_function_t *function = frame->closure->function;
         const size_t instruction = frame->ip - function->chunk.code - 1; // previous failed instruction
         fprintf(stderr, "[line %d] in %s\n",
             chunk_t_get_line(&function->chunk, instruction),
-            function->name == NULL ? "script" : function->name->chars
+            function_name(function)
         );
     }
     reset_stack();
 }
 
+static bool call_value(const value_t callee, const int argc);
+static vm_t_interpret_result_t run(void);
+
+// how many stretches between loop backedges run() lets go by before counting the instructions of one for --metrics
+static int sample_gap(void)
+{
+    static uint32_t state = 2463534242u; // xorshift32, random so loops cannot fall into step with the sampling
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return 1 + (int)(state % (2 * METRICS_SAMPLE_RATE - 1)); // averaging METRICS_SAMPLE_RATE
+}
+
+// INTERPRET_EXIT or INTERPRET_EXIT_OK while an exit in code a native called back into unwinds out through the native
+static vm_t_interpret_result_t native_exit = INTERPRET_OK;
+
+// why a call failed: usually a runtime error, already reported, otherwise an exit passing through a native
+static vm_t_interpret_result_t call_failed(void)
+{
+    const vm_t_interpret_result_t result = native_exit == INTERPRET_OK ? INTERPRET_RUNTIME_ERROR : native_exit;
+    native_exit = INTERPRET_OK;
+    return result;
+}
+
+// call callee with no arguments from a native, running any frame it pushes to completion in a nested run()
+static bool call_from_native(const value_t callee)
+{
+    vm_push(callee);
+    const int frame_base = vm.frame_base;
+    const int frame_count = vm.frame_count;
+    if (!call_value(callee, 0)) {
+        return false;
+    }
+    if (vm.frame_count > frame_count) {
+        vm.frame_base = frame_count;
+        const vm_t_interpret_result_t result = run();
+        vm.frame_base = frame_base;
+        if (result == INTERPRET_EXIT || result == INTERPRET_EXIT_OK) {
+            native_exit = result; // the native fails, and run() returns this instead of a runtime error
+        }
+        if (result != INTERPRET_OK) {
+            return false;
+        }
+    }
+    vm_pop(); // the result, where callee was
+    return true;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void set_number(obj_map_t *map, const char *key, const double value)
+{
+    vm_push(OBJ_VAL(obj_string_t_copy_from(key, (int)strlen(key), true)));
+    table_t_set(&map->table, vm.stack_top[-1], NUMBER_VAL(value));
+    vm_pop();
+}
+
+// bench(fn, iterations): time each call of fn after a tenth as many untimed ones, returning a map of ns per call
+static bool bench_native(const int, const value_t *args)
+{
+    // args is not used past the first call, a nested call can move the stack
+    const value_t callee = args[0];
+    if (!IS_NUMBER(args[1]) || AS_NUMBER(args[1]) < 1 || AS_NUMBER(args[1]) > INT32_MAX) {
+        runtime_error(gettext("bench requires a function and a positive number of iterations."));
+        return false;
+    }
+    const int iterations = (int)AS_NUMBER(args[1]);
+    const int warmup = iterations / 10 > 0 ? iterations / 10 : 1;
+    uint64_t *times = malloc(sizeof *times * iterations);
+    if (times == NULL) {
+        fprintf(stderr, "Failed to allocate bench timings.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = -warmup; i < iterations; i++) {
+        const uint64_t start = clock_ns(CLOCK_MONOTONIC);
+        if (!call_from_native(callee)) {
+            free(times);
+            return false;
+        }
+        if (i >= 0) {
+            times[i] = clock_ns(CLOCK_MONOTONIC) - start;
+        }
+    }
+    qsort(times, iterations, sizeof *times, compare_u64);
+
+    obj_map_t *map = obj_map_t_allocate();
+    vm_push(OBJ_VAL(map));
+    set_number(map, "iterations", iterations);
+    set_number(map, "min", times[0]);
+    set_number(map, "median", times[iterations / 2]);
+    set_number(map, "p99", times[((int64_t)iterations * 99 + 99) / 100 - 1]);
+    set_number(map, "max", times[iterations - 1]);
+    free(times);
+    return true;
+}
+
 void vm_define_native(const char *name, const native_fn_t function, const int arity)
 {
     vm_push(OBJ_VAL(obj_string_t_copy_from(name, (int)strlen(name), true)));
@@ -886,6 +1078,7 @@ static bool file_method_invoke(const obj_string_t *method, const int argc, const
                 return false;
             }
             file->fd = -1;
+            vm.counters.open_files--;
             vm_push(NIL_VAL);
             return true;
         }
@@ -991,12 +1184,24 @@ static bool file_method_invoke(const obj_string_t *method, const int argc, const
 
 void vm_t_init(void)
 {
+    vm.frames = malloc(sizeof(call_frame_t) * FRAMES_INITIAL);
+    vm.stack = malloc(sizeof(value_t) * STACK_INITIAL);
+    if (vm.frames == NULL || vm.stack == NULL) {
+        fprintf(stderr, "Failed to allocate the VM stacks.\n");
+        exit(EXIT_FAILURE);
+    }
+    vm.frame_capacity = FRAMES_INITIAL;
+    vm.frames_max = FRAMES_MAX;
+    vm.stack_end = vm.stack + STACK_INITIAL;
     reset_stack();
     vm.objects = NULL;
     vm.bytes_allocated = 0;
     vm.next_garbage_collect = 1024 * 1024;
     vm.flags = 0;
     vm.exit_status = 0;
+    vm.frame_base = 0;
+    vm.counters = (vm_counters_t){0};
+    native_exit = INTERPRET_OK;
 
     vm.gray_count = 0;
     vm.gray_capacity = 0;
@@ -1020,6 +1225,10 @@ void vm_t_init(void)
     vm_define_native("map", map_native, -1);
     vm_define_native("in", contains_native, 2);
     vm_define_native("file", file_native, 2);
+    vm_define_native("profile_dump", profile_dump_native, 0);
+    vm_define_native("time_ns", time_ns_native, 0);
+    vm_define_native("monotonic_ns", monotonic_ns_native, 0);
+    vm_define_native("bench", bench_native, 2);
 }
 
 void vm_set_argc_argv(const int argc, const char *argv[])
@@ -1089,6 +1298,8 @@ void vm_collect_garbage(void)
 {
     vm_gc_toggle_active();
     size_t before = vm.bytes_allocated;
+    const uint64_t start = clock_ns(CLOCK_MONOTONIC);
+    TATER_PROBE_GC_START(before);
     if (vm.flags & VM_FLAG_GC_TRACE) {
         printf("== start gc\n");
     }
@@ -1108,6 +1319,9 @@ void vm_collect_garbage(void)
             vm.bytes_allocated,
             vm.next_garbage_collect);
     }
+    TATER_PROBE_GC_DONE(before, vm.bytes_allocated);
+    vm.counters.gc_cycles++;
+    vm.counters.gc_ns += clock_ns(CLOCK_MONOTONIC) - start;
     vm_gc_toggle_active();
 }
 
@@ -1123,16 +1337,94 @@ static void vm_t_free_objects(void)
 
 void vm_t_free(void)
 {
+    profile_t_leave(1); // timed calls an error left open point into the heap
     table_t_free(&vm.globals);
     table_t_free(&vm.strings);
     vm.init_string = NULL; // before free_objects so it cleans it up for us
     vm_t_free_objects();
     free(vm.gray_stack);
+    free(vm.frames);
+    free(vm.stack);
+    vm.frames = NULL;
+    vm.stack = vm.stack_top = vm.stack_end = NULL;
+}
+
+void vm_set_frames_max(const int frames_max)
+{
+    vm.frames_max = frames_max;
+}
+
+/*
+ * Make room for at least needed more values. The stack moves, so every
+ * pointer into it is rebased: frame slots and the open upvalue locations.
+ */
+static void grow_stack(const size_t needed)
+{
+    const size_t count = vm.stack_top - vm.stack;
+    size_t capacity = vm.stack_end - vm.stack;
+    while (capacity < count + needed) {
+        capacity = capacity < STACK_INITIAL ? STACK_INITIAL : capacity * 2;
+    }
+    value_t *stack = malloc(sizeof(value_t) * capacity);
+    if (stack == NULL) {
+        fprintf(stderr, "Failed to reallocate the value stack.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (count > 0) {
+        memcpy(stack, vm.stack, sizeof(value_t) * count);
+    }
+    for (int i = 0; i < vm.frame_count; i++) {
+        vm.frames[i].slots = stack + (vm.frames[i].slots - vm.stack);
+    }
+    for (obj_upvalue_t *upvalue = vm.open_upvalues; upvalue != NULL; upvalue = upvalue->next) {
+        upvalue->location = stack + (upvalue->location - vm.stack);
+    }
+    free(vm.stack);
+    vm.stack = stack;
+    vm.stack_top = stack + count;
+    vm.stack_end = stack + capacity;
+}
+
+// calls check for a frame's worth of room up front so natives can hold their args pointer while pushing
+static void ensure_stack(const int slots)
+{
+    if (vm.stack_end - vm.stack_top < slots) {
+        grow_stack(slots);
+    }
+}
+
+#ifdef TATER_JIT
+// compile a function once, the first time its calls and loop iterations reach the threshold
+static inline void count_hotness(obj_function_t *function)
+{
+    if (function->hotness < JIT_THRESHOLD && ++function->hotness == JIT_THRESHOLD &&
+        (vm.flags & (VM_FLAG_JIT | VM_FLAG_JIT_STENCILS)) && !(vm.flags & (VM_FLAG_STACK_TRACE | VM_FLAG_PROFILE_HOT |
+            VM_FLAG_PROFILE_SAMPLE | VM_FLAG_OPSTATS | VM_FLAG_ALLOC_PROFILE | VM_FLAG_METRICS))) {
+        jit_t_compile(function, vm.flags & VM_FLAG_JIT_STENCILS ? JIT_STENCILS : JIT_TEMPLATES);
+    }
+}
+#endif
+
+// run native code from ip for as long as it can, returning where the interpreter continues
+static uint8_t *jit_enter(call_frame_t *frame, uint8_t *ip)
+{
+    obj_function_t *function = frame->closure->function;
+    const void *target = function->jit->entries[ip - function->chunk.code];
+    if (target == NULL) {
+        return ip;
+    }
+    // native code pushes without checking, and never more values than the chunk has bytes
+    if (vm.stack_end - vm.stack_top < function->chunk.count) {
+        grow_stack(function->chunk.count);
+    }
+    return function->jit->run(frame->slots, frame->closure, target);
 }
 
 void vm_push(const value_t value)
 {
-    assert(((uintptr_t)vm.stack_top - (uintptr_t)&vm.stack) <= (sizeof(value_t) * 256));
+    if (vm.stack_top == vm.stack_end) {
+        grow_stack(1);
+    }
     *vm.stack_top = value;
     vm.stack_top++;
 }
@@ -1160,19 +1452,53 @@ static bool call(obj_closure_t *closure, const int argc)
         runtime_error(gettext("Expected %d arguments but got %d."), closure->function->arity, argc);
         return false;
     }
-    if (vm.frame_count == FRAMES_MAX) {
+    if (vm.frame_count >= vm.frames_max) {
         runtime_error(gettext("Stack overflow."));
         return false;
     }
+    if (vm.frame_count == vm.frame_capacity) {
+        int capacity = vm.frame_capacity * 2;
+        capacity = capacity > vm.frames_max ? vm.frames_max : capacity;
+        call_frame_t *frames = realloc(vm.frames, sizeof(call_frame_t) * capacity);
+        if (frames == NULL) {
+            fprintf(stderr, "Failed to reallocate the call frames.\n");
+            exit(EXIT_FAILURE);
+        }
+        vm.frames = frames;
+        vm.frame_capacity = capacity;
+    }
+    if (closure->function->lazy != NULL && !compiler_t_compile_lazy(closure->function, vm.flags & VM_FLAG_STACK_TRACE)) {
+        runtime_error(gettext("Failed to compile %s."), closure->function->name->chars);
+        return false;
+    }
+#ifdef TATER_JIT
+    count_hotness(closure->function);
+#endif
+    if (vm.flags & VM_FLAG_PROFILE_HOT) {
+        closure->function->call_count++;
+    }
+    ensure_stack(closure->function->max_slots + UINT8_COUNT); // its locals and a byte's worth of temporaries
     call_frame_t *frame = &vm.frames[vm.frame_count++];
     frame->closure = closure;
     frame->ip = closure->function->chunk.code;
     frame->slots = vm.stack_top - argc - 1;
+    vm.counters.calls++;
+    TATER_PROBE_FUNCTION_ENTRY(function_name(closure->function), closure->function->chunk.lines[0].line, vm.frame_count);
+    if (vm.flags & VM_FLAG_PROFILE_CALLS) {
+        profile_t_enter(&closure->function->time, PROFILE_FRAME_DEPTH(vm.frame_count));
+    }
+    if (profile_sample_pending) {
+        profile_t_sample();
+    }
+    if (metrics_pending) {
+        metrics_t_write();
+    }
     return true;
 }
 
 static bool call_value(const value_t callee, const int argc)
 {
+    ensure_stack(UINT8_COUNT);
     if (IS_OBJ(callee)) {
         switch (OBJ_TYPE(callee)) {
             case OBJ_BOUND_METHOD: {
@@ -1185,6 +1511,7 @@ static bool call_value(const value_t callee, const int argc)
                 vm.stack_top[-argc - 1] = bound_native_method->receiving_instance; // swap out our instance
                 value_t *args = vm.stack_top - argc - 1;
                 vm.stack_top -= argc + 1;
+                vm.counters.calls++;
                 return bound_native_method->function(bound_native_method->name, argc + 1, args);
             }
             case OBJ_TYPECLASS: {
@@ -1208,7 +1535,16 @@ static bool call_value(const value_t callee, const int argc)
                     runtime_error(gettext("%s expected %d arguments but got %d."), native->name->chars, native->arity, argc);
                     return false;
                 }
-                if(!native->function(argc, vm.stack_top - argc)) {
+                vm.counters.calls++;
+                // natives push no frame, they are timed between their caller and any frame they call back into
+                if (vm.flags & VM_FLAG_PROFILE_CALLS) {
+                    profile_t_enter(&AS_NATIVE(callee)->time, PROFILE_NATIVE_DEPTH(vm.frame_count));
+                }
+                const bool ok = native->function(argc, vm.stack_top - argc);
+                if (vm.flags & VM_FLAG_PROFILE_CALLS) {
+                    profile_t_leave(PROFILE_NATIVE_DEPTH(vm.frame_count));
+                }
+                if (!ok) {
                     return false;
                 }
                 value_t r = vm_pop();
@@ -1235,30 +1571,35 @@ static bool invoke_from_typeobj(obj_typeobj_t *typeobj, const obj_string_t *name
 
 static bool invoke(const obj_string_t *name, const int argc)
 {
+    ensure_stack(UINT8_COUNT);
     const value_t receiving_instance = peek(argc); // instance is already on the stack for us
 
     /* dispatch to native helpers*/
     if (IS_STRING(receiving_instance)) {
         value_t *args = vm.stack_top - argc - 1;
         vm.stack_top -= argc + 1;
+        vm.counters.calls++;
         bool rv = string_method_invoke(name, argc + 1, args); // leaving arg on the stack
         return rv;
     }
     else if (IS_LIST(receiving_instance)) {
         value_t *args = vm.stack_top - argc - 1;
         vm.stack_top -= argc + 1;
+        vm.counters.calls++;
         bool rv = list_method_invoke(name, argc + 1, args); // leaving arg on the stack
         return rv;
     }
     else if (IS_MAP(receiving_instance)) {
         value_t *args = vm.stack_top - argc - 1;
         vm.stack_top -= argc + 1;
+        vm.counters.calls++;
         bool rv = map_method_invoke(name, argc + 1, args); // leaving arg on the stack
         return rv;
     }
     else if (IS_FILE(receiving_instance)) {
         value_t *args = vm.stack_top - argc - 1;
         vm.stack_top -= argc + 1;
+        vm.counters.calls++;
         bool rv = file_method_invoke(name, argc + 1, args); // leaving arg on the stack
         return rv;
     }
@@ -1372,31 +1713,31 @@ static void concatenate(void)
 
 static void dump_tracing(const call_frame_t *frame, const uint8_t *ip)
 {
-    if (vm.flags & VM_FLAG_STACK_TRACE) {
-        printf("           ");
-        for (value_t *slot = vm.stack; slot < vm.stack_top; slot++) {
-            printf("[ ");
-            value_t_print(stdout, *slot);
-            printf(" ]");
-        }
-        printf("\n");
-        chunk_t_disassemble_instruction(
-            &frame->closure->function->chunk,
-            (int)(ip - frame->closure->function->chunk.code)
-        );
-    }
+    printf("           ");
+    for (value_t *slot = vm.stack; slot < vm.stack_top; slot++) {
+        printf("[ ");
+        value_t_print(stdout, *slot);
+        printf(" ]");
+    }
+    printf("\n");
+    chunk_t_disassemble_instruction(
+        &frame->closure->function->chunk,
+        (int)(ip - frame->closure->function->chunk.code)
+    );
 }
 
 static vm_t_interpret_result_t run(void)
 {
     call_frame_t *frame = &vm.frames[vm.frame_count - 1];
     register uint8_t *ip = frame->ip;
+    uint16_t operand = 0; // index operand, one byte or two after OP_WIDE
 
 #define READ_BYTE() (*ip++)
 #define READ_SHORT() \
     (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
 #define READ_CONSTANT() (frame->closure->function->chunk.constants.values[READ_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define OPERAND_CONSTANT() (frame->closure->function->chunk.constants.values[operand])
+#define OPERAND_STRING() AS_STRING(OPERAND_CONSTANT())
 #define BINARY_OP(value_type_wrapper, op) \
     do { \
         if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
@@ -1437,10 +1778,53 @@ static vm_t_interpret_result_t run(void)
             &&OP_NOT_LABEL, &&OP_MOD_LABEL, &&OP_NEGATE_LABEL, &&OP_PRINT_LABEL, &&OP_ERROR_LABEL,
             &&OP_JUMP_LABEL, &&OP_JUMP_IF_FALSE_LABEL, &&OP_LOOP_LABEL, &&OP_CALL_LABEL, &&OP_INVOKE_LABEL,
             &&OP_SUPER_INVOKE_LABEL, &&OP_CLOSURE_LABEL, &&OP_CLOSE_UPVALUE_LABEL, &&OP_RETURN_LABEL, &&OP_EXIT_LABEL,
-            &&OP_TYPE_LABEL, &&OP_INHERIT_LABEL, &&OP_METHOD_LABEL, &&OP_FIELD_LABEL,
+            &&OP_TYPE_LABEL, &&OP_INHERIT_LABEL, &&OP_METHOD_LABEL, &&OP_FIELD_LABEL, &&OP_SWITCH_TABLE_LABEL,
+            &&OP_WIDE_LABEL, &&OP_TAIL_CALL_LABEL,
         };
-        #define DISPATCH() do { dump_tracing(frame, ip); goto *computed_goto_dispatch[READ_BYTE()]; } while (false);
-
+        # pragma GCC diagnostic ignored "-Woverride-init"
+        // OP_WIDE re-enters these just past their one byte operand read
+        static void* computed_goto_wide_dispatch[] __unused__ = {
+            [0 ... UINT8_MAX] = &&OP_WIDE_INVALID_LABEL,
+            [OP_GET_LOCAL] = &&OP_GET_LOCAL_WIDE_LABEL, [OP_SET_LOCAL] = &&OP_SET_LOCAL_WIDE_LABEL,
+            [OP_GET_GLOBAL] = &&OP_GET_GLOBAL_WIDE_LABEL, [OP_DEFINE_GLOBAL] = &&OP_DEFINE_GLOBAL_WIDE_LABEL,
+            [OP_SET_GLOBAL] = &&OP_SET_GLOBAL_WIDE_LABEL, [OP_GET_UPVALUE] = &&OP_GET_UPVALUE_WIDE_LABEL,
+            [OP_SET_UPVALUE] = &&OP_SET_UPVALUE_WIDE_LABEL, [OP_GET_PROPERTY] = &&OP_GET_PROPERTY_WIDE_LABEL,
+            [OP_SET_PROPERTY] = &&OP_SET_PROPERTY_WIDE_LABEL, [OP_GET_SUPER] = &&OP_GET_SUPER_WIDE_LABEL,
+            [OP_INVOKE] = &&OP_INVOKE_WIDE_LABEL, [OP_SUPER_INVOKE] = &&OP_SUPER_INVOKE_WIDE_LABEL,
+            [OP_CLOSURE] = &&OP_CLOSURE_WIDE_LABEL, [OP_TYPE] = &&OP_TYPE_WIDE_LABEL,
+            [OP_METHOD] = &&OP_METHOD_WIDE_LABEL, [OP_FIELD] = &&OP_FIELD_WIDE_LABEL,
+        };
+        // stack tracing sends every instruction through OP_TRACE_LABEL first, so the plain table needs no flag test
+        static void* computed_goto_trace_dispatch[] = {[0 ... UINT8_MAX] = &&OP_TRACE_LABEL};
+        // --alloc-profile stores ip in the frame before each instruction, so allocations know their line
+        static void* computed_goto_sync_dispatch[] = {[0 ... UINT8_MAX] = &&OP_SYNC_LABEL};
+        // --metrics counts the instructions of sampled stretches between loop backedges in OP_COUNT_LABEL first
+        static void* computed_goto_count_dispatch[] = {[0 ... UINT8_MAX] = &&OP_COUNT_LABEL};
+#ifdef TATER_OPSTATS
+        // --opstats sends every instruction through OP_STATS_LABEL first, default builds have no such table
+        static void* computed_goto_opstats_dispatch[] = {[0 ... UINT8_MAX] = &&OP_STATS_LABEL};
+#endif
+        // picked once per run(), flags are only toggled between interprets
+        void **dispatch = computed_goto_dispatch;
+        if (vm.flags & VM_FLAG_STACK_TRACE) dispatch = computed_goto_trace_dispatch;
+#ifdef TATER_OPSTATS
+        else if (vm.flags & VM_FLAG_OPSTATS) dispatch = computed_goto_opstats_dispatch;
+#endif
+        else if (vm.flags & VM_FLAG_ALLOC_PROFILE) dispatch = computed_goto_sync_dispatch;
+        const bool sample_instructions = dispatch == computed_goto_dispatch && (vm.flags & VM_FLAG_METRICS);
+        int stretches_left = sample_gap();
+        // loop backedges and returns end one stretch of instructions and start the next, counted or not
+        #define SAMPLE_STRETCH() do { \
+            if (sample_instructions) { \
+                dispatch = --stretches_left == 0 ? computed_goto_count_dispatch : computed_goto_dispatch; \
+                if (stretches_left == 0) stretches_left = sample_gap(); \
+            } \
+        } while (false)
+        #define DISPATCH() do { goto *dispatch[READ_BYTE()]; } while (false);
+        // functions compiled by the JIT or ahead of time (aot.c) run natively until they hand back an ip
+        #define JIT_ENTER() do { if (frame->closure->function->jit != NULL) ip = jit_enter(frame, ip); } while (false)
+
+        JIT_ENTER();
         DISPATCH();
         while (1) {
             OP_CONSTANT_LABEL: {
@@ -1452,18 +1836,19 @@ static vm_t_interpret_result_t run(void)
             OP_TRUE_LABEL: vm_push(TRUE_VAL); DISPATCH();
             OP_FALSE_LABEL: vm_push(FALSE_VAL); DISPATCH();
             OP_POP_LABEL: vm_pop(); DISPATCH();
-            OP_GET_LOCAL_LABEL: {
-                const uint8_t slot = READ_BYTE();
-                vm_push(frame->slots[slot]);
+            OP_GET_LOCAL_LABEL: operand = READ_BYTE();
+            OP_GET_LOCAL_WIDE_LABEL: {
+                vm_push(frame->slots[operand]);
                 DISPATCH();
             }
-            OP_SET_LOCAL_LABEL: {
-                const uint8_t slot = READ_BYTE();
-                frame->slots[slot] = peek(0);
+            OP_SET_LOCAL_LABEL: operand = READ_BYTE();
+            OP_SET_LOCAL_WIDE_LABEL: {
+                frame->slots[operand] = peek(0);
                 DISPATCH();
             }
-            OP_GET_GLOBAL_LABEL: {
-                const obj_string_t *name = READ_STRING();
+            OP_GET_GLOBAL_LABEL: operand = READ_BYTE();
+            OP_GET_GLOBAL_WIDE_LABEL: {
+                const obj_string_t *name = OPERAND_STRING();
                 value_t value;
                 if (!table_t_get(&vm.globals, OBJ_VAL(name), &value)) {
                     frame->ip = ip;
@@ -1473,14 +1858,16 @@ static vm_t_interpret_result_t run(void)
                 vm_push(value);
                 DISPATCH();
             }
-            OP_DEFINE_GLOBAL_LABEL: {
-                obj_string_t *name = READ_STRING();
+            OP_DEFINE_GLOBAL_LABEL: operand = READ_BYTE();
+            OP_DEFINE_GLOBAL_WIDE_LABEL: {
+                obj_string_t *name = OPERAND_STRING();
                 table_t_set(&vm.globals, OBJ_VAL(name), peek(0));
                 vm_pop();
                 DISPATCH();
             }
-            OP_SET_GLOBAL_LABEL: {
-                obj_string_t *name = READ_STRING();
+            OP_SET_GLOBAL_LABEL: operand = READ_BYTE();
+            OP_SET_GLOBAL_WIDE_LABEL: {
+                obj_string_t *name = OPERAND_STRING();
                 if (table_t_set(&vm.globals, OBJ_VAL(name), peek(0))) {
                     table_t_delete(&vm.globals, OBJ_VAL(name));
                     frame->ip = ip;
@@ -1489,36 +1876,37 @@ static vm_t_interpret_result_t run(void)
                 }
                 DISPATCH();
             }
-            OP_GET_UPVALUE_LABEL: {
-                const uint8_t slot = READ_BYTE();
-                vm_push(*frame->closure->upvalues[slot]->location);
+            OP_GET_UPVALUE_LABEL: operand = READ_BYTE();
+            OP_GET_UPVALUE_WIDE_LABEL: {
+                vm_push(*frame->closure->upvalues[operand]->location);
                 DISPATCH();
             }
-            OP_SET_UPVALUE_LABEL: {
-                const uint8_t slot = READ_BYTE();
-                *frame->closure->upvalues[slot]->location = peek(0);
+            OP_SET_UPVALUE_LABEL: operand = READ_BYTE();
+            OP_SET_UPVALUE_WIDE_LABEL: {
+                *frame->closure->upvalues[operand]->location = peek(0);
                 DISPATCH();
             }
-            OP_GET_PROPERTY_LABEL: {
+            OP_GET_PROPERTY_LABEL: operand = READ_BYTE();
+            OP_GET_PROPERTY_WIDE_LABEL: {
                 frame->ip = ip; // if it calls runtime_error, we need this restored
 
                 // native helpers
                 if (IS_STRING(peek(0))) {
-                    obj_string_t *name = READ_STRING();
+                    obj_string_t *name = OPERAND_STRING();
                     obj_bound_native_method_t *m = obj_bound_native_method_t_allocate(peek(0), name, string_method_invoke);
                     vm_pop();
                     vm_push(OBJ_VAL(m));
                     DISPATCH();
                 }
                 else if (IS_LIST(peek(0))) {
-                    obj_string_t *name = READ_STRING();
+                    obj_string_t *name = OPERAND_STRING();
                     obj_bound_native_method_t *m = obj_bound_native_method_t_allocate(peek(0), name, list_method_invoke);
                     vm_pop();
                     vm_push(OBJ_VAL(m));
                     DISPATCH();
                 }
                 else if (IS_MAP(peek(0))) {
-                    obj_string_t *name = READ_STRING();
+                    obj_string_t *name = OPERAND_STRING();
                     obj_bound_native_method_t *m = obj_bound_native_method_t_allocate(peek(0), name, map_method_invoke);
                     vm_pop();
                     vm_push(OBJ_VAL(m));
@@ -1529,7 +1917,7 @@ static vm_t_interpret_result_t run(void)
                 // otherwise native type
                 else if (IS_INSTANCE(peek(0))) {
                     obj_instance_t *instance = AS_INSTANCE(peek(0));
-                    const obj_string_t *name = READ_STRING();
+                    const obj_string_t *name = OPERAND_STRING();
 
                     // fields (priority, may shadow methods)
                     value_t value;
@@ -1549,7 +1937,7 @@ static vm_t_interpret_result_t run(void)
                 // try class fields
                 else if (IS_TYPECLASS(peek(0))) {
                     obj_typeobj_t *type = AS_TYPECLASS(peek(0));
-                    const obj_string_t *name = READ_STRING();
+                    const obj_string_t *name = OPERAND_STRING();
                     value_t type_field;
                     if (table_t_get(&type->fields, OBJ_VAL(name), &type_field)) {
                         vm_pop(); // type
@@ -1566,7 +1954,8 @@ static vm_t_interpret_result_t run(void)
                 }
                 DISPATCH();
             }
-            OP_SET_PROPERTY_LABEL: {
+            OP_SET_PROPERTY_LABEL: operand = READ_BYTE();
+            OP_SET_PROPERTY_WIDE_LABEL: {
                 frame->ip = ip;
                 if (IS_TYPECLASS(peek(1))) {
                     runtime_error(gettext("Type fields are read only."));
@@ -1576,15 +1965,16 @@ static vm_t_interpret_result_t run(void)
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 obj_instance_t *instance = AS_INSTANCE(peek(1));
-                table_t_set(&instance->fields, OBJ_VAL(READ_STRING()), peek(0)); // read name, peek the value to set
+                table_t_set(&instance->fields, OBJ_VAL(OPERAND_STRING()), peek(0)); // read name, peek the value to set
                 const value_t value = vm_pop(); // pop the value
                 vm_pop(); // pop the instance
                 vm_push(value); // push the value so we leave the value as the return
                 DISPATCH();
             }
-            OP_GET_SUPER_LABEL: {
+            OP_GET_SUPER_LABEL: operand = READ_BYTE();
+            OP_GET_SUPER_WIDE_LABEL: {
                 frame->ip = ip; // if it calls runtime_error, we need this restored
-                const obj_string_t *method_name = READ_STRING();
+                const obj_string_t *method_name = OPERAND_STRING();
                 obj_typeobj_t *super_type_obj = AS_TYPECLASS(vm_pop());
                 // NOTE this is only for methods, not fields
                 if (!bind_method(super_type_obj, method_name)) {
@@ -1676,32 +2066,94 @@ static vm_t_interpret_result_t run(void)
             }
             OP_LOOP_LABEL: {
                 const uint16_t offset = READ_SHORT();
+                if (vm.flags & VM_FLAG_PROFILE_HOT) {
+                    profile_t_count_backedge(frame->closure->function, ip - 3 - frame->closure->function->chunk.code);
+                }
+                SAMPLE_STRETCH();
                 ip -= offset;
+                if (profile_sample_pending) {
+                    frame->ip = ip;
+                    profile_t_sample();
+                }
+                if (metrics_pending) {
+                    metrics_t_write();
+                }
+#ifdef TATER_JIT
+                count_hotness(frame->closure->function);
+#endif
+                JIT_ENTER();
+                DISPATCH();
+            }
+            OP_SWITCH_TABLE_LABEL: {
+                const value_t table = READ_CONSTANT();
+                const uint16_t miss = READ_SHORT();
+                const value_t key = peek(0);
+                value_t target = NIL_VAL;
+                if (IS_LIST(table)) {
+                    const value_list_t *offsets = &AS_LIST(table)->elements;
+                    if (IS_NUMBER(key)) {
+                        const double index = AS_NUMBER(key) - AS_NUMBER(offsets->values[0]) + 1;
+                        if (index >= 1 && index < offsets->count && index == (int)index) {
+                            target = offsets->values[(int)index];
+                        }
+                    }
+                } else if (IS_NUMBER(key)) {
+                    table_t_get(&AS_MAP(table)->table, NUMBER_VAL(AS_NUMBER(key) + 0.0), &target); // -0 is 0
+                } else if (IS_STRING(key)) {
+                    table_t_get(&AS_MAP(table)->table, key, &target);
+                }
+                ip += IS_NUMBER(target) ? (uint16_t)AS_NUMBER(target) : miss;
                 DISPATCH();
             }
             OP_CALL_LABEL: {
                 const int argc = READ_BYTE();
                 frame->ip = ip;
                 if (!call_value(peek(argc), argc)) {
-                    return INTERPRET_RUNTIME_ERROR;
+                    return call_failed();
                 }
                 frame = &vm.frames[vm.frame_count - 1]; // move to new call_frame_t
                 ip = frame->ip;
+                JIT_ENTER();
                 DISPATCH();
             }
-            OP_INVOKE_LABEL: { // combined OP_GET_PROPERTY and OP_CALL
-                const obj_string_t *method_name = READ_STRING();
+            OP_TAIL_CALL_LABEL: { // OP_CALL then OP_RETURN, reusing the returning frame
+                const int argc = READ_BYTE();
+                frame->ip = ip;
+                close_upvalues(frame->slots);
+                // slide the callee and its arguments down over the returning frame
+                memmove(frame->slots, vm.stack_top - argc - 1, sizeof(value_t) * (argc + 1));
+                vm.stack_top = frame->slots + argc + 1;
+                vm.frame_count--;
+                TATER_PROBE_FUNCTION_RETURN(function_name(frame->closure->function),
+                    frame->closure->function->chunk.lines[0].line, vm.frame_count + 1);
+                if (!call_value(peek(argc), argc)) {
+                    return call_failed();
+                }
+                if (vm.frame_count <= vm.frame_base) { // a native returned for the frame a native called into
+                    return INTERPRET_OK;
+                }
+                // a closure now owns this frame, anything else already left its result as the return value
+                frame = &vm.frames[vm.frame_count - 1];
+                ip = frame->ip;
+                JIT_ENTER();
+                DISPATCH();
+            }
+            OP_INVOKE_LABEL: operand = READ_BYTE();
+            OP_INVOKE_WIDE_LABEL: { // combined OP_GET_PROPERTY and OP_CALL
+                const obj_string_t *method_name = OPERAND_STRING();
                 const int argc = READ_BYTE();
                 frame->ip = ip;
                 if (!invoke(method_name, argc)) {
-                    return INTERPRET_RUNTIME_ERROR;
+                    return call_failed();
                 }
                 frame = &vm.frames[vm.frame_count - 1]; // move to new call_frame_t
                 ip = frame->ip;
+                JIT_ENTER();
                 DISPATCH();
             }
-            OP_SUPER_INVOKE_LABEL: { // combined OP_GET_SUPER and OP_CALL
-                const obj_string_t *method_name = READ_STRING();
+            OP_SUPER_INVOKE_LABEL: operand = READ_BYTE();
+            OP_SUPER_INVOKE_WIDE_LABEL: { // combined OP_GET_SUPER and OP_CALL
+                const obj_string_t *method_name = OPERAND_STRING();
                 const int argc = READ_BYTE();
                 obj_typeobj_t *super_type_obj = AS_TYPECLASS(vm_pop());
                 frame->ip = ip;
@@ -1710,15 +2162,17 @@ static vm_t_interpret_result_t run(void)
                 }
                 frame = &vm.frames[vm.frame_count - 1]; // move to new call_frame_t
                 ip = frame->ip;
+                JIT_ENTER();
                 DISPATCH();
             }
-            OP_CLOSURE_LABEL: {
-                obj_closure_t *closure = obj_closure_t_allocate(AS_FUNCTION(READ_CONSTANT()));
+            OP_CLOSURE_LABEL: operand = READ_BYTE();
+            OP_CLOSURE_WIDE_LABEL: {
+                obj_closure_t *closure = obj_closure_t_allocate(AS_FUNCTION(OPERAND_CONSTANT()));
                 vm_push(OBJ_VAL(closure));
                 for (int i = 0; i < closure->upvalue_count; i++) {
-                    const uint8_t is_local = READ_BYTE();
-                    const uint8_t index = READ_BYTE();
-                    if (is_local) {
+                    const uint8_t flags = READ_BYTE();
+                    const int index = flags & UPVALUE_WIDE ? READ_SHORT() : READ_BYTE();
+                    if (flags & UPVALUE_LOCAL) {
                         closure->upvalues[i] = capture_upvalue(frame->slots + index);
                     } else {
                         closure->upvalues[i] = frame->closure->upvalues[index];
@@ -1735,15 +2189,26 @@ static vm_t_interpret_result_t run(void)
                 const value_t result = vm_pop();
                 close_upvalues(frame->slots); // close the remaining open upvalues owned by the returning function
                 vm.frame_count--;
-                if (vm.frame_count == 0) {
-                    vm_pop();
-                    ip = frame->ip;
+                TATER_PROBE_FUNCTION_RETURN(function_name(frame->closure->function),
+                    frame->closure->function->chunk.lines[0].line, vm.frame_count + 1);
+                if (vm.flags & VM_FLAG_PROFILE_CALLS) {
+                    profile_t_leave(PROFILE_FRAME_DEPTH(vm.frame_count + 1));
+                }
+                if (vm.frame_count <= vm.frame_base) {
+                    if (vm.frame_count == 0) {
+                        vm_pop();
+                    } else { // back to the native that called in, see call_from_native
+                        vm.stack_top = frame->slots;
+                        vm_push(result);
+                    }
                     return INTERPRET_OK;
                 }
                 vm.stack_top = frame->slots;
                 vm_push(result);
                 frame = &vm.frames[vm.frame_count - 1]; // move to new call_frame_t
                 ip = frame->ip;
+                SAMPLE_STRETCH();
+                JIT_ENTER();
                 DISPATCH();
             }
             OP_EXIT_LABEL: {
@@ -1758,8 +2223,9 @@ static vm_t_interpret_result_t run(void)
                 }
                 return INTERPRET_EXIT_OK;
             }
-            OP_TYPE_LABEL: {
-                vm_push(OBJ_VAL(obj_typeobj_t_allocate(READ_STRING())));
+            OP_TYPE_LABEL: operand = READ_BYTE();
+            OP_TYPE_WIDE_LABEL: {
+                vm_push(OBJ_VAL(obj_typeobj_t_allocate(OPERAND_STRING())));
                 DISPATCH();
             }
             OP_INHERIT_LABEL: {
@@ -1777,16 +2243,17 @@ static vm_t_interpret_result_t run(void)
                 vm_pop();
                 DISPATCH();
             }
-            OP_METHOD_LABEL: {
-                define_method(READ_STRING());
+            OP_METHOD_LABEL: operand = READ_BYTE();
+            OP_METHOD_WIDE_LABEL: {
+                define_method(OPERAND_STRING());
                 DISPATCH();
             }
-            OP_FIELD_LABEL: {
-                define_field(READ_STRING());
+            OP_FIELD_LABEL: operand = READ_BYTE();
+            OP_FIELD_WIDE_LABEL: {
+                define_field(OPERAND_STRING());
                 DISPATCH();
             }
             OP_CONSTANT_LONG_LABEL: {
-                assert(false);
                 const uint8_t p1 = READ_BYTE();
                 const uint8_t p2 = READ_BYTE();
                 const uint8_t p3 = READ_BYTE();
@@ -1797,15 +2264,51 @@ static vm_t_interpret_result_t run(void)
             }
             OP_POPN_LABEL: { uint8_t pop_count = READ_BYTE(); popn(pop_count); DISPATCH();}
             OP_DUP_LABEL: vm_push(peek(0)); DISPATCH();
+            OP_WIDE_LABEL: {
+                const uint8_t instruction = READ_BYTE();
+                operand = READ_SHORT();
+                goto *computed_goto_wide_dispatch[instruction];
+            }
+            OP_TRACE_LABEL: {
+                frame->ip = ip;
+                dump_tracing(frame, ip - 1);
+#ifdef TATER_OPSTATS
+                if (vm.flags & VM_FLAG_OPSTATS) profile_t_count_op(ip[-1]);
+#endif
+                goto *computed_goto_dispatch[ip[-1]];
+            }
+            OP_SYNC_LABEL: {
+                frame->ip = ip;
+                goto *computed_goto_dispatch[ip[-1]];
+            }
+            OP_COUNT_LABEL: {
+                vm.counters.instructions += METRICS_SAMPLE_RATE; // standing in for the stretches not sampled
+                goto *computed_goto_dispatch[ip[-1]];
+            }
+#ifdef TATER_OPSTATS
+            OP_STATS_LABEL: {
+                frame->ip = ip;
+                profile_t_count_op(ip[-1]);
+                goto *computed_goto_dispatch[ip[-1]];
+            }
+#endif
+            OP_WIDE_INVALID_LABEL: {
+                frame->ip = ip;
+                runtime_error(gettext("Invalid instruction after OP_WIDE."));
+                return INTERPRET_RUNTIME_ERROR;
+            }
         }
         # pragma GCC diagnostic pop
     }
 #undef READ_BYTE
 #undef READ_SHORT
 #undef READ_CONSTANT
-#undef READ_STRING
+#undef OPERAND_CONSTANT
+#undef OPERAND_STRING
 #undef BINARY_OP
 #undef DISPATCH
+#undef JIT_ENTER
+#undef SAMPLE_STRETCH
 }
 
 vm_t_interpret_result_t vm_t_interpret(const char *source)
@@ -1813,7 +2316,11 @@ vm_t_interpret_result_t vm_t_interpret(const char *source)
     obj_function_t *function = compiler_t_compile(source, vm.flags & VM_FLAG_STACK_TRACE);
     if (function == NULL)
         return INTERPRET_COMPILE_ERROR;
+    return vm_t_interpret_function(function);
+}
 
+vm_t_interpret_result_t vm_t_interpret_function(obj_function_t *function)
+{
     vm_push(OBJ_VAL(function));
     obj_closure_t *closure = obj_closure_t_allocate(function);
     vm_pop();
@@ -1872,6 +2379,10 @@ static void mark_objects(obj_t *object)
             obj_function_t *function = (obj_function_t*)object;
             obj_t_mark((obj_t*)function->name);
             mark_array(&function->chunk.constants);
+            if (function->lazy != NULL) {
+                obj_t_mark((obj_t*)function->lazy->source);
+                mark_array(&function->lazy->upvalue_names);
+            }
             break;
         }
         case OBJ_INSTANCE: {
@@ -1919,6 +2430,9 @@ static void vm_t_free_object(obj_t *o)
     if (vm.flags & VM_FLAG_GC_TRACE) {
         printf("%p free type %s\n", (void*)o, obj_type_names[o->type]);
     }
+    if (vm.flags & VM_FLAG_ALLOC_PROFILE) {
+        profile_t_alloc_freed(o);
+    }
     switch (o->type) {
         case OBJ_BOUND_METHOD: {
             FREE(obj_bound_method_t, o);
@@ -1944,7 +2458,13 @@ static void vm_t_free_object(obj_t *o)
         }
         case OBJ_FUNCTION: {
             obj_function_t *function = (obj_function_t*)o;
+            jit_t_free(function);
+            free(function->loop_counts);
             chunk_t_free(&function->chunk);
+            if (function->lazy != NULL) {
+                value_list_t_free(&function->lazy->upvalue_names);
+                FREE(lazy_function_t, function->lazy);
+            }
             FREE(obj_function_t, o);
             break;
         }
@@ -1982,8 +2502,10 @@ static void vm_t_free_object(obj_t *o)
         }
         case OBJ_FILE: {
             obj_file_t *f = (obj_file_t*)o;
-            if (f->fd > -1)
+            if (f->fd > -1) {
                 close(f->fd);
+                vm.counters.open_files--;
+            }
             FREE(obj_file_t, o);
             break;
         }
@@ -2026,6 +2548,9 @@ static void sweep(void)
     while (object != NULL) {
 
         if (object->is_marked) {
+            if (vm.flags & VM_FLAG_ALLOC_PROFILE) {
+                profile_t_alloc_survived(object);
+            }
             object->is_marked = false;
             previous = object;
             object = object->next;
@@ -2043,3 +2568,4 @@ static void sweep(void)
     }
 }
 #undef GC_HEAP_GROW_FACTOR
+#undef TRACE_EDGE_FRAMES
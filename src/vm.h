@@ -21,9 +21,10 @@
 #include "type.h"
 #include "vmopcodes.h"
 
-// TODO consider a more robust way to avoid stack overflows
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
+// both stacks start small and double as calls need them, up to the call depth limit
+#define FRAMES_INITIAL 8
+#define FRAMES_MAX 4096 // default call depth limit, see vm_set_frames_max
+#define STACK_INITIAL UINT8_COUNT
 
 typedef struct {
     obj_closure_t *closure;
@@ -37,13 +38,35 @@ typedef enum vm_flag {
     VM_FLAG_GC_TRACE = 0x2,
     VM_FLAG_GC_STRESS = 0x4,
     VM_FLAG_GC_ACTIVE = 0x8,
+    VM_FLAG_LAZY_COMPILE = 0x10,
+    VM_FLAG_JIT = 0x20,
+    VM_FLAG_JIT_STENCILS = 0x40,
+    VM_FLAG_PROFILE_HOT = 0x80,
+    VM_FLAG_PROFILE_SAMPLE = 0x100,
+    VM_FLAG_PROFILE_CALLS = 0x200,
+    VM_FLAG_OPSTATS = 0x400, // only in builds with -Dopstats=true
+    VM_FLAG_ALLOC_PROFILE = 0x800,
+    VM_FLAG_METRICS = 0x1000,
 } vm_flag_t;
 
+// running totals exported by --metrics, see metrics.h
 typedef struct {
-    call_frame_t frames[FRAMES_MAX];
+    uint64_t instructions; // estimated from a sample while VM_FLAG_METRICS is set
+    uint64_t calls; // closures and natives
+    uint64_t allocations; // objects
+    uint64_t gc_cycles;
+    uint64_t gc_ns; // time spent collecting
+    int open_files;
+} vm_counters_t;
+
+typedef struct {
+    call_frame_t *frames;
     int frame_count;
-    value_t stack[STACK_MAX];
+    int frame_capacity;
+    int frames_max;
+    value_t *stack;
     value_t *stack_top;
+    value_t *stack_end;
     table_t globals;
     table_t strings;
     obj_string_t *init_string;
@@ -56,6 +79,8 @@ typedef struct {
     obj_t **gray_stack;
     uint64_t flags;
     int exit_status;
+    int frame_base; // run() returns once a return leaves this many frames, above 0 while a native calls back in
+    vm_counters_t counters;
 } vm_t;
 
 typedef enum {
@@ -71,6 +96,7 @@ extern vm_t vm;
 void vm_t_init(void);
 void vm_t_free(void);
 vm_t_interpret_result_t vm_t_interpret(const char *source);
+vm_t_interpret_result_t vm_t_interpret_function(obj_function_t *function);
 void vm_push(const value_t value);
 value_t vm_pop(void);
 
@@ -82,7 +108,17 @@ void vm_inherit_env(void);
 void vm_toggle_gc_stress(void);
 void vm_toggle_gc_trace(void);
 void vm_toggle_stack_trace(void);
+void vm_toggle_lazy_compile(void);
+void vm_toggle_jit(void);
+void vm_toggle_jit_stencils(void);
+void vm_toggle_profile_hot(void);
+void vm_toggle_profile_calls(void);
+void vm_toggle_alloc_profile(void);
+#ifdef TATER_OPSTATS
+void vm_toggle_opstats(void);
+#endif
 void vm_collect_garbage(void);
+void vm_set_frames_max(const int frames_max);
 
 static inline bool vm_gc_active(void)
 {
@@ -71,10 +71,17 @@ typedef enum {
     OP_INHERIT,
     OP_METHOD,
     OP_FIELD,
+    OP_SWITCH_TABLE,
+    OP_WIDE,
+    OP_TAIL_CALL,
     OP_ASSERT,
     INVALID_OPCODE,
 } op_code_t;
 
+// OP_CLOSURE follows its function with a flags byte and an index per upvalue, the index two bytes when wide
+#define UPVALUE_LOCAL 0x1
+#define UPVALUE_WIDE 0x2 // only behind OP_WIDE, so a plain OP_CLOSURE keeps one byte indices
+
 static const char *const op_code_name[] = {
     [OP_CONSTANT] = "OP_CONSTANT",
     [OP_CONSTANT_LONG] = "OP_CONSTANT_LONG",
@@ -127,6 +134,9 @@ static const char *const op_code_name[] = {
     [OP_INHERIT] = "OP_INHERIT",
     [OP_METHOD] = "OP_METHOD",
     [OP_FIELD] = "OP_FIELD",
+    [OP_SWITCH_TABLE] = "OP_SWITCH_TABLE",
+    [OP_WIDE] = "OP_WIDE",
+    [OP_TAIL_CALL] = "OP_TAIL_CALL",
     [INVALID_OPCODE] = "INVALID_OPCODE",
 };
 
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "../src/common.h"
+#include "../src/memory.h"
+#include "../src/type.h"
+#include "../src/vm.h"
+
+// runtime primitives in isolation: tables, string hashing and interning, value lists and collections
+
+#define BENCH_OPS 200000 // operations per repetition
+#define BENCH_GC_LIVE 100000 // objects kept alive while timing collections
+#define BENCH_GC_OPS 50
+#define BENCH_WARMUP 2 // untimed repetitions first
+#define BENCH_REPEATS 9
+#define BENCH_KEY_LENGTH 16
+
+typedef struct {
+    const char *name;
+    int ops;
+    void (*setup)(void);
+    void (*run)(const int ops);
+} bench_t;
+
+static volatile uint32_t sink; // keeps results the compiler would otherwise drop
+static char (*keys)[BENCH_KEY_LENGTH + 1];
+static obj_string_t **strings;
+static table_t table;
+static value_list_t list;
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__)
+    return __rdtsc(); // reference cycles, at the nominal clock rate
+#else
+    return 0;
+#endif
+}
+
+static uint64_t nanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void make_keys(void)
+{
+    keys = malloc(sizeof *keys * BENCH_OPS);
+    strings = malloc(sizeof *strings * BENCH_OPS);
+    if (keys == NULL || strings == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    // held by a global list so collections leave them be
+    obj_list_t *held = obj_list_t_allocate();
+    table_t_set(&vm.globals, OBJ_VAL(obj_string_t_copy_from("bench_keys", 10, true)), OBJ_VAL(held));
+    for (int i = 0; i < BENCH_OPS; i++) {
+        snprintf(keys[i], sizeof keys[i], "key_%011d", i);
+        strings[i] = obj_string_t_copy_from(keys[i], BENCH_KEY_LENGTH, true);
+        value_list_t_add(&held->elements, OBJ_VAL(strings[i]));
+    }
+}
+
+static void fresh_table(void)
+{
+    table_t_free(&table);
+}
+
+static void full_table(void)
+{
+    if (table.count == 0) {
+        for (int i = 0; i < BENCH_OPS; i++) {
+            table_t_set(&table, OBJ_VAL(strings[i]), NUMBER_VAL(i));
+        }
+    }
+}
+
+static void fresh_list(void)
+{
+    value_list_t_free(&list);
+}
+
+static void table_set_numbers(const int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        table_t_set(&table, NUMBER_VAL(i), NIL_VAL);
+    }
+}
+
+static void table_set_strings(const int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        table_t_set(&table, OBJ_VAL(strings[i]), NIL_VAL);
+    }
+}
+
+static void table_get_strings(const int ops)
+{
+    uint32_t found = 0;
+    value_t value;
+    for (int i = 0; i < ops; i++) {
+        found += table_t_get(&table, OBJ_VAL(strings[i]), &value);
+    }
+    sink = found;
+}
+
+static void hash_strings(const int ops)
+{
+    uint32_t hash = 0;
+    for (int i = 0; i < ops; i++) {
+        hash ^= hash_string(keys[i], BENCH_KEY_LENGTH);
+    }
+    sink = hash;
+}
+
+static void intern_hits(const int ops)
+{
+    uint32_t hash = 0;
+    for (int i = 0; i < ops; i++) {
+        hash ^= obj_string_t_copy_from(keys[i], BENCH_KEY_LENGTH, true)->hash;
+    }
+    sink = hash;
+}
+
+static void intern_misses(const int ops)
+{
+    // keys are distinct from make_keys, and collected before the next repetition
+    char key[BENCH_KEY_LENGTH + 1];
+    uint32_t hash = 0;
+    for (int i = 0; i < ops; i++) {
+        snprintf(key, sizeof key, "new_%011d", i);
+        hash ^= obj_string_t_copy_from(key, BENCH_KEY_LENGTH, true)->hash;
+    }
+    sink = hash;
+}
+
+static void collect_misses(void)
+{
+    vm_collect_garbage();
+    vm.next_garbage_collect = SIZE_MAX;
+}
+
+static void list_add(const int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        value_list_t_add(&list, NUMBER_VAL(i));
+    }
+}
+
+static void collect(const int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        vm_collect_garbage();
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+int main(const int argc, const char *argv[])
+{
+    const char *only = argc > 1 ? argv[1] : NULL;
+    const bench_t benches[] = {
+        {"table_t_set (numbers)", BENCH_OPS, fresh_table, table_set_numbers},
+        {"table_t_set (strings)", BENCH_OPS, fresh_table, table_set_strings},
+        {"table_t_get (strings)", BENCH_OPS, full_table, table_get_strings},
+        {"hash_string (16 bytes)", BENCH_OPS, NULL, hash_strings},
+        {"obj_string_t_copy_from (interned)", BENCH_OPS, NULL, intern_hits},
+        {"obj_string_t_copy_from (new)", BENCH_OPS, collect_misses, intern_misses},
+        {"value_list_t_add", BENCH_OPS, fresh_list, list_add},
+        {"vm_collect_garbage (100k live)", BENCH_GC_OPS, NULL, collect},
+    };
+
+    vm_t_init();
+    vm.next_garbage_collect = SIZE_MAX; // only the collection benchmarks collect
+    make_keys();
+    table_t_init(&table);
+    value_list_t_init(&list);
+    char script[128];
+    snprintf(script, sizeof script, "let keep = []; for (let i = 0; i < %d; i++) { keep.append([i]); }", BENCH_GC_LIVE);
+    if (vm_t_interpret(script) != INTERPRET_OK) {
+        return EXIT_FAILURE;
+    }
+
+    printf("%-36s %14s %14s %14s\n", "", "ns/op", "min ns/op", "cycles/op");
+    for (size_t b = 0; b < sizeof benches / sizeof benches[0]; b++) {
+        const bench_t *bench = &benches[b];
+        if (only != NULL && strstr(bench->name, only) == NULL) {
+            continue;
+        }
+        uint64_t ns[BENCH_REPEATS], tsc[BENCH_REPEATS];
+        for (int r = -BENCH_WARMUP; r < BENCH_REPEATS; r++) {
+            if (bench->setup != NULL) {
+                bench->setup();
+            }
+            const uint64_t start_tsc = cycles();
+            const uint64_t start = nanoseconds();
+            bench->run(bench->ops);
+            const uint64_t end = nanoseconds();
+            const uint64_t end_tsc = cycles();
+            if (r >= 0) {
+                ns[r] = end - start;
+                tsc[r] = end_tsc - start_tsc;
+            }
+        }
+        qsort(ns, BENCH_REPEATS, sizeof ns[0], compare_u64);
+        qsort(tsc, BENCH_REPEATS, sizeof tsc[0], compare_u64);
+        printf("%-36s %14.2f %14.2f", bench->name, (double)ns[BENCH_REPEATS / 2] / bench->ops, (double)ns[0] / bench->ops);
+        if (tsc[BENCH_REPEATS / 2] > 0) {
+            printf(" %14.2f\n", (double)tsc[BENCH_REPEATS / 2] / bench->ops);
+        } else {
+            printf(" %14s\n", "-");
+        }
+    }
+
+    table_t_free(&table);
+    value_list_t_free(&list);
+    free(strings);
+    free(keys);
+    vm_t_free();
+    return EXIT_SUCCESS;
+}
+#undef BENCH_OPS
+#undef BENCH_GC_LIVE
+#undef BENCH_GC_OPS
+#undef BENCH_WARMUP
+#undef BENCH_REPEATS
+#undef BENCH_KEY_LENGTH
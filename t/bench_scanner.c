@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2022-2024 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/common.h"
+#include "../src/scanner.h"
+
+// scanner throughput over a generated script (or the file given on the command line)
+
+#define BENCH_SOURCE_SIZE (8 * 1024 * 1024)
+#define BENCH_PASSES 5
+
+static const char *const snippet = ""
+"# work counters for the residential sites\n"
+"type WorkCounter {\n"
+"    let name;\n"
+"    let counter = 0;\n"
+"    fn init(name) { self.name = name; }\n"
+"    // count the work orders we were given\n"
+"    fn work(locations) {\n"
+"        for (let i = 0; i < locations.len(); i++) {\n"
+"            self.counter++;\n"
+"            let site = locations[i][\"site\"];\n"
+"            if (site == 0x1 or site == 0b10) { print(self.name + \", location counter \" + str(self.counter)); }\n"
+"            else { while (false) { break; } }\n"
+"        }\n"
+"        return self.counter * 1_000 / 3.5;\n"
+"    }\n"
+"}\n"
+"let wc = WorkCounter(\"phase1\"); let orders = [{\"site\": 1}, {\"site\": 2}]; wc.work(orders);\n";
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static char *read_source(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    fseek(f, 0L, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    char *source = malloc(*size + 1);
+    if (source == NULL || fread(source, 1, *size, f) != *size) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    source[*size] = '\0';
+    fclose(f);
+    return source;
+}
+
+static char *generate_source(size_t *size)
+{
+    const size_t snippet_len = strlen(snippet);
+    const size_t copies = BENCH_SOURCE_SIZE / snippet_len;
+    *size = copies * snippet_len;
+    char *source = malloc(*size + 1);
+    if (source == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(source + i * snippet_len, snippet, snippet_len);
+    }
+    source[*size] = '\0';
+    return source;
+}
+
+int main(const int argc, const char *argv[])
+{
+    size_t size;
+    char *source = argc > 1 ? read_source(argv[1], &size) : generate_source(&size);
+
+    size_t tokens = 0; // unsigned keeps -ftrapv checks out of the timed loop
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        scanner_t_init(source);
+        for (;;) {
+            const token_t token = scanner_t_scan_token();
+            if (token.type == TOKEN_ERROR) {
+                fprintf(stderr, "line %d: %.*s\n", token.line, token.length, token.start);
+                return EXIT_FAILURE;
+            }
+            tokens++;
+            if (token.type == TOKEN_EOF)
+                break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const double seconds = elapsed(&start, &end);
+    const double megabytes = (double)size * BENCH_PASSES / (1024.0 * 1024.0);
+    printf("scanner: %.1f MB/s, %.1f Mtokens/s (%zu bytes x %d passes in %.3fs)\n",
+        megabytes / seconds, (double)tokens / seconds / 1e6, size, BENCH_PASSES, seconds);
+    free(source);
+    return EXIT_SUCCESS;
+}
+#undef BENCH_SOURCE_SIZE
+#undef BENCH_PASSES
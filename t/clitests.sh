@@ -38,7 +38,70 @@ TEST_TMPDIR=$(mktemp -d)
 trap "rm -rf ${TEST_TMPDIR};" err exit
 echo -e "let a = 1;\nprint a;" > "${TEST_TMPDIR}/t.tot"
 ${tater} -d -s "${TEST_TMPDIR}/t.tot"
+${tater} -c "${TEST_TMPDIR}/t.tot"
+test -f "${TEST_TMPDIR}/t.totc"
+test "$(${tater} "${TEST_TMPDIR}/t.tot")" = "1"
+${tater} -c -o "${TEST_TMPDIR}/other.totc" "${TEST_TMPDIR}/t.tot"
+test -f "${TEST_TMPDIR}/other.totc"
+echo -e "let a = 2;\nprint a;" > "${TEST_TMPDIR}/t.tot"
+test "$(${tater} "${TEST_TMPDIR}/t.tot")" = "2" # stale cache ignored
+echo -e "fn twice(x) { return x * 2; }" > "${TEST_TMPDIR}/prelude.tot"
+${tater} -S "${TEST_TMPDIR}/prelude.img" "${TEST_TMPDIR}/prelude.tot"
+echo -e "print twice(21);" > "${TEST_TMPDIR}/image.tot"
+test "$(${tater} -I "${TEST_TMPDIR}/prelude.img" "${TEST_TMPDIR}/image.tot")" = "42"
+${tater} -I "${TEST_TMPDIR}/nosuchimage.img" "${TEST_TMPDIR}/image.tot" && exit 1
+echo -e "fn unused() { not valid }\nfn twice(x) { return x * 2; }\nprint twice(2);" > "${TEST_TMPDIR}/lazy.tot"
+test "$(${tater} -l "${TEST_TMPDIR}/lazy.tot")" = "4"
+echo -e "print 1 + 2;\nif (false) { print 0; }" > "${TEST_TMPDIR}/fold.tot"
+${tater} -D "${TEST_TMPDIR}/fold.tot" | grep -q "OP_ADD"
+${tater} -D "${TEST_TMPDIR}/fold.tot" | sed -n '/after optimization/,$p' | grep -q "OP_ADD" && exit 1
+test "$(${tater} "${TEST_TMPDIR}/fold.tot")" = "3"
+echo -e "fn f(n, k) { let t = 0; while (t < n * k) { t = t + 1; } return t * t; }\nprint f(3, 4);" > "${TEST_TMPDIR}/ir.tot"
+test "$(${tater} -O0 "${TEST_TMPDIR}/ir.tot")" = "$(${tater} -O2 "${TEST_TMPDIR}/ir.tot")"
+${tater} -O2 -D "${TEST_TMPDIR}/ir.tot" | sed -n '/after optimization/,$p' | grep -q "OP_DUP"
+${tater} -O3 "${TEST_TMPDIR}/ir.tot" && exit 1
+# a .totc is only used by a run at the level it was compiled at
+echo -e 'print("source");' > "${TEST_TMPDIR}/cached.tot"
+${tater} -c "${TEST_TMPDIR}/cached.tot"
+sed -i 's/source/cached/' "${TEST_TMPDIR}/cached.totc"
+test "$(${tater} "${TEST_TMPDIR}/cached.tot")" = "cached"
+${tater} -c -O0 "${TEST_TMPDIR}/cached.tot"
+sed -i 's/source/cached/' "${TEST_TMPDIR}/cached.totc"
+test "$(${tater} "${TEST_TMPDIR}/cached.tot")" = "source"
+test "$(${tater} -O0 "${TEST_TMPDIR}/cached.tot")" = "cached"
+echo -e 'fn loop(n) { if (n == 0) return "done"; return loop(n - 1); }\nprint(loop(100000));' > "${TEST_TMPDIR}/tail.tot"
+${tater} -c -O0 "${TEST_TMPDIR}/tail.tot"
+test "$(${tater} "${TEST_TMPDIR}/tail.tot")" = "done"
+test "$(${tater} -O2 "${TEST_TMPDIR}/tail.tot")" = "done"
+echo -e "fn depth(n) { if (n == 0) return 0; return 1 + depth(n - 1); }\nprint depth(10000);" > "${TEST_TMPDIR}/deep.tot"
+test "$(${tater} -F 20000 "${TEST_TMPDIR}/deep.tot")" = "10000"
+${tater} "${TEST_TMPDIR}/deep.tot" && exit 1
+trace=$(${tater} "${TEST_TMPDIR}/deep.tot" 2>&1 || true)
+echo "${trace}" | grep -q "^\.\.\. 4076 more frames$"
+test "$(echo "${trace}" | grep -c "in depth")" = "19"
+${tater} -F 0 "${TEST_TMPDIR}/deep.tot" && exit 1
+echo -e "fn hot(n) { let t = 0; for (let k = 0; k < n; k += 1) { t = t + k / 2; } return t; }\nprint hot(5000);\nprint 1 / (hot(2) - 0.5);" > "${TEST_TMPDIR}/jit.tot"
+test "$(${tater} -j "${TEST_TMPDIR}/jit.tot" 2>&1)" = "$(${tater} "${TEST_TMPDIR}/jit.tot" 2>&1)"
+test "$(${tater} -J "${TEST_TMPDIR}/jit.tot" 2>&1)" = "$(${tater} "${TEST_TMPDIR}/jit.tot" 2>&1)"
+${tater} --emit-c "${TEST_TMPDIR}/jit.tot"
+grep -q "aot_t_main" "${TEST_TMPDIR}/jit.tot.c"
+${tater} --emit-c -o "${TEST_TMPDIR}/other.c" "${TEST_TMPDIR}/jit.tot"
+${tater} --profile-hot "${TEST_TMPDIR}/ir.tot" 2> "${TEST_TMPDIR}/hot.txt"
+grep -q " f (line 1)" "${TEST_TMPDIR}/hot.txt"
+${tater} --profile="${TEST_TMPDIR}/ir.folded" "${TEST_TMPDIR}/ir.tot"
+test -f "${TEST_TMPDIR}/ir.folded"
+${tater} --profile="${TEST_TMPDIR}/nosuchdir/ir.folded" "${TEST_TMPDIR}/ir.tot" && exit 1
+${tater} --profile-calls "${TEST_TMPDIR}/ir.tot" 2> "${TEST_TMPDIR}/calls.txt"
+grep -q " f (line 1)" "${TEST_TMPDIR}/calls.txt"
+${tater} --alloc-profile "${TEST_TMPDIR}/ir.tot" 2> "${TEST_TMPDIR}/allocs.txt"
+grep -q "allocation sites by bytes" "${TEST_TMPDIR}/allocs.txt"
+${tater} --metrics="${TEST_TMPDIR}/ir.prom" --metrics-interval=60 "${TEST_TMPDIR}/ir.tot"
+grep -q "^tater_calls_total [1-9]" "${TEST_TMPDIR}/ir.prom"
+${tater} --metrics="${TEST_TMPDIR}/nosuchdir/ir.prom" "${TEST_TMPDIR}/ir.tot" && exit 1
+${tater} --metrics="${TEST_TMPDIR}/ir.prom" --metrics-interval=0 "${TEST_TMPDIR}/ir.tot" && exit 1
+test -f "${TEST_TMPDIR}/other.c"
 echo -e "garbage" >> "${TEST_TMPDIR}/garbage.tot"
+${tater} --emit-c "${TEST_TMPDIR}/garbage.tot" && exit 1
 ${tater} -d -s "${TEST_TMPDIR}/garbage.tot" || true
 ${tater} -v
 ${tater} -h
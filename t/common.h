@@ -24,10 +24,16 @@
 #include <strings.h>
 #include <check.h>
 
+#include "../src/aot.h"
+#include "../src/cache.h"
 #include "../src/common.h"
 #include "../src/compiler.h"
 #include "../src/debug.h"
+#include "../src/image.h"
+#include "../src/jit.h"
 #include "../src/memory.h"
+#include "../src/metrics.h"
+#include "../src/profile.h"
 #include "../src/type.h"
 #include "../src/scanner.h"
 #include "../src/vm.h"
@@ -140,6 +140,23 @@ START_TEST(test_scanner)
         } while (maybe_next.type != TOKEN_EOF);
         ck_assert_msg(found_invalid_token, "Failed to find invalid token in \"%s\"", invalid_sources[i]);
     }
+
+    // every keyword, and identifiers that only look like one
+    for (int i = TOKEN_AND; i <= TOKEN_PERROR; i++) {
+        scanner_t_init(token_keyword_names[i]);
+        ck_assert_msg(scanner_t_scan_token().type == (token_type_t)i, "keyword %s", token_keyword_names[i]);
+    }
+    const char *identifiers[] = {"fnord", "f", "in", "is", "selfish", "whiles", "o", "nill", "_and", "print2", NULL};
+    for (int i = 0; identifiers[i] != NULL; i++) {
+        scanner_t_init(identifiers[i]);
+        ck_assert_msg(scanner_t_scan_token().type == TOKEN_IDENTIFIER, "identifier %s", identifiers[i]);
+    }
+
+    scanner_t_init("# comment\n// another\n\"multi\nline\" x");
+    token_t multiline = scanner_t_scan_token();
+    ck_assert(multiline.type == TOKEN_STRING && multiline.line == 4); // strings report the line they end on
+    ck_assert(scanner_t_scan_token().line == 4);
+    ck_assert(scanner_t_scan_token().type == TOKEN_EOF);
 }
 
 START_TEST(test_compiler)
@@ -200,6 +217,81 @@ START_TEST(test_compiler)
         obj_function_t *program_func __unused__ = compiler_t_compile(programs[p], false);
         vm_t_free();
     }
+
+    vm_t_init();
+    obj_function_t *folded = compiler_t_compile("print (0x1 | 0x2) * 3 - -1;", false);
+    ck_assert(folded->chunk.code[0] == OP_CONSTANT);
+    ck_assert(AS_NUMBER(folded->chunk.constants.values[folded->chunk.code[1]]) == 10);
+    ck_assert(folded->chunk.code[2] == OP_PRINT);
+    ck_assert(folded->chunk.constants.count == 1);
+    folded = compiler_t_compile("print \"foo\" + \"bar\" == \"foobar\";", false);
+    ck_assert(folded->chunk.code[0] == OP_TRUE);
+    folded = compiler_t_compile("if (false) { print 1; } else { print 2; } while (false) { print 3; }", false);
+    ck_assert(folded->chunk.code[0] == OP_CONSTANT);
+    ck_assert(AS_NUMBER(folded->chunk.constants.values[folded->chunk.code[1]]) == 2);
+    ck_assert(folded->chunk.code[2] == OP_PRINT);
+    ck_assert(folded->chunk.code[3] == OP_NIL);
+    folded = compiler_t_compile("fn f() { return 1; print 2; }", false);
+    ck_assert(AS_FUNCTION(folded->chunk.constants.values[1])->chunk.count == 5); // constant, return, nil, return
+    folded = compiler_t_compile("print 1 / 0;", false); // left for the runtime error
+    ck_assert(folded->chunk.code[4] == OP_DIVIDE);
+    compiler_t_set_optimization_level(0);
+    folded = compiler_t_compile("print 1 + 2;", false);
+    ck_assert(folded->chunk.code[4] == OP_ADD);
+    compiler_t_set_optimization_level(1);
+    obj_function_t *table = compiler_t_compile("switch (1) { case 1: print 1; case 2: print 2; case 3: print 3; }", false);
+    ck_assert(table->chunk.code[2] == OP_SWITCH_TABLE);
+    ck_assert(IS_LIST(table->chunk.constants.values[table->chunk.code[3]])); // dense
+    table = compiler_t_compile("switch (1) { case 1: print 1; case 200: print 2; case \"x\": print 3; }", false);
+    ck_assert(IS_MAP(table->chunk.constants.values[table->chunk.code[3]]));
+    table = compiler_t_compile("let x = 1; switch (1) { case 1: print 1; case x: print 2; case 3: print 3; }", false);
+    ck_assert(table->chunk.code[6] == OP_JUMP); // not every case is a constant, compare one by one
+    ck_assert(table->chunk.code[10] == OP_DUP);
+    compiler_t_set_optimization_level(0);
+    table = compiler_t_compile("switch (1) { case 1: print 1; case 2: print 2; case 3: print 3; }", false);
+    ck_assert(table->chunk.code[2] == OP_DUP); // no slot reserved for a table
+    compiler_t_set_optimization_level(1);
+    obj_function_t *tail = compiler_t_compile("fn f(n) { return g(n); }", false);
+    ck_assert(AS_FUNCTION(tail->chunk.constants.values[1])->chunk.code[4] == OP_TAIL_CALL);
+    tail = compiler_t_compile("fn f(n) { return g(n) + 1; }", false);
+    ck_assert(AS_FUNCTION(tail->chunk.constants.values[1])->chunk.code[4] == OP_CALL);
+    compiler_t_set_optimization_level(2);
+    obj_function_t *optimized = compiler_t_compile("fn f(x) { return x * x; }", false);
+    ck_assert(AS_FUNCTION(optimized->chunk.constants.values[1])->chunk.code[2] == OP_DUP); // x is loaded once
+    optimized = compiler_t_compile("fn f(n, k) { let t = 0; while (t < n * k) { t = t + 1; } return t; }", false);
+    const uint8_t *code = AS_FUNCTION(optimized->chunk.constants.values[1])->chunk.code;
+    ck_assert(code[6] == OP_MULTIPLY); // n * k runs once before the loop
+    ck_assert(code[7] == OP_GET_LOCAL && code[8] == 3);
+    compiler_t_set_optimization_level(1);
+    vm_t_free();
+
+    vm_t_init();
+    vm_toggle_lazy_compile();
+    vm_toggle_gc_stress();
+    const char *lazy_source = ""
+    "let g = 1;"
+    "fn outer(a) {\n"
+    "    let b = 2;\n"
+    "    fn inner(c) { fn innermost() { return a + b + c + g; } return innermost; }\n"
+    "    return inner;\n"
+    "}";
+    obj_function_t *lazy_func = compiler_t_compile(lazy_source, false);
+    ck_assert(lazy_func != NULL);
+    vm_push(OBJ_VAL(lazy_func));
+    obj_function_t *lazy_outer = AS_FUNCTION(lazy_func->chunk.constants.values[3]);
+    ck_assert(lazy_outer->lazy != NULL);
+    ck_assert(lazy_outer->chunk.count == 0);
+    ck_assert(lazy_outer->arity == 1);
+    ck_assert(lazy_outer->lazy->line == 1);
+    ck_assert(compiler_t_compile_lazy(lazy_outer, false));
+    ck_assert(lazy_outer->lazy == NULL);
+    ck_assert(lazy_outer->chunk.count > 0);
+    vm_pop();
+    ck_assert(vm_t_interpret("let g = 1; fn outer(a) { let b = 2; fn inner(c) { fn innermost() { return a + b + c + g; } return innermost; } return inner; } assert(outer(3)(4)() == 10);") == INTERPRET_OK);
+    // bodies that never run are never compiled
+    ck_assert(vm_t_interpret("fn unused() { this is not valid; } print(1);") == INTERPRET_OK);
+    ck_assert(vm_t_interpret("fn used() { this is not valid; } used();") == INTERPRET_RUNTIME_ERROR);
+    vm_t_free();
 }
 
 START_TEST(test_vm)
@@ -209,7 +301,23 @@ START_TEST(test_vm)
         "switch(3) { default: print(0); }",
         "switch(3) { case 3: print(3); }",
         "switch(3) { }",
+        "fn f(n) { switch (n) { case 0: return \"zero\"; case 1: return \"one\"; case 1: return \"dup\"; case 3: return \"three\"; default: return \"many\"; } }"
+        "assert(f(0) == \"zero\"); assert(f(1) == \"one\"); assert(f(2) == \"many\"); assert(f(3) == \"three\"); assert(f(-0) == \"zero\");"
+        "assert(f(1.5) == \"many\"); assert(f(\"1\") == \"many\"); assert(f(nil) == \"many\"); assert(f(100) == \"many\");",
+        "fn f(s) { let r = nil; switch (s) { case \"a\": r = 1; case 1000: r = 2; case \"c\": r = 3; } return r; }"
+        "assert(f(\"a\") == 1); assert(f(1000) == 2); assert(f(\"c\") == 3); assert(f(\"b\") == nil); assert(f([1]) == nil);",
         "let counter = 0; while (counter < 10) { break; print counter; counter = counter + 1;} assert(counter == 0);",
+        "fn count(n, acc) { if (n == 0) return acc; return count(n - 1, acc + 1); } assert(count(10000, 0) == 10000);"
+        "fn even(n) { if (n == 0) return true; return odd(n - 1); } fn odd(n) { if (n == 0) return false; return even(n - 1); }"
+        "assert(even(1001) == false); fn s(n) { return str(n); } assert(s(5) == \"5\");"
+        "fn make(n) { let x = n; fn get() { return x; } return get; } fn via(n) { let y = n * 2; fn g() { return y; } return make(g()); }"
+        "assert(via(21)() == 42); type P { fn init(v) { self.v = v; } } fn mk(v) { return P(v); } assert(mk(3).v == 3);",
+        // a call thrown away as dead code must not turn the next return into a tail call
+        "fn g(a) { return a; } fn f(x) { if (false) { g(x); } return x != x; } assert(f(1) == false);",
+        "assert(0x1 | 0x2 == 3); assert(1 << 4 == 16); assert(~0 == -1); assert(-(2 * 3) == -6); assert(7 % 4 == 3);"
+        "assert(\"a\" + \"b\" == \"ab\"); assert(!nil); assert(2 >= 2); assert(!(1 > 2)); assert(1 != 2);",
+        "let hit = 0; if (1) { hit = 1; } else { hit = 2; } if (0) { hit = 3; } assert(hit == 1);",
+        "let n = 0; while (true) { n++; if (n == 3) break; } while (false) { n = 100; break; } assert(n == 3);",
         "let counter = 0; for(let i = 0; i < 5; i++) { break; counter++;} assert(counter == 0);",
         "let counter = 0; for(let i = 0; i < 5; i++) { counter++; for(let y = 0; y < 3; y++) { break; } } assert(counter == 5);",
         "let counter = 0; let extra = 0; while (counter < 10) { counter = counter + 1; continue; extra++; print \"never reached\";} assert(extra == 0);",
@@ -352,6 +460,9 @@ START_TEST(test_vm)
 
         "let a = map(); for (let i = 0; i < 255; i++) { a.set(\"testcase\" + str(i), str(i * 255)); }"
         "for (let i = 0; i < 255; i++) { assert(a[\"testcase\" + str(i)] == str(i * 255)); }",
+        // removed keys leave tombstones that lookups have to probe past
+        "let m = {}; for (let i = 0; i < 1000; i++) { m[\"key\" + str(i)] = i; } for (let i = 0; i < 1000; i += 2) { m.remove(\"key\" + str(i)); }"
+        "for (let i = 1; i < 1000; i += 2) { assert(m[\"key\" + str(i)] == i); } assert(m.len() == 500);",
 
         "type Animal {} type Dog (Animal) {} type Cat (Animal) {}"
         "let m = {Cat:[], Dog:[]}; m[Cat].append(Cat()); assert(m[Cat].len() == 1); m[Animal] = [Dog(), Cat()]; assert(m[Animal].len() == 2);",
@@ -466,6 +577,11 @@ START_TEST(test_vm)
         "let counter = 0; for(1; counter < 5; counter = counter + 1) { print counter;}",
         "fn a() { print 1;} a();",
         "print clock();",
+        "assert(monotonic_ns() > 0); assert(time_ns() > 1600000000000000000);",
+        "let c = 0; fn count() { c++; } let r = bench(count, 20); assert(c == 22); assert(r[\"iterations\"] == 20);"
+            "assert(r[\"min\"] <= r[\"median\"]); assert(r[\"median\"] <= r[\"p99\"]); assert(r[\"p99\"] <= r[\"max\"]);",
+        "fn count() { return 1; } fn outer() { return bench(count, 1)[\"iterations\"]; } assert(bench(outer, 2)[\"iterations\"] == 2);",
+        "fn f() { return clock(); } let r = bench(f, 3); assert(r[\"iterations\"] == 3);", // a tail call to a native
         "fn mk() {let l = \"local\"; fn inner() {print l;}return inner;} let closure = mk(); closure();",
         "fn outer() {let x = 1; x = 2;fn inner() {print x;} inner(); } outer();",
         "fn novalue() { return; } novalue();",
@@ -574,12 +690,21 @@ START_TEST(test_vm)
         ck_assert_msg(vm_t_interpret(test_cases[i]) == INTERPRET_OK, "test case failed for \"%s\"\n", test_cases[i]);
         vm_t_free();
     }
+    // and again with bodies compiled on first call
+    for (int i = 0; test_cases[i] != NULL; i++) {
+        vm_t_init();
+        vm_toggle_lazy_compile();
+        ck_assert_msg(vm_t_interpret(test_cases[i]) == INTERPRET_OK, "lazy test case failed for \"%s\"\n", test_cases[i]);
+        vm_t_free();
+    }
 
 
     const char *exit_ok_tests[] = {
         "exit;",
         "exit(0);",
         "fn finish_and_quit() { print(\"working\"); exit(0); } finish_and_quit();",
+        "fn quit() { exit(0); } bench(quit, 3); assert(false);", // out through the native that called back in
+        "fn quit() { exit(0); } fn inner() { bench(quit, 1); } bench(inner, 1); assert(false);",
         NULL,
     };
     for (int i = 0; exit_ok_tests[i] != NULL; i++) {
@@ -594,6 +719,7 @@ START_TEST(test_vm)
         "exit(-1);",
         "assert(1 == 2);",
         "fn finish_and_fail() { print(\"working\"); exit(-1); } finish_and_fail();",
+        "fn fail() { exit(3); } bench(fail, 3);",
         NULL,
     };
     for (int i = 0; exit_tests[i] != NULL; i++) {
@@ -602,6 +728,10 @@ START_TEST(test_vm)
         ck_assert_msg(rv == INTERPRET_EXIT, "test case failed for \"%s\"\n", exit_tests[i]);
         vm_t_free();
     }
+    vm_t_init();
+    ck_assert(vm_t_interpret("fn fail() { exit(3); } bench(fail, 3);") == INTERPRET_EXIT);
+    ck_assert(vm.exit_status == 3);
+    vm_t_free();
 
     const char *compilation_fail_cases[] = {
         "continue;",
@@ -706,6 +836,9 @@ START_TEST(test_vm)
         "map(\"one\", 1).len(1);",
         "type Animals { let Cat = \"cat\"; let Dog = \"dog\"; let Bird = \"bird\";} print(Animals.NoSuch);",
         "type Animals { let Cat = \"cat\"; let Dog = \"dog\"; let Bird = \"bird\";} Animals.Cat = 1;",
+        "bench(clock, 0);",
+        "bench(nil, 3);",
+        "fn boom() { return 1 / nil; } bench(boom, 5);",
         NULL,
     };
     for (int i = 0; runtime_fail_cases[i] != NULL; i++) {
@@ -716,6 +849,76 @@ START_TEST(test_vm)
         ck_assert_msg(rv == INTERPRET_RUNTIME_ERROR, "Unexpected success for \"%s\"\n", runtime_fail_cases[i]);
         vm_t_free();
     }
+
+    // both stacks grow past their initial size, and the call depth limit can be lowered
+    vm_t_init();
+    ck_assert(vm.frame_capacity == FRAMES_INITIAL);
+    ck_assert(vm_t_interpret("fn depth(n) { if (n == 0) return 0; let a = n; let b = n; return 1 + depth(n - 1) + a - b; }"
+        "let f; { let v = 7; fn inner() { return v; } f = inner; depth(1000); } assert(depth(2000) == 2000); assert(f() == 7);") == INTERPRET_OK);
+    ck_assert(vm.frame_capacity > FRAMES_INITIAL);
+    ck_assert(vm.stack_end - vm.stack > STACK_INITIAL);
+    vm_set_frames_max(100);
+    ck_assert(vm_t_interpret("fn depth(n) { if (n == 0) return 0; return 1 + depth(n - 1); } depth(200);") == INTERPRET_RUNTIME_ERROR);
+    ck_assert(vm_t_interpret("fn depth(n) { if (n == 0) return 0; return 1 + depth(n - 1); } assert(depth(50) == 50);") == INTERPRET_OK);
+    vm_t_free();
+
+    // past 256 constants every global, property, method, type and closure operand needs OP_WIDE
+    static char wide_source[65536];
+    int length = 0;
+    for (int i = 0; i < 300; i++) {
+        length += snprintf(wide_source + length, sizeof wide_source - length, "let g%d = %d.5;", i, i);
+    }
+    length += snprintf(wide_source + length, sizeof wide_source - length, "type Wide { fn init() {");
+    for (int i = 0; i < 300; i++) {
+        length += snprintf(wide_source + length, sizeof wide_source - length, "self.p%d = g%d;", i, i);
+    }
+    length += snprintf(wide_source + length, sizeof wide_source - length, "} fn one() { return 1; } }"
+        "fn total(w) { let sum = 0;");
+    for (int i = 0; i < 300; i++) {
+        length += snprintf(wide_source + length, sizeof wide_source - length, "sum = sum + w.p%d;", i);
+    }
+    snprintf(wide_source + length, sizeof wide_source - length, "return sum + w.one(); }"
+        "let w = Wide(); g299 = total(w); assert(g299 == 45001); assert(w.p299 == 299.5);");
+    for (int level = 0; level <= 2; level++) {
+        vm_t_init();
+        compiler_t_set_optimization_level(level);
+        obj_function_t *wide_function = compiler_t_compile(wide_source, false);
+        ck_assert(wide_function != NULL);
+        ck_assert(wide_function->chunk.constants.count > UINT8_COUNT);
+        ck_assert(vm_t_interpret(wide_source) == INTERPRET_OK);
+        compiler_t_set_optimization_level(1);
+        vm_t_free();
+    }
+
+    // past 256 locals the slots and the upvalues capturing them need OP_WIDE, and the frame more stack room
+    length = snprintf(wide_source, sizeof wide_source, "fn outer() {");
+    for (int i = 0; i < 300; i++) {
+        length += snprintf(wide_source + length, sizeof wide_source - length, "let l%d = %d;", i, i);
+    }
+    length += snprintf(wide_source + length, sizeof wide_source - length, "fn middle() { fn inner() { return ");
+    for (int i = 0; i < 300; i += 10) {
+        length += snprintf(wide_source + length, sizeof wide_source - length, "l%d + ", i);
+    }
+    length += snprintf(wide_source + length, sizeof wide_source - length, "l299; } l299 = l299 + 1; return inner; }"
+        "for (let i = 0; i < 3; i = i + 1) { let a = l298; if (i == 1) continue; if (a == 0) break; }"
+        "let inner = middle(); l280 = l280 + 1; return inner() + l280 + clock() * 0; }");
+    snprintf(wide_source + length, sizeof wide_source - length, "assert(outer() == 4351 + 300 + 281); assert(outer() == 4932);");
+    for (int level = 0; level <= 2; level++) {
+        vm_t_init();
+        compiler_t_set_optimization_level(level);
+        obj_function_t *wide_function = compiler_t_compile(wide_source, false);
+        ck_assert(wide_function != NULL);
+        int max_slots = 0;
+        for (int i = 0; i < wide_function->chunk.constants.count; i++) {
+            if (IS_FUNCTION(wide_function->chunk.constants.values[i])) {
+                max_slots = AS_FUNCTION(wide_function->chunk.constants.values[i])->max_slots;
+            }
+        }
+        ck_assert(max_slots > UINT8_COUNT);
+        ck_assert(vm_t_interpret(wide_source) == INTERPRET_OK);
+        compiler_t_set_optimization_level(1);
+        vm_t_free();
+    }
 }
 
 static bool native_getpid(const int, const value_t*)
@@ -923,7 +1126,6 @@ START_TEST(test_debug)
     chunk_t_write(&chunk, i, 1);
     chunk_t_disassemble_instruction(&chunk, 3);
 
-    // unused but tested here
     i = chunk_t_add_constant(&chunk, NUMBER_VAL(1));
     chunk_t_write(&chunk, OP_CONSTANT_LONG, 1); // +4
     chunk_t_write(&chunk, (uint8_t)(i & 0xff), 1);
@@ -934,6 +1136,22 @@ START_TEST(test_debug)
     chunk_t_write(&chunk, OP_ASSERT, 1); // +4
     chunk_t_disassemble_instruction(&chunk, 9);
 
+    while (chunk.constants.count <= UINT8_MAX) {
+        chunk_t_add_constant(&chunk, NUMBER_VAL(chunk.constants.count));
+    }
+    i = chunk_t_add_constant(&chunk, OBJ_VAL(obj_string_t_copy_from("wide", 4, true)));
+    chunk_t_write(&chunk, OP_WIDE, 1); // +4
+    chunk_t_write(&chunk, OP_GET_GLOBAL, 1);
+    chunk_t_write(&chunk, (uint8_t)((i >> 8) & 0xff), 1);
+    chunk_t_write(&chunk, (uint8_t)(i & 0xff), 1);
+    ck_assert(chunk_t_disassemble_instruction(&chunk, 10) == 14);
+    chunk_t_write(&chunk, OP_WIDE, 1); // +5
+    chunk_t_write(&chunk, OP_INVOKE, 1);
+    chunk_t_write(&chunk, (uint8_t)((i >> 8) & 0xff), 1);
+    chunk_t_write(&chunk, (uint8_t)(i & 0xff), 1);
+    chunk_t_write(&chunk, 2, 1);
+    ck_assert(chunk_t_disassemble_instruction(&chunk, 14) == 19);
+
     chunk_t_free(&chunk);
 
     vm_toggle_gc_stress();
@@ -1028,6 +1246,582 @@ START_TEST(test_env) {
     vm_t_free();
 }
 
+static vm_t_interpret_result_t interpret_captured(const char *source, const int level, char *output, const size_t size)
+{
+    FILE *captured = tmpfile();
+    ck_assert(captured != NULL);
+    fflush(stdout);
+    const int saved = dup(STDOUT_FILENO);
+    dup2(fileno(captured), STDOUT_FILENO);
+
+    vm_t_init();
+    vm_toggle_gc_stress();
+    compiler_t_set_optimization_level(level);
+    const vm_t_interpret_result_t result = vm_t_interpret(source);
+    compiler_t_set_optimization_level(1);
+    vm_t_free();
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    rewind(captured);
+    const size_t length = fread(output, 1, size - 1, captured);
+    output[length] = '\0';
+    fclose(captured);
+    return result;
+}
+
+START_TEST(test_optimizer)
+{
+    const char *test_cases[] = {
+        "fn f(n, k) { let t = 0; let i = 0; while (i < n * k) { let sq = i * i; t = t + sq; i = i + 1; } return t; } print f(10, 2);",
+        "let g = 3; g = g + 1; print g; let s = 0; for (let j = 0; j < 5; j++) { s = s + j; } print s;",
+        "fn f(a, b) { let r = 0; while (r < a + b) { if (r == 3) break; r++; } return r; } print f(1, 1); print f(4, 4);",
+        "fn f(a) { let out = []; for (let i = 0; i < a * 2; i++) { let x = i; fn g() { return x + a; } out.append(g); } return out; }"
+        "let fs = f(2); for (let i = 0; i < 4; i++) { print fs[i](); }",
+        "fn f(a) { let n = 0; while (n < a * a) { let x = n; let y = x * 2; n = n + 1; if (y > 6) continue; print y; } return n; } print f(3);",
+        "fn f(s) { let t = \"\"; let n = 0; while (n < 2 * 3) { t = t + s; n++; } return t; } print f(\"ab\");",
+        "fn f(a, b) { return (a + b) * (a + b) - -a * -a; } print f(2, 3); let q = 2; print q * q;",
+        "fn f(x) { if (x > 1 and x < 5 or x == 9) return \"in\"; return \"out\"; } print f(3); print f(9); print f(6);",
+        "type P { fn init(x) { self.x = x; } fn sum(n) { let t = 0; for (let i = 0; i < n * self.x; i++) { t = t + i; } return t; } } print P(2).sum(3);",
+        "fn f(a) { let i = 0; while (i < a * \"x\") { i++; } } print 1; f(2);",
+        "fn f(a) { let i = 0; while (true) { while (i < a + 1) { i++; } return i; } } print f(4);",
+    };
+    char before[4096], after[4096];
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+        const vm_t_interpret_result_t unoptimized = interpret_captured(test_cases[i], 0, before, sizeof before);
+        const vm_t_interpret_result_t optimized = interpret_captured(test_cases[i], 2, after, sizeof after);
+        ck_assert_msg(unoptimized == optimized, "Different results for: %s", test_cases[i]);
+        ck_assert_msg(strcmp(before, after) == 0, "Different output for: %s\n%s\n%s", test_cases[i], before, after);
+    }
+}
+
+START_TEST(test_cache)
+{
+    const char *source_path = "cache.tmp";
+    const char *cache_path = "cache.tmpc";
+    const char *source = ""
+    "fn adder(x) { fn add(y) { return x + y; } return add; }"
+    "let s = \"tot\"; let n = 2.5; let b = true; let z = nil;"
+    "assert(adder(n)(1) == 3.5); assert(s + \"s\" == \"tots\"); assert(b); assert(z == nil);"
+    "fn pick(k) { switch (k) { case 1: return 1; case 2: return 2; case 3: return 3; case \"s\": return 4; } return 0; }"
+    "assert(pick(2) == 2); assert(pick(\"s\") == 4); assert(pick(5) == 0);"
+    "";
+    FILE *f = fopen(source_path, "w");
+    ck_assert(f != NULL);
+    fprintf(f, "%s", source);
+    fclose(f);
+
+    vm_t_init();
+    obj_function_t *function = compiler_t_compile(source, false);
+    ck_assert(function != NULL);
+    ck_assert(cache_t_write(cache_path, source_path, source, function));
+    vm_t_free();
+
+    vm_t_init();
+    vm_toggle_gc_stress();
+    obj_function_t *loaded = cache_t_load(cache_path, source_path, source);
+    ck_assert(loaded != NULL);
+    ck_assert(vm.stack_top == vm.stack);
+    ck_assert(loaded->chunk.count > 0);
+    ck_assert(loaded->chunk.code[loaded->chunk.count - 1] == OP_RETURN);
+    ck_assert(vm_t_interpret_function(loaded) == INTERPRET_OK);
+    vm_t_free();
+
+    // a cache for different source is ignored
+    vm_t_init();
+    ck_assert(cache_t_load(cache_path, source_path, "let v = 1;") == NULL);
+    ck_assert(cache_t_load("nosuchcache.tmpc", source_path, source) == NULL);
+    ck_assert(vm.stack_top == vm.stack);
+    vm_t_free();
+
+    // truncated caches are rejected without leaving anything on the stack
+    ck_assert(truncate(cache_path, 64) == 0);
+    vm_t_init();
+    ck_assert(cache_t_load(cache_path, source_path, source) == NULL);
+    ck_assert(vm.stack_top == vm.stack);
+    vm_t_free();
+
+    unlink(cache_path);
+    unlink(source_path);
+}
+
+START_TEST(test_image)
+{
+    const char *image_path = "image.tmp";
+    const char *prelude = ""
+    "type Animal { let legs = 4; fn init(name) { self.name = name; } fn speak() { return self.name + \" speaks\"; } }"
+    "type Dog (Animal) { fn speak() { return super.speak() + \" woof\"; } }"
+    "fn counter() { let c = 0; fn inc() { c++; return c; } return inc; }"
+    "let next = counter(); next(); next();"
+    "let rex = Dog(\"rex\");"
+    "let bark = rex.speak;"
+    "let things = [1, \"two\", nil, true, {\"k\": [3]}];"
+    "things.append(things);"
+    "let stringify = str;"
+    "";
+    const char *program = ""
+    "assert(next() == 3);"
+    "assert(rex.speak() == \"rex speaks woof\");"
+    "assert(bark() == \"rex speaks woof\");"
+    "assert(rex.legs == 4); assert(Dog(\"fido\").name == \"fido\");"
+    "assert(things[0] == 1); assert(things[1] == \"two\"); assert(things[2] == nil); assert(things[3]);"
+    "assert(things[4][\"k\"][0] == 3); assert(things[5][1] == \"two\");"
+    "assert(stringify(1) == \"1\");"
+    "assert(argc == 1);"
+    "";
+
+    vm_t_init();
+    const char *args[] = {"saving", "extra"};
+    vm_set_argc_argv(2, args);
+    ck_assert(vm_t_interpret(prelude) == INTERPRET_OK);
+    ck_assert(image_t_write(image_path));
+    vm_t_free();
+
+    vm_t_init();
+    vm_toggle_gc_stress();
+    ck_assert(image_t_load(image_path));
+    const char *load_args[] = {"loading"};
+    vm_set_argc_argv(1, load_args);
+    ck_assert_msg(vm_t_interpret(program) == INTERPRET_OK, "Failed to interpret: %s", program);
+    vm_t_free();
+
+    // open files cannot be saved
+    vm_t_init();
+    ck_assert(vm_t_interpret("let f = file(\"image-file.tmp\", \"w\");") == INTERPRET_OK);
+    ck_assert(image_t_write("image-invalid.tmp") == false);
+    ck_assert(access("image-invalid.tmp", F_OK) == -1);
+    vm_t_free();
+
+    // truncated images are rejected
+    ck_assert(truncate(image_path, 40) == 0);
+    vm_t_init();
+    ck_assert(image_t_load(image_path) == false);
+    ck_assert(image_t_load("nosuchimage.tmp") == false);
+    ck_assert(vm.stack_top == vm.stack);
+    vm_t_free();
+
+    unlink(image_path);
+    unlink("image-file.tmp");
+}
+
+START_TEST(test_jit)
+{
+    // hot loops and calls run natively, leaving the interpreter anything the templates do not handle
+    const char *program = ""
+    "fn numeric(n) { let total = 0; for (let k = 0; k < n; k += 1) { total = total + k * 0.5 - k / 4; if (k == nil) total = -1; } return total; }"
+    "assert(numeric(3000) == 1124625);"
+    "fn mixed(n) { let s = \"\"; let t = true; for (let k = 0; k < n; k += 1) { if (!t) s = s + \"a\"; t = !t; } return s.len(); }"
+    "assert(mixed(3000) == 1500);"
+    "let g = 0; fn globals(n) { while (g < n) { g = g + 1; } return g; }"
+    "assert(globals(3000) == 3000);"
+    "type P { let x = 0; fn bump(n) { for (let k = 0; k < n; k += 1) { self.x = self.x + 1; } return self.x; } }"
+    "assert(P().bump(3000) == 3000);"
+    "fn outer() { let c = 0; fn inc() { c = c + 1; return c; } for (let k = 0; k < 3000; k += 1) inc(); return inc(); }"
+    "assert(outer() == 3001);"
+    "fn negative(n) { let v = 1; for (let k = 0; k < n; k += 1) { v = -v; } return v; }"
+    "assert(negative(3001) == -1);"
+    "";
+
+    for (int backend = JIT_TEMPLATES; backend <= JIT_STENCILS; backend++) {
+        vm_t_init();
+        backend == JIT_TEMPLATES ? vm_toggle_jit() : vm_toggle_jit_stencils();
+        ck_assert_msg(vm_t_interpret(program) == INTERPRET_OK, "Failed to interpret: %s", program);
+#ifdef TATER_JIT
+        value_t numeric;
+        ck_assert(table_t_get(&vm.globals, OBJ_VAL(obj_string_t_copy_from("numeric", 7, true)), &numeric));
+        ck_assert(AS_CLOSURE(numeric)->function->jit != NULL);
+        ck_assert(AS_CLOSURE(numeric)->function->hotness == JIT_THRESHOLD);
+#endif
+        // errors still come from the interpreter, at the right line
+        ck_assert(vm_t_interpret("fn divide(n) { let v = 0; for (let k = n; k >= 0; k -= 1) { v = 1 / k; } return v; }\ndivide(3000);") == INTERPRET_RUNTIME_ERROR);
+        ck_assert(vm_t_interpret("fn add(n) { let v = 0; for (let k = 0; k < n; k += 1) { let x = k; if (k == 2999) x = nil; v = v + x; } }\nadd(3000);") == INTERPRET_RUNTIME_ERROR);
+        vm_t_free();
+    }
+
+#if defined(__x86_64__)
+    for (int backend = JIT_TEMPLATES; backend <= JIT_STENCILS; backend++) {
+        vm_t_init();
+        obj_function_t *function = compiler_t_compile("let i = 0; while (i < 10) { i = i + 1; }", false);
+        ck_assert(function != NULL);
+        ck_assert(jit_t_compile(function, backend));
+        ck_assert(function->jit->entries[0] != NULL);
+        ck_assert(function->jit->size > 0);
+        jit_t_free(function);
+        ck_assert(function->jit == NULL);
+        vm_t_free();
+    }
+#endif
+}
+
+START_TEST(test_aot)
+{
+    const char *c_path = "aot.tmp.c";
+    const char *source = ""
+    "fn hot(n) { let t = 0; for (let k = 0; k < n; k += 1) { t = t + k % 7; } return t; }"
+    "fn counter() { let c = 0; fn inc() { c = c + 1; return c; } return inc; }"
+    "print hot(10); print counter()();"
+    "";
+
+    vm_t_init();
+    obj_function_t *function = compiler_t_compile(source, false);
+    ck_assert(function != NULL);
+    vm_push(OBJ_VAL(function));
+    ck_assert(aot_t_emit_c(function, "aot.tot", c_path));
+
+    // the header-less serialization it embeds reads back, and truncated bytes are rejected
+    char *bytes = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&bytes, &size);
+    ck_assert(stream != NULL);
+    ck_assert(cache_t_write_function(stream, function));
+    fclose(stream);
+    vm_pop();
+    obj_function_t *loaded = cache_t_read_function((const uint8_t*)bytes, size);
+    ck_assert(loaded != NULL);
+    ck_assert(loaded->chunk.count == function->chunk.count);
+    ck_assert(cache_t_read_function((const uint8_t*)bytes, size / 2) == NULL);
+    ck_assert(vm.stack_top == vm.stack);
+    vm_t_free();
+
+    // one C function for the script and each of its three functions, entered after calls and at loops
+    FILE *f = fopen(c_path, "r");
+    ck_assert(f != NULL);
+    char line[1024];
+    int functions = 0, loops = 0;
+    bool has_main = false;
+    while (fgets(line, sizeof line, f) != NULL) {
+        functions += strncmp(line, "static uint8_t *f", 17) == 0;
+        loops += strstr(line, "goto L") != NULL && strstr(line, "case ") == NULL;
+        has_main = has_main || strstr(line, "return aot_t_main(argc, argv, bytecode, sizeof bytecode,") != NULL;
+    }
+    fclose(f);
+    ck_assert_int_eq(functions, 4);
+    ck_assert(loops > 0);
+    ck_assert(has_main);
+    unlink(c_path);
+
+    // code built against another bytecode format or script refuses to run
+    const uint8_t empty[] = {0};
+    ck_assert(aot_t_main(0, NULL, (const uint8_t*)bytes, size, CACHE_FORMAT_VERSION + 1, NULL, 0) == EXIT_FAILURE);
+    ck_assert(aot_t_main(0, NULL, empty, sizeof empty, CACHE_FORMAT_VERSION, NULL, 0) == EXIT_FAILURE);
+    ck_assert(aot_t_main(0, NULL, (const uint8_t*)bytes, size, CACHE_FORMAT_VERSION, NULL, 0) == EXIT_FAILURE);
+    free(bytes);
+}
+
+START_TEST(test_profile_hot)
+{
+    const char *program = ""
+    "fn inner(n) { let t = 0; while (t < n) { t += 1; } return t; }"
+    "fn outer() { let s = 0; for (let i = 0; i < 10; i += 1) { s += inner(i); } return s; }"
+    "assert(outer() == 45);"
+    "";
+
+    // nothing is counted unless asked
+    vm_t_init();
+    ck_assert(vm_t_interpret(program) == INTERPRET_OK);
+    obj_function_t *hot[PROFILE_HOT_LIMIT];
+    ck_assert_int_eq(profile_t_hot_functions(hot, PROFILE_HOT_LIMIT), 0);
+    vm_t_free();
+
+    vm_t_init();
+    vm_toggle_profile_hot();
+    vm_toggle_jit(); // ignored while counting
+    ck_assert(vm_t_interpret(program) == INTERPRET_OK);
+    const int count = profile_t_hot_functions(hot, PROFILE_HOT_LIMIT);
+    ck_assert_int_eq(count, 3);
+    ck_assert(strcmp(hot[0]->name->chars, "inner") == 0);
+    ck_assert(hot[0]->call_count == 10);
+    ck_assert(profile_t_backedges(hot[0]) == 45);
+    ck_assert(hot[0]->jit == NULL);
+    ck_assert(strcmp(hot[1]->name->chars, "outer") == 0);
+    ck_assert(hot[1]->call_count == 1);
+    ck_assert(profile_t_backedges(hot[1]) == 20); // into the increment and back to the condition
+    ck_assert(hot[2]->name == NULL);
+    ck_assert_int_eq(profile_t_hot_functions(hot, 1), 1);
+    ck_assert(strcmp(hot[0]->name->chars, "inner") == 0);
+
+    char *report = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&report, &size);
+    profile_t_hot_report(f, PROFILE_HOT_LIMIT);
+    fclose(f);
+    ck_assert(strstr(report, "45  inner (line 1)") != NULL);
+    ck_assert(strstr(report, "loop at line 1") != NULL);
+    free(report);
+    vm_t_free();
+}
+
+START_TEST(test_profile_sampler)
+{
+    const char *folded_path = "profile.tmp";
+    ck_assert(!profile_t_sampler_stop());
+    ck_assert(!profile_t_sampler_start(folded_path, 0));
+
+    vm_t_init();
+    vm_toggle_jit(); // ignored while sampling
+    ck_assert(profile_t_sampler_start(folded_path, PROFILE_SAMPLE_HZ));
+    ck_assert(vm.flags & VM_FLAG_PROFILE_SAMPLE);
+    // a pending sample is taken at the next call, here the script's own
+    profile_sample_pending = 1;
+    ck_assert(vm_t_interpret("fn spin(n) { let t = 0; while (t < n) { t += 1; } return t; }\nassert(spin(200000) == 200000);") == INTERPRET_OK);
+    ck_assert(profile_t_sampler_stop());
+    ck_assert(!(vm.flags & VM_FLAG_PROFILE_SAMPLE));
+    vm_t_free();
+
+    FILE *f = fopen(folded_path, "r");
+    ck_assert(f != NULL);
+    char line[1024];
+    bool script = false;
+    while (fgets(line, sizeof line, f) != NULL) {
+        script = script || strcmp(line, "<script>:1 1\n") == 0;
+        // every line is a collapsed stack and its sample count
+        ck_assert(strncmp(line, "<script>:", 9) == 0);
+        ck_assert(strrchr(line, ' ') != NULL && atoi(strrchr(line, ' ') + 1) > 0);
+    }
+    fclose(f);
+    ck_assert(script);
+    unlink(folded_path);
+}
+
+static const profile_time_t *profile_time_of(const char *name)
+{
+    value_t callable;
+    ck_assert(table_t_get(&vm.globals, OBJ_VAL(obj_string_t_copy_from(name, strlen(name), true)), &callable));
+    return IS_NATIVE(callable) ? &AS_NATIVE(callable)->time : &AS_CLOSURE(callable)->function->time;
+}
+
+START_TEST(test_profile_calls)
+{
+    const char *program = ""
+    "fn helper(x) { return x * 2; }"
+    "fn work(n) { let t = 0; for (let i = 0; i < n; i += 1) { t = t + helper(i); } return t; }"
+    "fn down(n) { if (n == 0) return str(n); return down(n - 1); }"
+    "assert(work(1000) == 999000); assert(down(50) == \"0\");"
+    "";
+
+    vm_t_init();
+    vm_toggle_profile_calls();
+    ck_assert(vm_t_interpret(program) == INTERPRET_OK);
+    const profile_time_t *helper = profile_time_of("helper");
+    const profile_time_t *work = profile_time_of("work");
+    ck_assert(helper->calls == 1000);
+    ck_assert(work->calls == 1);
+    ck_assert(work->inclusive_ns >= helper->inclusive_ns + work->exclusive_ns);
+    ck_assert(helper->inclusive_ns == helper->exclusive_ns); // it calls nothing
+    // tail calls replace the frame, each one still counts
+    ck_assert(profile_time_of("down")->calls == 51);
+    ck_assert(profile_time_of("down")->active == 0);
+    ck_assert(profile_time_of("str")->calls == 1);
+
+    obj_t *timed[PROFILE_CALLS_LIMIT];
+    const int count = profile_t_timed(timed, PROFILE_CALLS_LIMIT);
+    ck_assert(count >= 5);
+    ck_assert(profile_t_timed(timed, 2) == 2);
+
+    // a native calling back in stays open around the calls it makes
+    ck_assert(vm_t_interpret("fn spin() { let t = 0; for (let i = 0; i < 100; i++) { t = t + i; } return t; } bench(spin, 5);") == INTERPRET_OK);
+    const profile_time_t *bench = profile_time_of("bench");
+    const profile_time_t *spin = profile_time_of("spin");
+    ck_assert(bench->calls == 1);
+    ck_assert(spin->calls == 6);
+    ck_assert(bench->inclusive_ns >= spin->inclusive_ns);
+    ck_assert(bench->active == 0 && spin->active == 0);
+
+    // an error leaves calls running, they are closed by the next call at their depth
+    ck_assert(vm_t_interpret("fn fail() { return 1 / 0; }\nfail();") == INTERPRET_RUNTIME_ERROR);
+    ck_assert(profile_time_of("fail")->active == 1);
+    ck_assert(vm_t_interpret("helper(1);") == INTERPRET_OK);
+    ck_assert(profile_time_of("fail")->active == 0);
+    ck_assert(profile_time_of("helper")->calls == 1001);
+
+    char *report = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&report, &size);
+    profile_t_calls_report(f, PROFILE_CALLS_LIMIT);
+    fclose(f);
+    ck_assert(strstr(report, "1001") != NULL);
+    ck_assert(strstr(report, "helper (line 1)") != NULL);
+    ck_assert(strstr(report, "str (native)") != NULL);
+    free(report);
+    vm_t_free();
+
+    // nothing is timed unless asked
+    vm_t_init();
+    ck_assert(vm_t_interpret(program) == INTERPRET_OK);
+    ck_assert(profile_time_of("helper")->calls == 0);
+    ck_assert(vm_t_interpret("profile_dump();") == INTERPRET_OK);
+    vm_t_free();
+}
+
+START_TEST(test_opstats)
+{
+#ifdef TATER_OPSTATS
+    memset(&profile_opstats, 0, sizeof profile_opstats);
+    vm_t_init();
+    ck_assert(vm_t_interpret("fn f(x) { return x + 1; } f(1); f(2);") == INTERPRET_OK);
+    ck_assert(profile_opstats.ops[OP_ADD] == 0); // only counted when asked
+    vm_toggle_opstats();
+    ck_assert(vm_t_interpret("fn f(x) { return x + 1; } f(1); f(2);") == INTERPRET_OK);
+    ck_assert(profile_opstats.ops[OP_ADD] == 2);
+    ck_assert(profile_opstats.ops[OP_CALL] == 2);
+    ck_assert(profile_opstats.pairs[OP_GET_LOCAL][OP_CONSTANT] == 2);
+    ck_assert(profile_opstats.pairs[OP_CONSTANT][OP_ADD] == 2);
+    ck_assert(profile_opstats.pairs[OP_ADD][OP_RETURN] == 2);
+
+    char *report = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&report, &size);
+    profile_t_opstats_report(f, PROFILE_OPSTATS_LIMIT);
+    fclose(f);
+    ck_assert(strstr(report, "OP_CONSTANT OP_ADD") != NULL);
+    free(report);
+    vm_t_free();
+#endif
+}
+
+START_TEST(test_alloc_profile)
+{
+    const char *program = ""
+    "type Cell { let v; fn init(v) { self.v = v; } }\n"
+    "let kept = [];\n"
+    "fn fill(n) {\n"
+    "    for (let i = 0; i < n; i += 1) {\n"
+    "        let c = Cell(i);\n"
+    "        if (i % 10 == 0) kept.append(c);\n"
+    "    }\n"
+    "}\n"
+    "fill(100);\n"
+    "";
+
+    vm_t_init();
+    vm_toggle_alloc_profile();
+    ck_assert(vm_t_interpret(program) == INTERPRET_OK);
+    vm_collect_garbage(); // only the kept cells survive
+
+    char *report = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&report, &size);
+    profile_t_alloc_report(f, PROFILE_ALLOC_LIMIT);
+    fclose(f);
+    ck_assert(strstr(report, "OBJ_INSTANCE     fill:5\n") != NULL);
+    ck_assert(strstr(report, "buffer           fill:6\n") != NULL); // the list growing
+    ck_assert(strstr(report, "OBJ_STRING       <compile>\n") != NULL);
+
+    const char *surviving = strstr(report, "-- allocation sites surviving a collection --");
+    ck_assert(surviving != NULL);
+    const char *site = strstr(surviving, "OBJ_INSTANCE     fill:5\n");
+    ck_assert(site != NULL);
+    while (site > surviving && site[-1] != '\n') {
+        site--;
+    }
+    unsigned long long survivors = 0, bytes = 0, allocated = 0;
+    ck_assert(sscanf(site, "%llu %llu %llu", &survivors, &bytes, &allocated) == 3);
+    ck_assert(survivors == 10);
+    ck_assert(allocated == 100);
+    ck_assert(bytes == 10 * sizeof(obj_instance_t));
+    free(report);
+    vm_t_free();
+}
+
+START_TEST(test_perf_map)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/tmp/perf-%ld.map", (long)getpid());
+    ck_assert(!profile_t_perf_map_close()); // never opened
+    ck_assert(profile_t_perf_map_open());
+
+    vm_t_init();
+    vm_toggle_jit();
+    ck_assert(vm_t_interpret("fn spin(n) { let t = 0; for (let k = 0; k < n; k += 1) { t = t + k; } return t; }\nassert(spin(3000) == 4498500);") == INTERPRET_OK);
+    vm_t_free();
+    ck_assert(profile_t_perf_map_close());
+
+    FILE *f = fopen(path, "r");
+    ck_assert(f != NULL);
+    char line[256] = {0};
+    const bool mapped = fgets(line, sizeof line, f) != NULL;
+    fclose(f);
+    unlink(path);
+#ifdef TATER_JIT
+    unsigned long long start = 0, size = 0;
+    char name[128] = {0};
+    ck_assert(mapped);
+    ck_assert(sscanf(line, "%llx %llx %127s", &start, &size, name) == 3);
+    ck_assert(start != 0 && size != 0);
+    ck_assert(strcmp(name, "tater:spin:1") == 0);
+#else
+    ck_assert(!mapped); // nothing native to name
+#endif
+}
+
+static unsigned long long metric_value(const char *path, const char *name)
+{
+    FILE *f = fopen(path, "r");
+    ck_assert(f != NULL);
+    char line[256];
+    unsigned long long value = 0;
+    bool found = false;
+    while (!found && fgets(line, sizeof line, f) != NULL) {
+        const size_t length = strlen(name);
+        found = strncmp(line, name, length) == 0 && line[length] == ' ' && sscanf(line + length, "%llu", &value) == 1;
+    }
+    fclose(f);
+    ck_assert_msg(found, "no %s in %s\n", name, path);
+    return value;
+}
+
+START_TEST(test_metrics)
+{
+    const char *path = "metrics.tmp";
+    unlink(path);
+    ck_assert(!metrics_t_stop()); // never started
+    ck_assert(!metrics_t_write());
+
+    vm_t_init();
+    ck_assert(metrics_t_start(path, 0));
+    ck_assert(vm.flags & VM_FLAG_METRICS);
+    ck_assert(vm_t_interpret("let f = file(\"metrics_file.tmp\", \"w\"); fn add(a, b) { return a + b; }") == INTERPRET_OK);
+    ck_assert(access(path, F_OK) == -1);
+    // SIGUSR1 only marks a write as pending, the next call makes it
+    raise(SIGUSR1);
+    ck_assert(metrics_pending);
+    ck_assert(vm_t_interpret("let t = 0; for (let i = 0; i < 100; i++) { t = add(t, i); } assert(t == 4950);") == INTERPRET_OK);
+    ck_assert(!metrics_pending);
+    ck_assert(access(path, R_OK) == 0);
+    ck_assert(metric_value(path, "tater_calls_total") > 0);
+    ck_assert(metric_value(path, "tater_open_files") == 1);
+
+    ck_assert(vm_t_interpret("f.close(); let l = list(); for (let i = 0; i < 10; i++) { l.append(list(i)); }") == INTERPRET_OK);
+    vm_collect_garbage();
+    ck_assert(metrics_t_stop()); // writes once more
+    ck_assert(!(vm.flags & VM_FLAG_METRICS));
+    ck_assert(metric_value(path, "tater_instructions_total") > 0); // an estimate
+    ck_assert(metric_value(path, "tater_calls_total") >= 111);
+    ck_assert(metric_value(path, "tater_allocations_total") >= 11);
+    ck_assert(metric_value(path, "tater_gc_cycles_total") >= 1);
+    ck_assert(metric_value(path, "tater_heap_bytes") == vm.bytes_allocated);
+    ck_assert(metric_value(path, "tater_interned_strings") > 0);
+    ck_assert(metric_value(path, "tater_open_files") == 0);
+    vm_t_free();
+    unlink(path);
+    unlink("metrics_file.tmp");
+
+    // native loops never reach the VM's checks for a pending write, so nothing is compiled while exporting
+    vm_t_init();
+    vm_toggle_jit();
+    ck_assert(metrics_t_start(path, 0));
+    ck_assert(vm_t_interpret("fn spin(n) { let t = 0; for (let i = 0; i < n; i++) { t = t + i; } return t; } spin(5000);") == INTERPRET_OK);
+    value_t spin;
+    ck_assert(table_t_get(&vm.globals, OBJ_VAL(obj_string_t_copy_from("spin", 4, true)), &spin));
+    ck_assert(AS_CLOSURE(spin)->function->jit == NULL);
+    ck_assert(metrics_t_stop());
+    vm_t_free();
+    unlink(path);
+
+    ck_assert(!metrics_t_start(path, -1));
+}
+
 int main(const int argc, const char *argv[])
 {
     const char *suite_name = "tater";
@@ -1052,6 +1846,10 @@ int main(const int argc, const char *argv[])
     tcase_add_test(tc, test_vm);
     suite_add_tcase(s, tc);
 
+    tc = tcase_create("optimizer");
+    tcase_add_test(tc, test_optimizer);
+    suite_add_tcase(s, tc);
+
     tc = tcase_create("native");
     tcase_add_test(tc, test_native);
     suite_add_tcase(s, tc);
@@ -1076,6 +1874,32 @@ int main(const int argc, const char *argv[])
     tcase_add_test(tc, test_env);
     suite_add_tcase(s, tc);
 
+    tc = tcase_create("cache");
+    tcase_add_test(tc, test_cache);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("image");
+    tcase_add_test(tc, test_image);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("jit");
+    tcase_add_test(tc, test_jit);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("aot");
+    tcase_add_test(tc, test_aot);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("profile");
+    tcase_add_test(tc, test_profile_hot);
+    tcase_add_test(tc, test_profile_sampler);
+    tcase_add_test(tc, test_profile_calls);
+    tcase_add_test(tc, test_opstats);
+    tcase_add_test(tc, test_alloc_profile);
+    tcase_add_test(tc, test_perf_map);
+    tcase_add_test(tc, test_metrics);
+    suite_add_tcase(s, tc);
+
     if (argc > 1) {
         for (int i = 1; i < argc; i++) {
             if (suite_tcase(s, argv[i])) {